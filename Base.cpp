@@ -295,7 +295,7 @@ namespace data
 		}	
 	}	
 
-	GzipDeflator::GzipDeflator (): m_IsDirty (false)
+	GzipDeflator::GzipDeflator (): m_CompressionLevel (Z_DEFAULT_COMPRESSION), m_IsDirty (false)
 	{
 		memset (&m_Deflator, 0, sizeof (m_Deflator));
 		deflateInit2 (&m_Deflator, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY); // 15 + 16 sets gzip
@@ -308,7 +308,15 @@ namespace data
 
 	void GzipDeflator::SetCompressionLevel (int level)
 	{
+		if (level == m_CompressionLevel) return;
+		if (m_IsDirty)
+		{
+			// reset first, deflateParams flushes if anything was compressed before
+			deflateReset (&m_Deflator);
+			m_IsDirty = false;
+		}
 		deflateParams (&m_Deflator, level, Z_DEFAULT_STRATEGY);
+		m_CompressionLevel = level;
 	}	
 	
 	size_t GzipDeflator::Deflate (const uint8_t * in, size_t inLen, uint8_t * out, size_t outLen)
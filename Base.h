@@ -109,12 +109,14 @@ namespace data
 			GzipDeflator ();
 			~GzipDeflator ();
 
-			void SetCompressionLevel (int level);
+			void SetCompressionLevel (int level); // no-op if the same
+			int GetCompressionLevel () const { return m_CompressionLevel; };
 			size_t Deflate (const uint8_t * in, size_t inLen, uint8_t * out, size_t outLen);
 			
 		private:
 
 			z_stream m_Deflator;
+			int m_CompressionLevel;
 			bool m_IsDirty;
 	};
 }
@@ -0,0 +1,371 @@
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <functional>
+#include <openssl/sha.h>
+#include <openssl/rand.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "Log.h"
+#include "Crypto.h"
+#include "Identity.h"
+#include "TunnelBase.h"
+#include "NetDbIndex.h"
+#include "TimerWheel.h"
+#include "Queue.h"
+#include "version.h"
+
+// microbenchmarks of crypto primitives, netDb lookups, timers and queues the router spends its CPU on
+// usage: benchmark [--json] [--time=<ms per benchmark>]
+
+namespace i2p
+{
+namespace benchmark
+{
+	struct Result
+	{
+		std::string name;
+		uint64_t numOps;
+		double opsPerSec;
+		double cyclesPerOp; // 0 if there is no cycle counter
+		size_t bytesPerOp; // 0 if not applicable
+	};
+
+	static uint64_t GetCycles ()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc ();
+#else
+		return 0;
+#endif
+	}
+
+	class Benchmarks
+	{
+		public:
+
+			Benchmarks (int duration): m_Duration (duration) {};
+
+			void Run (const std::string& name, std::function<void ()> op, size_t bytesPerOp = 0)
+			{
+				op (); // warm up
+				uint64_t numOps = 0, cycles = GetCycles ();
+				auto begin = std::chrono::steady_clock::now (), end = begin;
+				auto duration = std::chrono::milliseconds (m_Duration);
+				do
+				{
+					// check time every few ops only, some ops take nanoseconds
+					for (int i = 0; i < 16; i++) op ();
+					numOps += 16;
+					end = std::chrono::steady_clock::now ();
+				}
+				while (end - begin < duration);
+				cycles = GetCycles () - cycles;
+				double seconds = std::chrono::duration<double>(end - begin).count ();
+				m_Results.push_back ({ name, numOps, numOps/seconds, (double)cycles/numOps, bytesPerOp });
+				if (!m_IsJson)
+				{
+					std::cout << name << ": " << (uint64_t)(numOps/seconds) << " ops/sec";
+					if (cycles) std::cout << ", " << (uint64_t)((double)cycles/numOps) << " cycles/op";
+					if (bytesPerOp) std::cout << ", " << (uint64_t)(numOps*bytesPerOp/seconds/1048576) << " MB/sec";
+					std::cout << std::endl;
+				}
+			}
+
+			void SetJson (bool isJson) { m_IsJson = isJson; };
+
+			void PrintJson () const
+			{
+				std::cout << "{\n  \"version\": \"" << VERSION << "\",\n";
+				std::cout << "  \"aesni\": " << (i2p::crypto::IsAESNISupported () ? "true" : "false") << ",\n";
+				std::cout << "  \"aes_kernel\": \"" << i2p::crypto::GetAESKernelName (i2p::crypto::GetAESKernel ()) << "\",\n";
+				std::cout << "  \"results\": [\n";
+				for (size_t i = 0; i < m_Results.size (); i++)
+				{
+					auto& r = m_Results[i];
+					std::cout << "    { \"name\": \"" << r.name << "\", \"ops\": " << r.numOps <<
+						", \"ops_per_sec\": " << r.opsPerSec << ", \"cycles_per_op\": " << r.cyclesPerOp <<
+						", \"bytes_per_op\": " << r.bytesPerOp << " }" << (i + 1 < m_Results.size () ? "," : "") << "\n";
+				}
+				std::cout << "  ]\n}" << std::endl;
+			}
+
+		private:
+
+			int m_Duration; // in milliseconds
+			bool m_IsJson = false;
+			std::vector<Result> m_Results;
+	};
+
+	static void RunAsymmetric (Benchmarks& benchmarks)
+	{
+		uint8_t data[514], encrypted[514], decrypted[514];
+		RAND_bytes (data, 222);
+		auto keys = i2p::data::PrivateKeys::CreateRandomKeys ();
+		i2p::crypto::ElGamalEncryption elGamal (keys.GetPublic ()->GetStandardIdentity ().publicKey);
+		benchmarks.Run ("ElGamalEncryption::Encrypt", [&]() { elGamal.Encrypt (data, 222, encrypted); });
+		benchmarks.Run ("ElGamalDecrypt", [&]() { i2p::crypto::ElGamalDecrypt (keys.GetPrivateKey (), encrypted, decrypted); });
+
+		i2p::crypto::DHKeys dh, remote;
+		remote.GenerateKeys ();
+		uint8_t shared[256];
+		benchmarks.Run ("DHKeys::GenerateKeys", [&]() { dh.GenerateKeys (); });
+		benchmarks.Run ("DHKeys::Agree", [&]() { dh.Agree (remote.GetPublicKey (), shared); });
+
+		struct
+		{
+			i2p::data::SigningKeyType type;
+			const char * name;
+		} signatures[] =
+		{
+			{ i2p::data::SIGNING_KEY_TYPE_DSA_SHA1, "DSA-SHA1" },
+			{ i2p::data::SIGNING_KEY_TYPE_ECDSA_SHA256_P256, "ECDSA-SHA256-P256" },
+			{ i2p::data::SIGNING_KEY_TYPE_ECDSA_SHA384_P384, "ECDSA-SHA384-P384" },
+			{ i2p::data::SIGNING_KEY_TYPE_ECDSA_SHA512_P521, "ECDSA-SHA512-P521" },
+			{ i2p::data::SIGNING_KEY_TYPE_RSA_SHA256_2048, "RSA-SHA256-2048" },
+			{ i2p::data::SIGNING_KEY_TYPE_RSA_SHA384_3072, "RSA-SHA384-3072" },
+			{ i2p::data::SIGNING_KEY_TYPE_RSA_SHA512_4096, "RSA-SHA512-4096" },
+			{ i2p::data::SIGNING_KEY_TYPE_EDDSA_SHA512_ED25519, "EdDSA-SHA512-Ed25519" }
+		};
+		uint8_t signature[1024];
+		for (auto& it: signatures)
+		{
+			auto signer = i2p::data::PrivateKeys::CreateRandomKeys (it.type);
+			auto verifier = signer.GetPublic ();
+			std::string name (it.name);
+			// 1K is typical size of signed data
+			benchmarks.Run (name + " Signer::Sign", [&]() { signer.Sign (data, 512, signature); });
+			benchmarks.Run (name + " Verifier::Verify", [&]() { verifier->Verify (data, 512, signature); });
+		}
+	}
+
+	static void RunSymmetric (Benchmarks& benchmarks, const std::string& kernel)
+	{
+		// keys must be set after the kernel is selected
+		i2p::crypto::AESKey layerKey, ivKey;
+		RAND_bytes (layerKey, 32);
+		RAND_bytes (ivKey, 32);
+		const int maxNumMsgs = i2p::crypto::TUNNEL_CRYPTO_NUM_LANES;
+		i2p::crypto::AESAlignedBuffer<1024*maxNumMsgs> buf;
+		const uint8_t * in[maxNumMsgs];
+		uint8_t * out[maxNumMsgs];
+		for (int i = 0; i < maxNumMsgs; i++)
+			in[i] = out[i] = (uint8_t *)buf + i*1024;
+		RAND_bytes (buf, 1024*maxNumMsgs);
+
+		i2p::crypto::TunnelEncryption tunnelEncryption;
+		tunnelEncryption.SetKeys (layerKey, ivKey);
+		i2p::crypto::TunnelDecryption tunnelDecryption;
+		tunnelDecryption.SetKeys (layerKey, ivKey);
+		// messages of the same tunnel processed at once, ops/sec times lanes is messages/sec
+		for (int numMsgs: { 1, 4, 8, 16 })
+		{
+			benchmarks.Run ("TunnelEncryption::Encrypt x" + std::to_string (numMsgs) + " " + kernel,
+				[&]() { tunnelEncryption.Encrypt (numMsgs, in, out); }, 1024*numMsgs);
+			benchmarks.Run ("TunnelDecryption::Decrypt x" + std::to_string (numMsgs) + " " + kernel,
+				[&]() { tunnelDecryption.Decrypt (numMsgs, in, out); }, 1024*numMsgs);
+		}
+
+		i2p::crypto::CBCEncryption cbcEncryption;
+		cbcEncryption.SetKey (layerKey);
+		cbcEncryption.SetIV (ivKey);
+		benchmarks.Run ("CBCEncryption::Encrypt " + kernel, [&]() { cbcEncryption.Encrypt (buf, 1024, buf); }, 1024);
+		i2p::crypto::CBCDecryption cbcDecryption;
+		cbcDecryption.SetKey (layerKey);
+		cbcDecryption.SetIV (ivKey);
+		benchmarks.Run ("CBCDecryption::Decrypt " + kernel, [&]() { cbcDecryption.Decrypt (buf, 1024, buf); }, 1024);
+	}
+
+	static void RunNetDb (Benchmarks& benchmarks)
+	{
+		const int numKeys = 1024;
+		std::vector<i2p::data::IdentHash> keys (numKeys);
+		for (auto& it: keys)
+			RAND_bytes (it, 32);
+		int ind = 0;
+		benchmarks.Run ("CreateRoutingKey", [&]() { i2p::data::CreateRoutingKey (keys[ind++ % numKeys]); });
+
+		std::set<i2p::data::IdentHash> excluded;
+		for (int i = 0; i < 10; i++) excluded.insert (keys[i]);
+		for (int numFloodfills: { 1000, 5000, 10000, 50000 })
+		{
+			std::map<i2p::data::IdentHash, std::shared_ptr<i2p::data::RouterInfo> > floodfills;
+			i2p::data::IdentHash ident;
+			for (int i = 0; i < numFloodfills; i++)
+			{
+				RAND_bytes (ident, 32);
+				floodfills[ident] = nullptr;
+			}
+			for (int i = 0; i < 10; i++) excluded.insert (std::next (floodfills.begin (), rand () % numFloodfills)->first);
+			std::vector<i2p::data::IdentHash> res;
+			// 3 closest, as for DatabaseSearchReply
+			benchmarks.Run ("GetClosestFloodfills " + std::to_string (numFloodfills) + " floodfills", [&]()
+				{
+					res.clear ();
+					i2p::data::VisitClosestRouters (floodfills, keys[ind++ % numKeys],
+						[&res, &excluded](const std::pair<const i2p::data::IdentHash, std::shared_ptr<i2p::data::RouterInfo> >& it)->bool
+						{
+							if (!excluded.count (it.first)) res.push_back (it.first);
+							return res.size () < 3;
+						});
+				});
+			// linear scan we had before, for comparison
+			benchmarks.Run ("GetClosestFloodfill scan " + std::to_string (numFloodfills) + " floodfills", [&]()
+				{
+					auto& key = keys[ind++ % numKeys];
+					i2p::data::XORMetric minMetric;
+					minMetric.SetMax ();
+					for (auto& it: floodfills)
+					{
+						i2p::data::XORMetric m = key ^ it.first;
+						if (m < minMetric && !excluded.count (it.first))
+						{
+							minMetric = m;
+							ident = it.first;
+						}
+					}
+				});
+		}
+	}
+
+	static void RunTimers (Benchmarks& benchmarks)
+	{
+		// sessions and streams rearm their timers on every packet
+		boost::asio::io_service service;
+		boost::asio::io_service::work work (service);
+		auto handler = [](const boost::system::error_code&) {};
+		for (int numTimers: { 1000, 10000, 100000 })
+		{
+			{
+				std::vector<std::unique_ptr<boost::asio::deadline_timer> > timers;
+				for (int i = 0; i < numTimers; i++)
+				{
+					timers.emplace_back (new boost::asio::deadline_timer (service));
+					timers.back ()->expires_from_now (boost::posix_time::milliseconds (30000 + rand () % 30000));
+					timers.back ()->async_wait (handler);
+				}
+				benchmarks.Run ("deadline_timer rearm " + std::to_string (numTimers) + " timers", [&]()
+					{
+						auto& timer = timers[rand () % numTimers];
+						timer->expires_from_now (boost::posix_time::milliseconds (30000 + rand () % 30000));
+						timer->async_wait (handler);
+						service.poll (); // aborted handler
+					});
+			}
+			service.poll ();
+			{
+				std::vector<std::unique_ptr<i2p::util::WheelTimer> > timers;
+				for (int i = 0; i < numTimers; i++)
+				{
+					timers.emplace_back (new i2p::util::WheelTimer (service));
+					timers.back ()->AsyncWait (30000 + rand () % 30000, handler);
+				}
+				benchmarks.Run ("WheelTimer rearm " + std::to_string (numTimers) + " timers", [&]()
+					{
+						timers[rand () % numTimers]->AsyncWait (30000 + rand () % 30000, handler);
+						service.poll (); // aborted handler
+					});
+			}
+			service.poll ();
+		}
+	}
+
+	template<typename Queue>
+	static void RunQueue (Benchmarks& benchmarks, const std::string& name)
+	{
+		// one consumer and many producers, as transports and tunnels have
+		static int element;
+		for (int numProducers: { 1, 2, 4, 8, 16 })
+		{
+			Queue queue;
+			std::atomic<bool> isRunning (true);
+			std::vector<std::thread> producers;
+			for (int i = 0; i < numProducers; i++)
+				producers.emplace_back ([&queue, &isRunning]()
+					{
+						// keep queue about full, ring overflows sometimes
+						const int maxSize = 2*i2p::util::LOCK_FREE_QUEUE_DEFAULT_CAPACITY;
+						while (isRunning)
+						{
+							if (queue.GetSize () < maxSize)
+								queue.Put (&element);
+							else
+								std::this_thread::yield ();
+						}
+					});
+			benchmarks.Run (name + " " + std::to_string (numProducers) + " producers", [&queue]() { queue.GetNext (); });
+			isRunning = false;
+			for (auto& it: producers) it.join ();
+		}
+	}
+
+	static void RunQueues (Benchmarks& benchmarks)
+	{
+		RunQueue<i2p::util::Queue<int *> > (benchmarks, "Queue");
+		RunQueue<i2p::util::LockFreeQueue<int *> > (benchmarks, "LockFreeQueue");
+	}
+
+	static void Run (int argc, char * argv[])
+	{
+		bool isJson = false;
+		int duration = 1000;
+		for (int i = 1; i < argc; i++)
+		{
+			std::string arg (argv[i]);
+			if (arg == "--json")
+				isJson = true;
+			else if (arg.compare (0, 7, "--time=") == 0)
+				duration = std::stoi (arg.substr (7));
+			else
+			{
+				std::cerr << "Usage: " << argv[0] << " [--json] [--time=<ms per benchmark>]" << std::endl;
+				return;
+			}
+		}
+		if (isJson)
+		{
+			// log goes to stderr, keep it quiet for scripts reading JSON
+			StartLog ("");
+			g_Log->SetLogLevel ("error");
+		}
+		i2p::crypto::InitCrypto ();
+
+		Benchmarks benchmarks (duration);
+		benchmarks.SetJson (isJson);
+		RunAsymmetric (benchmarks);
+		for (int k = 0; k < i2p::crypto::eNumAESKernels; k++)
+		{
+			auto kernel = (i2p::crypto::AESKernel)k;
+			if (!i2p::crypto::IsAESKernelSupported (kernel)) break;
+			i2p::crypto::SetAESKernel (kernel);
+			RunSymmetric (benchmarks, i2p::crypto::GetAESKernelName (kernel));
+		}
+		uint8_t data[1024], hash[32];
+		RAND_bytes (data, 1024);
+		benchmarks.Run ("SHA256", [&]() { SHA256 (data, 1024, hash); }, 1024);
+		RunNetDb (benchmarks);
+		RunTimers (benchmarks);
+		RunQueues (benchmarks);
+
+		if (isJson) benchmarks.PrintJson ();
+		i2p::crypto::TerminateCrypto ();
+		StopLog ();
+	}
+}
+}
+
+int main (int argc, char * argv[])
+{
+	i2p::benchmark::Run (argc, argv);
+	return EXIT_SUCCESS;
+}
@@ -29,6 +29,12 @@ namespace client
 	
 	void ClientContext::Start ()
 	{
+		int numDestinationThreads = i2p::util::config::GetArg("-destinationthreads", 0);
+		if (numDestinationThreads > 0 && !m_DestinationsServicePool)
+			m_DestinationsServicePool.reset (new i2p::util::ServicePool (numDestinationThreads, "Destinations"));
+		if (m_DestinationsServicePool)
+			m_DestinationsServicePool->Start ();
+
 		if (!m_SharedLocalDestination)
 		{	
 			m_SharedLocalDestination = CreateNewLocalDestination (); // non-public, DSA
@@ -132,7 +138,10 @@ namespace client
 		for (auto it: m_Destinations)
 			it.second->Stop ();
 		m_Destinations.clear ();
-		m_SharedLocalDestination = nullptr; 
+		m_SharedLocalDestination = nullptr;
+		// destinations might be still referenced, keep services until exit
+		if (m_DestinationsServicePool)
+			m_DestinationsServicePool->Stop (); 
 	}	
 	
 	void ClientContext::LoadPrivateKeys (i2p::data::PrivateKeys& keys, const std::string& filename,  i2p::data::SigningKeyType sigType)
@@ -169,7 +178,7 @@ namespace client
 		const std::map<std::string, std::string> * params)
 	{
 		i2p::data::PrivateKeys keys = i2p::data::PrivateKeys::CreateRandomKeys (sigType);
-		auto localDestination = std::make_shared<ClientDestination> (keys, isPublic, params);
+		auto localDestination = std::make_shared<ClientDestination> (keys, isPublic, params, m_DestinationsServicePool.get ());
 		std::unique_lock<std::mutex> l(m_DestinationsMutex);
 		m_Destinations[localDestination->GetIdentHash ()] = localDestination;
 		localDestination->Start ();
@@ -205,7 +214,7 @@ namespace client
 			}	
 			return nullptr;
 		}	
-		auto localDestination = std::make_shared<ClientDestination> (keys, isPublic, params);
+		auto localDestination = std::make_shared<ClientDestination> (keys, isPublic, params, m_DestinationsServicePool.get ());
 		std::unique_lock<std::mutex> l(m_DestinationsMutex);
 		m_Destinations[keys.GetPublic ()->GetIdentHash ()] = localDestination;
 		localDestination->Start ();
@@ -66,6 +66,7 @@ namespace client
 
 		private:
 
+			std::unique_ptr<i2p::util::ServicePool> m_DestinationsServicePool; // nullptr if destinations run own threads
 			std::mutex m_DestinationsMutex;
 			std::map<i2p::data::IdentHash, std::shared_ptr<ClientDestination> > m_Destinations;
 			std::shared_ptr<ClientDestination>  m_SharedLocalDestination;	
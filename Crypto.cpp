@@ -3,6 +3,7 @@
 #include <vector>
 #include <mutex>
 #include <memory>
+#include <algorithm>
 #include <openssl/sha.h>
 #include <openssl/dh.h>
 #include <openssl/md5.h>
@@ -12,6 +13,9 @@
 #include <openssl/ssl.h>
 #include "Log.h"
 #include "Crypto.h"
+#ifdef AESNI
+#include <cpuid.h>
+#endif
 
 namespace i2p
 {
@@ -337,6 +341,85 @@ namespace crypto
 	}
 
 // AES
+#ifdef AESNI
+	static bool DetectAESNI ()
+	{
+		unsigned int eax, ebx, ecx, edx;
+		if (__get_cpuid (1, &eax, &ebx, &ecx, &edx))
+			return ecx & bit_AES;
+		return false;
+	}	
+
+#if defined(__x86_64__) && (defined(__clang__) ? __clang_major__ >= 6 : __GNUC__ >= 8) 
+#define AESNI_VAES // assembler knows VAES
+	static bool DetectVAES ()
+	{
+		unsigned int eax, ebx, ecx, edx;
+		if (!__get_cpuid (1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_AVX) || !(ecx & bit_OSXSAVE))
+			return false;
+		uint32_t xcr0, xcr0h;	
+		__asm__ ("xgetbv" : "=a"(xcr0), "=d"(xcr0h) : "c"(0));
+		if ((xcr0 & 0x06) != 0x06) return false; // ymm registers are not saved by OS
+		if (__get_cpuid_max (0, nullptr) < 7) return false;
+		__cpuid_count (7, 0, eax, ebx, ecx, edx);
+		return (ebx & (1 << 5)) && (ecx & (1 << 9)); // AVX2 and VAES
+	}	
+
+	static bool DetectVAES512 () // VAES is detected already
+	{
+		uint32_t xcr0, xcr0h;	
+		__asm__ ("xgetbv" : "=a"(xcr0), "=d"(xcr0h) : "c"(0));
+		if ((xcr0 & 0xE6) != 0xE6) return false; // opmask and zmm registers are not saved by OS
+		unsigned int eax, ebx, ecx, edx;
+		__cpuid_count (7, 0, eax, ebx, ecx, edx);
+		return ebx & (1 << 16); // AVX-512F
+	}	
+#endif	
+#endif
+
+	static AESKernel DetectAESKernel () // best supported by CPU
+	{
+#ifdef AESNI
+		if (DetectAESNI ())
+		{
+#ifdef AESNI_VAES
+			if (DetectVAES ()) return DetectVAES512 () ? eAESKernelVAES512 : eAESKernelVAES;
+#endif
+			return eAESKernelAESNI;
+		}	
+#endif
+		return eAESKernelPortable;
+	}
+
+	static const char * g_AESKernelNames[eNumAESKernels] = { "portable", "AES-NI", "VAES", "VAES-512" };
+	static AESKernel g_MaxAESKernel = DetectAESKernel (); // lowered if self-test fails
+	static AESKernel g_AESKernel = g_MaxAESKernel; // for keys being set
+
+	bool IsAESNISupported ()
+	{
+		return g_MaxAESKernel != eAESKernelPortable;
+	}	
+
+	bool IsAESKernelSupported (AESKernel kernel)
+	{
+		return kernel <= g_MaxAESKernel;
+	}	
+
+	const char * GetAESKernelName (AESKernel kernel)
+	{
+		return (kernel >= 0 && kernel < eNumAESKernels) ? g_AESKernelNames[kernel] : "unknown";
+	}	
+
+	AESKernel GetAESKernel ()
+	{
+		return g_AESKernel;
+	}	
+
+	void SetAESKernel (AESKernel kernel)
+	{
+		g_AESKernel = std::min (kernel, g_MaxAESKernel);
+	}	
+
 	#ifdef AESNI
 	
 	#define KeyExpansion256(round0,round1) \
@@ -362,7 +445,7 @@ namespace crypto
 		"pxor %%xmm2, %%xmm3 \n" \
 		"movaps	%%xmm3, "#round1"(%[sched]) \n" 
 
-	void ECBCryptoAESNI::ExpandKey (const AESKey& key)
+	void ECBCrypto::ExpandKey (const AESKey& key)
 	{
 		__asm__
 		(
@@ -417,16 +500,6 @@ namespace crypto
 		"aesenc	208(%["#sched"]), %%xmm0 \n" \
 		"aesenclast	224(%["#sched"]), %%xmm0 \n"
 		
-	void ECBEncryptionAESNI::Encrypt (const ChipherBlock * in, ChipherBlock * out)
-	{
-		__asm__
-		(
-			"movups	(%[in]), %%xmm0 \n"
-			EncryptAES256(sched)
-			"movups	%%xmm0, (%[out]) \n"	
-			: : [sched]"r"(GetKeySchedule ()), [in]"r"(in), [out]"r"(out) : "%xmm0", "memory"
-		);
-	}		
 
 	#define DecryptAES256(sched) \
 		"pxor 224(%["#sched"]), %%xmm0 \n" \
@@ -445,78 +518,127 @@ namespace crypto
 		"aesdec	16(%["#sched"]), %%xmm0 \n" \
 		"aesdeclast (%["#sched"]), %%xmm0 \n"
 	
-	void ECBDecryptionAESNI::Decrypt (const ChipherBlock * in, ChipherBlock * out)
-	{
-		__asm__
-		(
-			"movups	(%[in]), %%xmm0 \n"
-			DecryptAES256(sched)
-			"movups	%%xmm0, (%[out]) \n"	
-			: : [sched]"r"(GetKeySchedule ()), [in]"r"(in), [out]"r"(out) : "%xmm0", "memory"
-		);		
-	}
 
 	#define CallAESIMC(offset) \
 		"movaps "#offset"(%[shed]), %%xmm0 \n"	\
 		"aesimc %%xmm0, %%xmm0 \n" \
 		"movaps %%xmm0, "#offset"(%[shed]) \n" 
 
-	void ECBDecryptionAESNI::SetKey (const AESKey& key)
+#endif		
+
+	void ECBEncryption::SetKey (const AESKey& key)
 	{
-		ExpandKey (key); // expand encryption key first
-		// then  invert it using aesimc
-		__asm__
-		(
-			CallAESIMC(16)
-			CallAESIMC(32)
-			CallAESIMC(48)
-			CallAESIMC(64)
-			CallAESIMC(80)
-			CallAESIMC(96)
-			CallAESIMC(112)
-			CallAESIMC(128)
-			CallAESIMC(144)
-			CallAESIMC(160)
-			CallAESIMC(176)
-			CallAESIMC(192)
-			CallAESIMC(208)
-			: : [shed]"r"(GetKeySchedule ()) : "%xmm0", "memory"
-		);
+		m_Kernel = g_AESKernel;
+#ifdef AESNI
+		if (IsAESNI ())
+		{	
+			ExpandKey (key);
+			return;
+		}	
+#endif
+		AES_set_encrypt_key (key, 256, GetAESKey ());
+	}	
+
+	void ECBEncryption::Encrypt (const ChipherBlock * in, ChipherBlock * out)
+	{
+#ifdef AESNI
+		if (IsAESNI ())
+		{	
+			__asm__
+			(
+				"movups	(%[in]), %%xmm0 \n"
+				EncryptAES256(sched)
+				"movups	%%xmm0, (%[out]) \n"	
+				: : [sched]"r"(GetKeySchedule ()), [in]"r"(in), [out]"r"(out) : "%xmm0", "memory"
+			);
+			return;
+		}	
+#endif
+		AES_encrypt (in->buf, out->buf, GetAESKey ());
+	}		
+
+	void ECBDecryption::SetKey (const AESKey& key)
+	{
+		m_Kernel = g_AESKernel;
+#ifdef AESNI
+		if (IsAESNI ())
+		{	
+			ExpandKey (key); // expand encryption key first
+			// then  invert it using aesimc
+			__asm__
+			(
+				CallAESIMC(16)
+				CallAESIMC(32)
+				CallAESIMC(48)
+				CallAESIMC(64)
+				CallAESIMC(80)
+				CallAESIMC(96)
+				CallAESIMC(112)
+				CallAESIMC(128)
+				CallAESIMC(144)
+				CallAESIMC(160)
+				CallAESIMC(176)
+				CallAESIMC(192)
+				CallAESIMC(208)
+				: : [shed]"r"(GetKeySchedule ()) : "%xmm0", "memory"
+			);
+			return;
+		}	
+#endif
+		AES_set_decrypt_key (key, 256, GetAESKey ()); 
 	}
 
-#endif		
+	void ECBDecryption::Decrypt (const ChipherBlock * in, ChipherBlock * out)
+	{
+#ifdef AESNI
+		if (IsAESNI ())
+		{	
+			__asm__
+			(
+				"movups	(%[in]), %%xmm0 \n"
+				DecryptAES256(sched)
+				"movups	%%xmm0, (%[out]) \n"	
+				: : [sched]"r"(GetKeySchedule ()), [in]"r"(in), [out]"r"(out) : "%xmm0", "memory"
+			);		
+			return;
+		}	
+#endif
+		AES_decrypt (in->buf, out->buf, GetAESKey ());
+	}
 
 
 	void CBCEncryption::Encrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out)
 	{
 #ifdef AESNI
-		__asm__
-		(
-		 	"movups	(%[iv]), %%xmm1 \n"
-		 	"1: \n"
-		 	"movups	(%[in]), %%xmm0 \n"
-		 	"pxor %%xmm1, %%xmm0 \n"
-		 	EncryptAES256(sched)
-		 	"movaps	%%xmm0, %%xmm1 \n"	
-		 	"movups	%%xmm0, (%[out]) \n"
-		 	"add $16, %[in] \n"
-		 	"add $16, %[out] \n"
-		 	"dec %[num] \n"
-		 	"jnz 1b \n"	 	
-		 	"movups	%%xmm1, (%[iv]) \n"
-			: 
-			: [iv]"r"(&m_LastBlock), [sched]"r"(m_ECBEncryption.GetKeySchedule ()), 
-			  [in]"r"(in), [out]"r"(out), [num]"r"(numBlocks)
-			: "%xmm0", "%xmm1", "cc", "memory"
-		); 
-#else		
+		if (m_ECBEncryption.IsAESNI ())
+		{
+			__asm__ __volatile__
+			(
+			 	"movups	(%[iv]), %%xmm1 \n"
+			 	"1: \n"
+			 	"movups	(%[in]), %%xmm0 \n"
+			 	"pxor %%xmm1, %%xmm0 \n"
+			 	EncryptAES256(sched)
+			 	"movaps	%%xmm0, %%xmm1 \n"	
+			 	"movups	%%xmm0, (%[out]) \n"
+			 	"add $16, %[in] \n"
+			 	"add $16, %[out] \n"
+			 	"dec %[num] \n"
+			 	"jnz 1b \n"	 	
+			 	"movups	%%xmm1, (%[iv]) \n"
+				: [in]"+r"(in), [out]"+r"(out), [num]"+r"(numBlocks)
+				: [iv]"r"(&m_LastBlock), [sched]"r"(m_ECBEncryption.GetKeySchedule ())
+				: "%xmm0", "%xmm1", "cc", "memory"
+			); 
+			return;
+		}
+#endif
 		for (int i = 0; i < numBlocks; i++)
 		{
 			m_LastBlock ^= in[i];
 			m_ECBEncryption.Encrypt (&m_LastBlock, &m_LastBlock);
 			out[i] = m_LastBlock;
 		}
-#endif		
 	}
 
 	void CBCEncryption::Encrypt (const uint8_t * in, std::size_t len, uint8_t * out)
@@ -530,48 +652,54 @@ namespace crypto
 	void CBCEncryption::Encrypt (const uint8_t * in, uint8_t * out)
 	{
 #ifdef AESNI
-		__asm__
-		(
-			"movups	(%[iv]), %%xmm1 \n"
-			"movups	(%[in]), %%xmm0 \n"
-		 	"pxor %%xmm1, %%xmm0 \n"
-		 	EncryptAES256(sched)
-			"movups	%%xmm0, (%[out]) \n"
-			"movups	%%xmm0, (%[iv]) \n"
-			: 
-			: [iv]"r"(&m_LastBlock), [sched]"r"(m_ECBEncryption.GetKeySchedule ()), 
-			  [in]"r"(in), [out]"r"(out)
-			: "%xmm0", "%xmm1", "memory"
-		);		
-#else
-		Encrypt (1, (const ChipherBlock *)in, (ChipherBlock *)out); 
+		if (m_ECBEncryption.IsAESNI ())
+		{
+			__asm__
+			(
+				"movups	(%[iv]), %%xmm1 \n"
+				"movups	(%[in]), %%xmm0 \n"
+			 	"pxor %%xmm1, %%xmm0 \n"
+			 	EncryptAES256(sched)
+				"movups	%%xmm0, (%[out]) \n"
+				"movups	%%xmm0, (%[iv]) \n"
+				: 
+				: [iv]"r"(&m_LastBlock), [sched]"r"(m_ECBEncryption.GetKeySchedule ()), 
+				  [in]"r"(in), [out]"r"(out)
+				: "%xmm0", "%xmm1", "memory"
+			);		
+			return;
+		}
 #endif
+		Encrypt (1, (const ChipherBlock *)in, (ChipherBlock *)out); 
 	}
 
 	void CBCDecryption::Decrypt (int numBlocks, const ChipherBlock * in, ChipherBlock * out)
 	{
 #ifdef AESNI
-		__asm__
-		(
-			"movups	(%[iv]), %%xmm1 \n"
-		 	"1: \n"
-		 	"movups	(%[in]), %%xmm0 \n"
-			"movaps %%xmm0, %%xmm2 \n"
-		 	DecryptAES256(sched)
-			"pxor %%xmm1, %%xmm0 \n"
-		 	"movups	%%xmm0, (%[out]) \n"
-			"movaps %%xmm2, %%xmm1 \n"
-		 	"add $16, %[in] \n"
-		 	"add $16, %[out] \n"
-		 	"dec %[num] \n"
-		 	"jnz 1b \n"	 	
-		 	"movups	%%xmm1, (%[iv]) \n"
-			: 
-			: [iv]"r"(&m_IV), [sched]"r"(m_ECBDecryption.GetKeySchedule ()), 
-			  [in]"r"(in), [out]"r"(out), [num]"r"(numBlocks)
-			: "%xmm0", "%xmm1", "%xmm2", "cc", "memory"
-		); 
-#else
+		if (m_ECBDecryption.IsAESNI ())
+		{
+			__asm__ __volatile__
+			(
+				"movups	(%[iv]), %%xmm1 \n"
+			 	"1: \n"
+			 	"movups	(%[in]), %%xmm0 \n"
+				"movaps %%xmm0, %%xmm2 \n"
+			 	DecryptAES256(sched)
+				"pxor %%xmm1, %%xmm0 \n"
+			 	"movups	%%xmm0, (%[out]) \n"
+				"movaps %%xmm2, %%xmm1 \n"
+			 	"add $16, %[in] \n"
+			 	"add $16, %[out] \n"
+			 	"dec %[num] \n"
+			 	"jnz 1b \n"	 	
+			 	"movups	%%xmm1, (%[iv]) \n"
+				: [in]"+r"(in), [out]"+r"(out), [num]"+r"(numBlocks)
+				: [iv]"r"(&m_IV), [sched]"r"(m_ECBDecryption.GetKeySchedule ())
+				: "%xmm0", "%xmm1", "%xmm2", "cc", "memory"
+			); 
+			return;
+		}
+#endif
 		for (int i = 0; i < numBlocks; i++)
 		{
 			ChipherBlock tmp = in[i];
@@ -579,7 +707,6 @@ namespace crypto
 			out[i] ^= m_IV;
 			m_IV = tmp;
 		}
-#endif
 	}
 
 	void CBCDecryption::Decrypt (const uint8_t * in, std::size_t len, uint8_t * out)
@@ -592,95 +719,849 @@ namespace crypto
 	void CBCDecryption::Decrypt (const uint8_t * in, uint8_t * out)
 	{
 #ifdef AESNI
-		__asm__
-		(
-			"movups	(%[iv]), %%xmm1 \n"
-		 	"movups	(%[in]), %%xmm0 \n"
-			"movups	%%xmm0, (%[iv]) \n"
-		 	DecryptAES256(sched)
-			"pxor %%xmm1, %%xmm0 \n"
-		 	"movups	%%xmm0, (%[out]) \n"	
-			: 
-			: [iv]"r"(&m_IV), [sched]"r"(m_ECBDecryption.GetKeySchedule ()), 
-			  [in]"r"(in), [out]"r"(out)
-			: "%xmm0", "%xmm1", "memory"
-		);
-#else
-		Decrypt (1, (const ChipherBlock *)in, (ChipherBlock *)out); 
+		if (m_ECBDecryption.IsAESNI ())
+		{
+			__asm__
+			(
+				"movups	(%[iv]), %%xmm1 \n"
+			 	"movups	(%[in]), %%xmm0 \n"
+				"movups	%%xmm0, (%[iv]) \n"
+			 	DecryptAES256(sched)
+				"pxor %%xmm1, %%xmm0 \n"
+			 	"movups	%%xmm0, (%[out]) \n"	
+				: 
+				: [iv]"r"(&m_IV), [sched]"r"(m_ECBDecryption.GetKeySchedule ()), 
+				  [in]"r"(in), [out]"r"(out)
+				: "%xmm0", "%xmm1", "memory"
+			);
+			return;
+		}
 #endif
+		Decrypt (1, (const ChipherBlock *)in, (ChipherBlock *)out); 
 	}
 
 	void TunnelEncryption::Encrypt (const uint8_t * in, uint8_t * out)
 	{
 #ifdef AESNI
-		__asm__
-		(
-            // encrypt IV 
-			"movups	(%[in]), %%xmm0 \n"
-			EncryptAES256(sched_iv)
-			"movaps %%xmm0, %%xmm1 \n"
-			// double IV encryption
-			EncryptAES256(sched_iv)
-			"movups %%xmm0, (%[out]) \n"
-			// encrypt data, IV is xmm1
-			"1: \n"
-			"add $16, %[in] \n"
-		    "add $16, %[out] \n"
-		 	"movups	(%[in]), %%xmm0 \n"
-		 	"pxor %%xmm1, %%xmm0 \n"
-		 	EncryptAES256(sched_l)
-		 	"movaps	%%xmm0, %%xmm1 \n"	
-		 	"movups	%%xmm0, (%[out]) \n"
-		 	"dec %[num] \n"
-		 	"jnz 1b \n"	 	
-			: 
-			: [sched_iv]"r"(m_IVEncryption.GetKeySchedule ()), [sched_l]"r"(m_LayerEncryption.GetKeySchedule ()), 
-			  [in]"r"(in), [out]"r"(out), [num]"r"(63) // 63 blocks = 1008 bytes
-			: "%xmm0", "%xmm1", "cc", "memory"
-		);
-#else
+		if (m_LayerEncryption.IsAESNI ())
+		{
+			int numBlocks = 63; // 63 blocks = 1008 bytes
+			__asm__ __volatile__
+			(
+	            // encrypt IV 
+				"movups	(%[in]), %%xmm0 \n"
+				EncryptAES256(sched_iv)
+				"movaps %%xmm0, %%xmm1 \n"
+				// double IV encryption
+				EncryptAES256(sched_iv)
+				"movups %%xmm0, (%[out]) \n"
+				// encrypt data, IV is xmm1
+				"1: \n"
+				"add $16, %[in] \n"
+			    "add $16, %[out] \n"
+			 	"movups	(%[in]), %%xmm0 \n"
+			 	"pxor %%xmm1, %%xmm0 \n"
+			 	EncryptAES256(sched_l)
+			 	"movaps	%%xmm0, %%xmm1 \n"	
+			 	"movups	%%xmm0, (%[out]) \n"
+			 	"dec %[num] \n"
+			 	"jnz 1b \n"	 	
+				: [in]"+r"(in), [out]"+r"(out), [num]"+r"(numBlocks)
+				: [sched_iv]"r"(m_IVEncryption.GetKeySchedule ()), [sched_l]"r"(m_LayerEncryption.GetKeySchedule ())
+				: "%xmm0", "%xmm1", "cc", "memory"
+			);
+			return;
+		}
+#endif
 		m_IVEncryption.Encrypt ((const ChipherBlock *)in, (ChipherBlock *)out); // iv
-		m_LayerEncryption.SetIV (out);
-		m_LayerEncryption.Encrypt (in + 16, i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE, out + 16); // data
+		// data, CBC with encrypted iv 
+		ChipherBlock lastBlock;
+		memcpy (lastBlock.buf, out, 16);
+		auto inBlocks = (const ChipherBlock *)(in + 16);
+		auto outBlocks = (ChipherBlock *)(out + 16);
+		for (size_t i = 0; i < i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE/16; i++)
+		{
+			lastBlock ^= inBlocks[i];
+			m_LayerEncryption.Encrypt (&lastBlock, &lastBlock);
+			outBlocks[i] = lastBlock;
+		}	
 		m_IVEncryption.Encrypt ((ChipherBlock *)out, (ChipherBlock *)out); // double iv
-#endif
 	}
 
 	void TunnelDecryption::Decrypt (const uint8_t * in, uint8_t * out)
 	{
 #ifdef AESNI
-		__asm__
+		if (m_LayerDecryption.IsAESNI ())
+		{
+			int numBlocks = 63; // 63 blocks = 1008 bytes
+			__asm__ __volatile__
+			(
+	            // decrypt IV 
+				"movups	(%[in]), %%xmm0 \n"
+				DecryptAES256(sched_iv)
+				"movaps %%xmm0, %%xmm1 \n"
+				// double IV encryption
+				DecryptAES256(sched_iv)
+				"movups %%xmm0, (%[out]) \n"
+				// decrypt data, IV is xmm1
+				"1: \n"
+				"add $16, %[in] \n"
+			    "add $16, %[out] \n"
+				"movups	(%[in]), %%xmm0 \n"
+				"movaps %%xmm0, %%xmm2 \n"
+			 	DecryptAES256(sched_l)
+				"pxor %%xmm1, %%xmm0 \n"
+			 	"movups	%%xmm0, (%[out]) \n"
+				"movaps %%xmm2, %%xmm1 \n"
+			 	"dec %[num] \n"
+			 	"jnz 1b \n"	 	
+				: [in]"+r"(in), [out]"+r"(out), [num]"+r"(numBlocks)
+				: [sched_iv]"r"(m_IVDecryption.GetKeySchedule ()), [sched_l]"r"(m_LayerDecryption.GetKeySchedule ())
+				: "%xmm0", "%xmm1", "%xmm2", "cc", "memory"
+			);
+			return;
+		}
+#endif
+		m_IVDecryption.Decrypt ((const ChipherBlock *)in, (ChipherBlock *)out); // iv
+		// data, CBC with decrypted iv 
+		ChipherBlock iv;
+		memcpy (iv.buf, out, 16);
+		auto inBlocks = (const ChipherBlock *)(in + 16);
+		auto outBlocks = (ChipherBlock *)(out + 16);
+		for (size_t i = 0; i < i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE/16; i++)
+		{
+			ChipherBlock tmp = inBlocks[i];
+			m_LayerDecryption.Decrypt (&tmp, outBlocks + i);
+			outBlocks[i] ^= iv;
+			iv = tmp;
+		}	
+		m_IVDecryption.Decrypt ((ChipherBlock *)out, (ChipherBlock *)out); // double iv
+	}	
+
+#if defined(AESNI) && defined(__x86_64__) // multi-lane kernels need 16 xmm registers
+	// same round for 4 independent blocks in xmm0-xmm3, round key in xmm8
+	#define AESRoundx4(op, offset, sched) \
+		"movaps "#offset"(%["#sched"]), %%xmm8 \n" \
+		#op" %%xmm8, %%xmm0 \n" \
+		#op" %%xmm8, %%xmm1 \n" \
+		#op" %%xmm8, %%xmm2 \n" \
+		#op" %%xmm8, %%xmm3 \n"
+
+	#define EncryptAES256x4(sched) \
+		AESRoundx4(pxor, 0, sched) \
+		AESRoundx4(aesenc, 16, sched) \
+		AESRoundx4(aesenc, 32, sched) \
+		AESRoundx4(aesenc, 48, sched) \
+		AESRoundx4(aesenc, 64, sched) \
+		AESRoundx4(aesenc, 80, sched) \
+		AESRoundx4(aesenc, 96, sched) \
+		AESRoundx4(aesenc, 112, sched) \
+		AESRoundx4(aesenc, 128, sched) \
+		AESRoundx4(aesenc, 144, sched) \
+		AESRoundx4(aesenc, 160, sched) \
+		AESRoundx4(aesenc, 176, sched) \
+		AESRoundx4(aesenc, 192, sched) \
+		AESRoundx4(aesenc, 208, sched) \
+		AESRoundx4(aesenclast, 224, sched)
+
+	#define DecryptAES256x4(sched) \
+		AESRoundx4(pxor, 224, sched) \
+		AESRoundx4(aesdec, 208, sched) \
+		AESRoundx4(aesdec, 192, sched) \
+		AESRoundx4(aesdec, 176, sched) \
+		AESRoundx4(aesdec, 160, sched) \
+		AESRoundx4(aesdec, 144, sched) \
+		AESRoundx4(aesdec, 128, sched) \
+		AESRoundx4(aesdec, 112, sched) \
+		AESRoundx4(aesdec, 96, sched) \
+		AESRoundx4(aesdec, 80, sched) \
+		AESRoundx4(aesdec, 64, sched) \
+		AESRoundx4(aesdec, 48, sched) \
+		AESRoundx4(aesdec, 32, sched) \
+		AESRoundx4(aesdec, 16, sched) \
+		AESRoundx4(aesdeclast, 0, sched)
+
+	// same round for 8 independent blocks in xmm0-xmm7, round key in xmm8
+	#define AESRoundx8(op, offset, sched) \
+		"movaps "#offset"(%["#sched"]), %%xmm8 \n" \
+		#op" %%xmm8, %%xmm0 \n" \
+		#op" %%xmm8, %%xmm1 \n" \
+		#op" %%xmm8, %%xmm2 \n" \
+		#op" %%xmm8, %%xmm3 \n" \
+		#op" %%xmm8, %%xmm4 \n" \
+		#op" %%xmm8, %%xmm5 \n" \
+		#op" %%xmm8, %%xmm6 \n" \
+		#op" %%xmm8, %%xmm7 \n"
+
+	#define EncryptAES256x8(sched) \
+		AESRoundx8(pxor, 0, sched) \
+		AESRoundx8(aesenc, 16, sched) \
+		AESRoundx8(aesenc, 32, sched) \
+		AESRoundx8(aesenc, 48, sched) \
+		AESRoundx8(aesenc, 64, sched) \
+		AESRoundx8(aesenc, 80, sched) \
+		AESRoundx8(aesenc, 96, sched) \
+		AESRoundx8(aesenc, 112, sched) \
+		AESRoundx8(aesenc, 128, sched) \
+		AESRoundx8(aesenc, 144, sched) \
+		AESRoundx8(aesenc, 160, sched) \
+		AESRoundx8(aesenc, 176, sched) \
+		AESRoundx8(aesenc, 192, sched) \
+		AESRoundx8(aesenc, 208, sched) \
+		AESRoundx8(aesenclast, 224, sched)
+
+	// block at offset of message j xored to lane j, pointers are read from array
+	#define LoadXorLane(j, reg) \
+		"mov "#j"*8(%[in]), %[p] \n" \
+		"movups (%[p],%[offset]), %%xmm9 \n" \
+		"pxor %%xmm9, %%"#reg" \n"
+
+	#define StoreLane(j, reg) \
+		"mov "#j"*8(%[out]), %[p] \n" \
+		"movups %%"#reg", (%[p],%[offset]) \n"
+
+	// tunnel kernels process data after IV of each lane, encrypted or decrypted IV of lane j is at ivs + 16*j
+	static void TunnelEncryptAESNIx4 (const uint8_t * sched, const uint8_t * ivs, const uint8_t * const * in, uint8_t * const * out)
+	{
+		size_t offset = 16; // data starts after IV
+		__asm__ __volatile__
 		(
-            // decrypt IV 
-			"movups	(%[in]), %%xmm0 \n"
-			DecryptAES256(sched_iv)
-			"movaps %%xmm0, %%xmm1 \n"
-			// double IV encryption
-			DecryptAES256(sched_iv)
-			"movups %%xmm0, (%[out]) \n"
-			// decrypt data, IV is xmm1
+			"movaps	(%[ivs]), %%xmm4 \n"
+			"movaps	16(%[ivs]), %%xmm5 \n"
+			"movaps	32(%[ivs]), %%xmm6 \n"
+			"movaps	48(%[ivs]), %%xmm7 \n"
 			"1: \n"
-			"add $16, %[in] \n"
-		    "add $16, %[out] \n"
-			"movups	(%[in]), %%xmm0 \n"
-			"movaps %%xmm0, %%xmm2 \n"
-		 	DecryptAES256(sched_l)
-			"pxor %%xmm1, %%xmm0 \n"
-		 	"movups	%%xmm0, (%[out]) \n"
-			"movaps %%xmm2, %%xmm1 \n"
-		 	"dec %[num] \n"
-		 	"jnz 1b \n"	 	
-			: 
-			: [sched_iv]"r"(m_IVDecryption.GetKeySchedule ()), [sched_l]"r"(m_LayerDecryption.GetKeySchedule ()), 
-			  [in]"r"(in), [out]"r"(out), [num]"r"(63) // 63 blocks = 1008 bytes
-			: "%xmm0", "%xmm1", "%xmm2", "cc", "memory"
+			"movups	(%[in0],%[offset]), %%xmm0 \n"
+			"movups	(%[in1],%[offset]), %%xmm1 \n"
+			"movups	(%[in2],%[offset]), %%xmm2 \n"
+			"movups	(%[in3],%[offset]), %%xmm3 \n"
+			"pxor %%xmm4, %%xmm0 \n"
+			"pxor %%xmm5, %%xmm1 \n"
+			"pxor %%xmm6, %%xmm2 \n"
+			"pxor %%xmm7, %%xmm3 \n"
+			EncryptAES256x4(sched)
+			"movaps	%%xmm0, %%xmm4 \n"
+			"movaps	%%xmm1, %%xmm5 \n"
+			"movaps	%%xmm2, %%xmm6 \n"
+			"movaps	%%xmm3, %%xmm7 \n"
+			"movups	%%xmm0, (%[out0],%[offset]) \n"
+			"movups	%%xmm1, (%[out1],%[offset]) \n"
+			"movups	%%xmm2, (%[out2],%[offset]) \n"
+			"movups	%%xmm3, (%[out3],%[offset]) \n"
+			"add $16, %[offset] \n"
+			"cmp $1024, %[offset] \n"
+			"jne 1b \n"
+			: [offset]"+r"(offset)
+			: [ivs]"r"(ivs), [sched]"r"(sched),
+			  [in0]"r"(in[0]), [in1]"r"(in[1]), [in2]"r"(in[2]), [in3]"r"(in[3]),
+			  [out0]"r"(out[0]), [out1]"r"(out[1]), [out2]"r"(out[2]), [out3]"r"(out[3])
+			: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", "cc", "memory"
 		);
-#else
-		m_IVDecryption.Decrypt ((const ChipherBlock *)in, (ChipherBlock *)out); // iv
-		m_LayerDecryption.SetIV (out);	
-		m_LayerDecryption.Decrypt (in + 16, i2p::tunnel::TUNNEL_DATA_ENCRYPTED_SIZE, out + 16); // data
-		m_IVDecryption.Decrypt ((ChipherBlock *)out, (ChipherBlock *)out); // double iv
+	}
+
+	static void TunnelDecryptAESNIx4 (const uint8_t * sched, const uint8_t * ivs, const uint8_t * const * in, uint8_t * const * out)
+	{
+		size_t offset = 16; // data starts after IV
+		__asm__ __volatile__
+		(
+			"movaps	(%[ivs]), %%xmm4 \n"
+			"movaps	16(%[ivs]), %%xmm5 \n"
+			"movaps	32(%[ivs]), %%xmm6 \n"
+			"movaps	48(%[ivs]), %%xmm7 \n"
+			"1: \n"
+			"movups	(%[in0],%[offset]), %%xmm0 \n"
+			"movups	(%[in1],%[offset]), %%xmm1 \n"
+			"movups	(%[in2],%[offset]), %%xmm2 \n"
+			"movups	(%[in3],%[offset]), %%xmm3 \n"
+			"movaps	%%xmm0, %%xmm9 \n"
+			"movaps	%%xmm1, %%xmm10 \n"
+			"movaps	%%xmm2, %%xmm11 \n"
+			"movaps	%%xmm3, %%xmm12 \n"
+			DecryptAES256x4(sched)
+			"pxor %%xmm4, %%xmm0 \n"
+			"pxor %%xmm5, %%xmm1 \n"
+			"pxor %%xmm6, %%xmm2 \n"
+			"pxor %%xmm7, %%xmm3 \n"
+			"movups	%%xmm0, (%[out0],%[offset]) \n"
+			"movups	%%xmm1, (%[out1],%[offset]) \n"
+			"movups	%%xmm2, (%[out2],%[offset]) \n"
+			"movups	%%xmm3, (%[out3],%[offset]) \n"
+			"movaps	%%xmm9, %%xmm4 \n"
+			"movaps	%%xmm10, %%xmm5 \n"
+			"movaps	%%xmm11, %%xmm6 \n"
+			"movaps	%%xmm12, %%xmm7 \n"
+			"add $16, %[offset] \n"
+			"cmp $1024, %[offset] \n"
+			"jne 1b \n"
+			: [offset]"+r"(offset)
+			: [ivs]"r"(ivs), [sched]"r"(sched),
+			  [in0]"r"(in[0]), [in1]"r"(in[1]), [in2]"r"(in[2]), [in3]"r"(in[3]),
+			  [out0]"r"(out[0]), [out1]"r"(out[1]), [out2]"r"(out[2]), [out3]"r"(out[3])
+			: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", 
+			  "%xmm9", "%xmm10", "%xmm11", "%xmm12", "cc", "memory"
+		);
+	}
+
+	static void TunnelEncryptAESNIx8 (const uint8_t * sched, const uint8_t * ivs, const uint8_t * const * in, uint8_t * const * out)
+	{
+		// state of each lane is the chain, so 10 registers are enough
+		size_t offset = 16; // data starts after IV
+		const uint8_t * p;
+		__asm__ __volatile__
+		(
+			"movaps	(%[ivs]), %%xmm0 \n"
+			"movaps	16(%[ivs]), %%xmm1 \n"
+			"movaps	32(%[ivs]), %%xmm2 \n"
+			"movaps	48(%[ivs]), %%xmm3 \n"
+			"movaps	64(%[ivs]), %%xmm4 \n"
+			"movaps	80(%[ivs]), %%xmm5 \n"
+			"movaps	96(%[ivs]), %%xmm6 \n"
+			"movaps	112(%[ivs]), %%xmm7 \n"
+			"1: \n"
+			LoadXorLane(0, xmm0)
+			LoadXorLane(1, xmm1)
+			LoadXorLane(2, xmm2)
+			LoadXorLane(3, xmm3)
+			LoadXorLane(4, xmm4)
+			LoadXorLane(5, xmm5)
+			LoadXorLane(6, xmm6)
+			LoadXorLane(7, xmm7)
+			EncryptAES256x8(sched)
+			StoreLane(0, xmm0)
+			StoreLane(1, xmm1)
+			StoreLane(2, xmm2)
+			StoreLane(3, xmm3)
+			StoreLane(4, xmm4)
+			StoreLane(5, xmm5)
+			StoreLane(6, xmm6)
+			StoreLane(7, xmm7)
+			"add $16, %[offset] \n"
+			"cmp $1024, %[offset] \n"
+			"jne 1b \n"
+			: [offset]"+r"(offset), [p]"=&r"(p)
+			: [ivs]"r"(ivs), [sched]"r"(sched), [in]"r"(in), [out]"r"(out)
+			: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", "%xmm9", "cc", "memory"
+		);
+	}
+
+#ifdef AESNI_VAES
+	// same round for 2 blocks in each of ymm registers, round key is broadcasted to ymm15
+	#define VAESRound(op, n) #op" %%ymm15, %%ymm"#n", %%ymm"#n" \n"
+	#define VAESRoundKey(offset, sched) "vbroadcasti128 "#offset"(%["#sched"]), %%ymm15 \n"
+
+	#define VAESRoundx8(op, offset, sched) \
+		VAESRoundKey(offset, sched) \
+		VAESRound(op, 0) VAESRound(op, 1) VAESRound(op, 2) VAESRound(op, 3)
+
+	#define VAESRoundx16(op, offset, sched) \
+		VAESRoundx8(op, offset, sched) \
+		VAESRound(op, 4) VAESRound(op, 5) VAESRound(op, 6) VAESRound(op, 7)
+
+	#define VEncryptAES256(x, sched) \
+		VAESRound##x(vpxor, 0, sched) \
+		VAESRound##x(vaesenc, 16, sched) \
+		VAESRound##x(vaesenc, 32, sched) \
+		VAESRound##x(vaesenc, 48, sched) \
+		VAESRound##x(vaesenc, 64, sched) \
+		VAESRound##x(vaesenc, 80, sched) \
+		VAESRound##x(vaesenc, 96, sched) \
+		VAESRound##x(vaesenc, 112, sched) \
+		VAESRound##x(vaesenc, 128, sched) \
+		VAESRound##x(vaesenc, 144, sched) \
+		VAESRound##x(vaesenc, 160, sched) \
+		VAESRound##x(vaesenc, 176, sched) \
+		VAESRound##x(vaesenc, 192, sched) \
+		VAESRound##x(vaesenc, 208, sched) \
+		VAESRound##x(vaesenclast, 224, sched)
+
+	#define VDecryptAES256(x, sched) \
+		VAESRound##x(vpxor, 224, sched) \
+		VAESRound##x(vaesdec, 208, sched) \
+		VAESRound##x(vaesdec, 192, sched) \
+		VAESRound##x(vaesdec, 176, sched) \
+		VAESRound##x(vaesdec, 160, sched) \
+		VAESRound##x(vaesdec, 144, sched) \
+		VAESRound##x(vaesdec, 128, sched) \
+		VAESRound##x(vaesdec, 112, sched) \
+		VAESRound##x(vaesdec, 96, sched) \
+		VAESRound##x(vaesdec, 80, sched) \
+		VAESRound##x(vaesdec, 64, sched) \
+		VAESRound##x(vaesdec, 48, sched) \
+		VAESRound##x(vaesdec, 32, sched) \
+		VAESRound##x(vaesdec, 16, sched) \
+		VAESRound##x(vaesdeclast, 0, sched)
+
+	// blocks at offset of messages j and k to low and high halves of ymm register n
+	#define VLoadLanes(j, k, n) \
+		"mov "#j"*8(%[in]), %[p] \n" \
+		"vmovdqu (%[p],%[offset]), %%xmm"#n" \n" \
+		"mov "#k"*8(%[in]), %[p] \n" \
+		"vinserti128 $1, (%[p],%[offset]), %%ymm"#n", %%ymm"#n" \n"
+
+	#define VLoadXorLanes(j, k, n) \
+		VLoadLanes(j, k, 14) \
+		"vpxor %%ymm14, %%ymm"#n", %%ymm"#n" \n"
+
+	#define VStoreLanes(j, k, n) \
+		"mov "#j"*8(%[out]), %[p] \n" \
+		"vmovdqu %%xmm"#n", (%[p],%[offset]) \n" \
+		"mov "#k"*8(%[out]), %[p] \n" \
+		"vextracti128 $1, %%ymm"#n", (%[p],%[offset]) \n"
+
+	// upper halves are zeroed at exit to avoid AVX-SSE transition penalty in SSE code after
+	static void TunnelEncryptVAESx16 (const uint8_t * sched, const uint8_t * ivs, const uint8_t * const * in, uint8_t * const * out)
+	{
+		size_t offset = 16; // data starts after IV
+		const uint8_t * p;
+		__asm__ __volatile__
+		(
+			"vmovdqu (%[ivs]), %%ymm0 \n"
+			"vmovdqu 32(%[ivs]), %%ymm1 \n"
+			"vmovdqu 64(%[ivs]), %%ymm2 \n"
+			"vmovdqu 96(%[ivs]), %%ymm3 \n"
+			"vmovdqu 128(%[ivs]), %%ymm4 \n"
+			"vmovdqu 160(%[ivs]), %%ymm5 \n"
+			"vmovdqu 192(%[ivs]), %%ymm6 \n"
+			"vmovdqu 224(%[ivs]), %%ymm7 \n"
+			"1: \n"
+			VLoadXorLanes(0, 1, 0)
+			VLoadXorLanes(2, 3, 1)
+			VLoadXorLanes(4, 5, 2)
+			VLoadXorLanes(6, 7, 3)
+			VLoadXorLanes(8, 9, 4)
+			VLoadXorLanes(10, 11, 5)
+			VLoadXorLanes(12, 13, 6)
+			VLoadXorLanes(14, 15, 7)
+			VEncryptAES256(x16, sched)
+			VStoreLanes(0, 1, 0)
+			VStoreLanes(2, 3, 1)
+			VStoreLanes(4, 5, 2)
+			VStoreLanes(6, 7, 3)
+			VStoreLanes(8, 9, 4)
+			VStoreLanes(10, 11, 5)
+			VStoreLanes(12, 13, 6)
+			VStoreLanes(14, 15, 7)
+			"add $16, %[offset] \n"
+			"cmp $1024, %[offset] \n"
+			"jne 1b \n"
+			"vzeroupper \n"
+			: [offset]"+r"(offset), [p]"=&r"(p)
+			: [ivs]"r"(ivs), [sched]"r"(sched), [in]"r"(in), [out]"r"(out)
+			: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12", "%xmm13", "%xmm14", "%xmm15", "cc", "memory"
+		);
+	}
+
+	static void TunnelEncryptVAESx8 (const uint8_t * sched, const uint8_t * ivs, const uint8_t * const * in, uint8_t * const * out)
+	{
+		size_t offset = 16; // data starts after IV
+		const uint8_t * p;
+		__asm__ __volatile__
+		(
+			"vmovdqu (%[ivs]), %%ymm0 \n"
+			"vmovdqu 32(%[ivs]), %%ymm1 \n"
+			"vmovdqu 64(%[ivs]), %%ymm2 \n"
+			"vmovdqu 96(%[ivs]), %%ymm3 \n"
+			"1: \n"
+			VLoadXorLanes(0, 1, 0)
+			VLoadXorLanes(2, 3, 1)
+			VLoadXorLanes(4, 5, 2)
+			VLoadXorLanes(6, 7, 3)
+			VEncryptAES256(x8, sched)
+			VStoreLanes(0, 1, 0)
+			VStoreLanes(2, 3, 1)
+			VStoreLanes(4, 5, 2)
+			VStoreLanes(6, 7, 3)
+			"add $16, %[offset] \n"
+			"cmp $1024, %[offset] \n"
+			"jne 1b \n"
+			"vzeroupper \n"
+			: [offset]"+r"(offset), [p]"=&r"(p)
+			: [ivs]"r"(ivs), [sched]"r"(sched), [in]"r"(in), [out]"r"(out)
+			: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12", "%xmm13", "%xmm14", "%xmm15", "cc", "memory"
+		);
+	}
+
+	static void TunnelDecryptVAESx8 (const uint8_t * sched, const uint8_t * ivs, const uint8_t * const * in, uint8_t * const * out)
+	{
+		// state in ymm0-3, chain in ymm4-7, ciphertext in ymm8-11
+		size_t offset = 16; // data starts after IV
+		const uint8_t * p;
+		__asm__ __volatile__
+		(
+			"vmovdqu (%[ivs]), %%ymm4 \n"
+			"vmovdqu 32(%[ivs]), %%ymm5 \n"
+			"vmovdqu 64(%[ivs]), %%ymm6 \n"
+			"vmovdqu 96(%[ivs]), %%ymm7 \n"
+			"1: \n"
+			VLoadLanes(0, 1, 0)
+			VLoadLanes(2, 3, 1)
+			VLoadLanes(4, 5, 2)
+			VLoadLanes(6, 7, 3)
+			"vmovdqa %%ymm0, %%ymm8 \n"
+			"vmovdqa %%ymm1, %%ymm9 \n"
+			"vmovdqa %%ymm2, %%ymm10 \n"
+			"vmovdqa %%ymm3, %%ymm11 \n"
+			VDecryptAES256(x8, sched)
+			"vpxor %%ymm4, %%ymm0, %%ymm0 \n"
+			"vpxor %%ymm5, %%ymm1, %%ymm1 \n"
+			"vpxor %%ymm6, %%ymm2, %%ymm2 \n"
+			"vpxor %%ymm7, %%ymm3, %%ymm3 \n"
+			VStoreLanes(0, 1, 0)
+			VStoreLanes(2, 3, 1)
+			VStoreLanes(4, 5, 2)
+			VStoreLanes(6, 7, 3)
+			"vmovdqa %%ymm8, %%ymm4 \n"
+			"vmovdqa %%ymm9, %%ymm5 \n"
+			"vmovdqa %%ymm10, %%ymm6 \n"
+			"vmovdqa %%ymm11, %%ymm7 \n"
+			"add $16, %[offset] \n"
+			"cmp $1024, %[offset] \n"
+			"jne 1b \n"
+			"vzeroupper \n"
+			: [offset]"+r"(offset), [p]"=&r"(p)
+			: [ivs]"r"(ivs), [sched]"r"(sched), [in]"r"(in), [out]"r"(out)
+			: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12", "%xmm13", "%xmm14", "%xmm15", "cc", "memory"
+		);
+	}
+
+	// AVX-512 versions, four blocks in each of zmm registers
+	#define ZVAESRound(op, n) #op" %%zmm15, %%zmm"#n", %%zmm"#n" \n"
+	#define ZVAESRoundx16(op, offset, sched) \
+		"vbroadcasti32x4 "#offset"(%["#sched"]), %%zmm15 \n" \
+		ZVAESRound(op, 0) ZVAESRound(op, 1) ZVAESRound(op, 2) ZVAESRound(op, 3)
+
+	#define ZEncryptAES256x16(sched) \
+		ZVAESRoundx16(vpxord, 0, sched) \
+		ZVAESRoundx16(vaesenc, 16, sched) \
+		ZVAESRoundx16(vaesenc, 32, sched) \
+		ZVAESRoundx16(vaesenc, 48, sched) \
+		ZVAESRoundx16(vaesenc, 64, sched) \
+		ZVAESRoundx16(vaesenc, 80, sched) \
+		ZVAESRoundx16(vaesenc, 96, sched) \
+		ZVAESRoundx16(vaesenc, 112, sched) \
+		ZVAESRoundx16(vaesenc, 128, sched) \
+		ZVAESRoundx16(vaesenc, 144, sched) \
+		ZVAESRoundx16(vaesenc, 160, sched) \
+		ZVAESRoundx16(vaesenc, 176, sched) \
+		ZVAESRoundx16(vaesenc, 192, sched) \
+		ZVAESRoundx16(vaesenc, 208, sched) \
+		ZVAESRoundx16(vaesenclast, 224, sched)
+
+	#define ZDecryptAES256x16(sched) \
+		ZVAESRoundx16(vpxord, 224, sched) \
+		ZVAESRoundx16(vaesdec, 208, sched) \
+		ZVAESRoundx16(vaesdec, 192, sched) \
+		ZVAESRoundx16(vaesdec, 176, sched) \
+		ZVAESRoundx16(vaesdec, 160, sched) \
+		ZVAESRoundx16(vaesdec, 144, sched) \
+		ZVAESRoundx16(vaesdec, 128, sched) \
+		ZVAESRoundx16(vaesdec, 112, sched) \
+		ZVAESRoundx16(vaesdec, 96, sched) \
+		ZVAESRoundx16(vaesdec, 80, sched) \
+		ZVAESRoundx16(vaesdec, 64, sched) \
+		ZVAESRoundx16(vaesdec, 48, sched) \
+		ZVAESRoundx16(vaesdec, 32, sched) \
+		ZVAESRoundx16(vaesdec, 16, sched) \
+		ZVAESRoundx16(vaesdeclast, 0, sched)
+
+	// blocks at offset of messages 4*n..4*n+3 to zmm register r
+	#define ZLoadLanes(n, r) \
+		"mov (4*"#n")*8(%[in]), %[p] \n" \
+		"vmovdqu (%[p],%[offset]), %%xmm"#r" \n" \
+		"mov (4*"#n"+1)*8(%[in]), %[p] \n" \
+		"vinserti32x4 $1, (%[p],%[offset]), %%zmm"#r", %%zmm"#r" \n" \
+		"mov (4*"#n"+2)*8(%[in]), %[p] \n" \
+		"vinserti32x4 $2, (%[p],%[offset]), %%zmm"#r", %%zmm"#r" \n" \
+		"mov (4*"#n"+3)*8(%[in]), %[p] \n" \
+		"vinserti32x4 $3, (%[p],%[offset]), %%zmm"#r", %%zmm"#r" \n"
+
+	#define ZLoadXorLanes(n) \
+		ZLoadLanes(n, 14) \
+		"vpxord %%zmm14, %%zmm"#n", %%zmm"#n" \n"
+
+	#define ZStoreLanes(n) \
+		"mov (4*"#n")*8(%[out]), %[p] \n" \
+		"vmovdqu %%xmm"#n", (%[p],%[offset]) \n" \
+		"mov (4*"#n"+1)*8(%[out]), %[p] \n" \
+		"vextracti32x4 $1, %%zmm"#n", (%[p],%[offset]) \n" \
+		"mov (4*"#n"+2)*8(%[out]), %[p] \n" \
+		"vextracti32x4 $2, %%zmm"#n", (%[p],%[offset]) \n" \
+		"mov (4*"#n"+3)*8(%[out]), %[p] \n" \
+		"vextracti32x4 $3, %%zmm"#n", (%[p],%[offset]) \n"
+
+	static void TunnelEncryptVAES512x16 (const uint8_t * sched, const uint8_t * ivs, const uint8_t * const * in, uint8_t * const * out)
+	{
+		size_t offset = 16; // data starts after IV
+		const uint8_t * p;
+		__asm__ __volatile__
+		(
+			"vmovdqu64 (%[ivs]), %%zmm0 \n"
+			"vmovdqu64 64(%[ivs]), %%zmm1 \n"
+			"vmovdqu64 128(%[ivs]), %%zmm2 \n"
+			"vmovdqu64 192(%[ivs]), %%zmm3 \n"
+			"1: \n"
+			ZLoadXorLanes(0)
+			ZLoadXorLanes(1)
+			ZLoadXorLanes(2)
+			ZLoadXorLanes(3)
+			ZEncryptAES256x16(sched)
+			ZStoreLanes(0)
+			ZStoreLanes(1)
+			ZStoreLanes(2)
+			ZStoreLanes(3)
+			"add $16, %[offset] \n"
+			"cmp $1024, %[offset] \n"
+			"jne 1b \n"
+			"vzeroupper \n"
+			: [offset]"+r"(offset), [p]"=&r"(p)
+			: [ivs]"r"(ivs), [sched]"r"(sched), [in]"r"(in), [out]"r"(out)
+			: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12", "%xmm13", "%xmm14", "%xmm15", "cc", "memory"
+		);
+	}
+
+	static void TunnelDecryptVAES512x16 (const uint8_t * sched, const uint8_t * ivs, const uint8_t * const * in, uint8_t * const * out)
+	{
+		// state in zmm0-3, chain in zmm4-7, ciphertext in zmm8-11
+		size_t offset = 16; // data starts after IV
+		const uint8_t * p;
+		__asm__ __volatile__
+		(
+			"vmovdqu64 (%[ivs]), %%zmm4 \n"
+			"vmovdqu64 64(%[ivs]), %%zmm5 \n"
+			"vmovdqu64 128(%[ivs]), %%zmm6 \n"
+			"vmovdqu64 192(%[ivs]), %%zmm7 \n"
+			"1: \n"
+			ZLoadLanes(0, 0)
+			ZLoadLanes(1, 1)
+			ZLoadLanes(2, 2)
+			ZLoadLanes(3, 3)
+			"vmovdqa64 %%zmm0, %%zmm8 \n"
+			"vmovdqa64 %%zmm1, %%zmm9 \n"
+			"vmovdqa64 %%zmm2, %%zmm10 \n"
+			"vmovdqa64 %%zmm3, %%zmm11 \n"
+			ZDecryptAES256x16(sched)
+			"vpxord %%zmm4, %%zmm0, %%zmm0 \n"
+			"vpxord %%zmm5, %%zmm1, %%zmm1 \n"
+			"vpxord %%zmm6, %%zmm2, %%zmm2 \n"
+			"vpxord %%zmm7, %%zmm3, %%zmm3 \n"
+			ZStoreLanes(0)
+			ZStoreLanes(1)
+			ZStoreLanes(2)
+			ZStoreLanes(3)
+			"vmovdqa64 %%zmm8, %%zmm4 \n"
+			"vmovdqa64 %%zmm9, %%zmm5 \n"
+			"vmovdqa64 %%zmm10, %%zmm6 \n"
+			"vmovdqa64 %%zmm11, %%zmm7 \n"
+			"add $16, %[offset] \n"
+			"cmp $1024, %[offset] \n"
+			"jne 1b \n"
+			"vzeroupper \n"
+			: [offset]"+r"(offset), [p]"=&r"(p)
+			: [ivs]"r"(ivs), [sched]"r"(sched), [in]"r"(in), [out]"r"(out)
+			: "%xmm0", "%xmm1", "%xmm2", "%xmm3", "%xmm4", "%xmm5", "%xmm6", "%xmm7", "%xmm8", "%xmm9", "%xmm10", "%xmm11", "%xmm12", "%xmm13", "%xmm14", "%xmm15", "cc", "memory"
+		);
+	}
+#endif
+
+	struct TunnelCryptoKernel
+	{
+		AESKernel kernel; // keys must be set for this kernel or better 
+		int numLanes;
+		void (* encrypt) (const uint8_t * sched, const uint8_t * ivs, const uint8_t * const * in, uint8_t * const * out);
+		void (* decrypt) (const uint8_t * sched, const uint8_t * ivs, const uint8_t * const * in, uint8_t * const * out);
+	};
+
+	// widest first, nullptr if lanes don't fit to registers
+	static const TunnelCryptoKernel g_TunnelCryptoKernels[] =
+	{
+#ifdef AESNI_VAES
+		{ eAESKernelVAES512, 16, TunnelEncryptVAES512x16, TunnelDecryptVAES512x16 },
+		{ eAESKernelVAES, 16, TunnelEncryptVAESx16, nullptr }, // 16 state and key registers for decryption are too many
+		{ eAESKernelVAES, 8, TunnelEncryptVAESx8, TunnelDecryptVAESx8 },
+#endif
+		{ eAESKernelAESNI, 8, TunnelEncryptAESNIx8, nullptr }, // each lane needs state, chain and ciphertext for decryption
+		{ eAESKernelAESNI, 4, TunnelEncryptAESNIx4, TunnelDecryptAESNIx4 }
+	};
+#endif
+
+	void TunnelEncryption::Encrypt (int numMsgs, const uint8_t * const * in, uint8_t * const * out)
+	{
+		int i = 0;
+#if defined(AESNI) && defined(__x86_64__)
+		// CBC chain of each message is serial, so we interleave messages to keep AES units busy 
+		AESAlignedBuffer<16*TUNNEL_CRYPTO_NUM_LANES> ivBuf;
+		uint8_t * ivs = ivBuf;
+		auto kernel = m_LayerEncryption.GetKernel ();
+		for (auto& it: g_TunnelCryptoKernels)
+		{
+			if (it.kernel > kernel || !it.encrypt) continue;
+			for (; i + it.numLanes <= numMsgs; i += it.numLanes)
+			{
+				for (int j = 0; j < it.numLanes; j++)
+					m_IVEncryption.Encrypt ((const ChipherBlock *)in[i + j], (ChipherBlock *)(ivs + 16*j)); // iv
+				it.encrypt (m_LayerEncryption.GetKeySchedule (), ivs, in + i, out + i);
+				for (int j = 0; j < it.numLanes; j++)
+					m_IVEncryption.Encrypt ((const ChipherBlock *)(ivs + 16*j), (ChipherBlock *)out[i + j]); // double iv
+			}
+		}
+#endif
+		for (; i < numMsgs; i++)
+			Encrypt (in[i], out[i]);
+	}
+
+	void TunnelDecryption::Decrypt (int numMsgs, const uint8_t * const * in, uint8_t * const * out)
+	{
+		int i = 0;
+#if defined(AESNI) && defined(__x86_64__)
+		AESAlignedBuffer<16*TUNNEL_CRYPTO_NUM_LANES> ivBuf;
+		uint8_t * ivs = ivBuf;
+		auto kernel = m_LayerDecryption.GetKernel ();
+		for (auto& it: g_TunnelCryptoKernels)
+		{
+			if (it.kernel > kernel || !it.decrypt) continue;
+			for (; i + it.numLanes <= numMsgs; i += it.numLanes)
+			{
+				for (int j = 0; j < it.numLanes; j++)
+					m_IVDecryption.Decrypt ((const ChipherBlock *)in[i + j], (ChipherBlock *)(ivs + 16*j)); // iv
+				it.decrypt (m_LayerDecryption.GetKeySchedule (), ivs, in + i, out + i);
+				for (int j = 0; j < it.numLanes; j++)
+					m_IVDecryption.Decrypt ((const ChipherBlock *)(ivs + 16*j), (ChipherBlock *)out[i + j]); // double iv
+			}
+		}
 #endif
+		for (; i < numMsgs; i++)
+			Decrypt (in[i], out[i]);
+	}
+
+	static bool SelfTestAESKernel ()
+	{
+		// FIPS-197, C.3 AES-256
+		static const uint8_t ecbKey[32] =
+		{
+			0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+			0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f
+		};
+		static const uint8_t ecbPlain[16] =
+		{
+			0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+		};
+		static const uint8_t ecbCipher[16] =
+		{
+			0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf, 0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89
+		};
+		ChipherBlock block;
+		ECBEncryption ecbEncryption;
+		ecbEncryption.SetKey (ecbKey);
+		ecbEncryption.Encrypt ((const ChipherBlock *)ecbPlain, &block);
+		if (memcmp (block.buf, ecbCipher, 16)) return false;
+		ECBDecryption ecbDecryption;
+		ecbDecryption.SetKey (ecbKey);
+		ecbDecryption.Decrypt ((const ChipherBlock *)ecbCipher, &block);
+		if (memcmp (block.buf, ecbPlain, 16)) return false;
+	
+		// NIST SP 800-38A, F.2.5 and F.2.6 CBC-AES256
+		static const uint8_t cbcKey[32] =
+		{
+			0x60, 0x3d, 0xeb, 0x10, 0x15, 0xca, 0x71, 0xbe, 0x2b, 0x73, 0xae, 0xf0, 0x85, 0x7d, 0x77, 0x81,
+			0x1f, 0x35, 0x2c, 0x07, 0x3b, 0x61, 0x08, 0xd7, 0x2d, 0x98, 0x10, 0xa3, 0x09, 0x14, 0xdf, 0xf4
+		};
+		static const uint8_t cbcIV[16] =
+		{
+			0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+		};
+		static const uint8_t cbcPlain[64] =
+		{
+			0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+			0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+			0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+			0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10
+		};
+		static const uint8_t cbcCipher[64] =
+		{
+			0xf5, 0x8c, 0x4c, 0x04, 0xd6, 0xe5, 0xf1, 0xba, 0x77, 0x9e, 0xab, 0xfb, 0x5f, 0x7b, 0xfb, 0xd6,
+			0x9c, 0xfc, 0x4e, 0x96, 0x7e, 0xdb, 0x80, 0x8d, 0x67, 0x9f, 0x77, 0x7b, 0xc6, 0x70, 0x2c, 0x7d,
+			0x39, 0xf2, 0x33, 0x69, 0xa9, 0xd9, 0xba, 0xcf, 0xa5, 0x30, 0xe2, 0x63, 0x04, 0x23, 0x14, 0x61,
+			0xb2, 0xeb, 0x05, 0xe2, 0xc3, 0x9b, 0xe9, 0xfc, 0xda, 0x6c, 0x19, 0x07, 0x8c, 0x6a, 0x9d, 0x1b
+		};
+		uint8_t buf[64];
+		CBCEncryption cbcEncryption;
+		cbcEncryption.SetKey (cbcKey);
+		cbcEncryption.SetIV (cbcIV);
+		cbcEncryption.Encrypt (cbcPlain, 64, buf);
+		if (memcmp (buf, cbcCipher, 64)) return false;
+		cbcEncryption.SetIV (cbcIV);
+		cbcEncryption.Encrypt (cbcPlain, buf); // one block
+		if (memcmp (buf, cbcCipher, 16)) return false;
+		CBCDecryption cbcDecryption;
+		cbcDecryption.SetKey (cbcKey);
+		cbcDecryption.SetIV (cbcIV);
+		cbcDecryption.Decrypt (cbcCipher, 64, buf);
+		if (memcmp (buf, cbcPlain, 64)) return false;
+		cbcDecryption.SetIV (cbcIV);
+		cbcDecryption.Decrypt (cbcCipher, buf); // one block
+		if (memcmp (buf, cbcPlain, 16)) return false;
+		return true;
+	}	
+
+	const int AES_SELF_TEST_NUM_TUNNEL_MSGS = 16 + 8 + 4 + 1; // each number of lanes and single path
+	static void SelfTestTunnelCrypto (uint8_t * encrypted, uint8_t * decrypted) 
+	{
+		// there are no published vectors for double IV encryption, 
+		// so kernels are compared against each other and checked for round trip 
+		uint8_t layerKey[32], ivKey[32];
+		for (int i = 0; i < 32; i++)
+		{
+			layerKey[i] = i;
+			ivKey[i] = 0xFF - i;
+		}
+		TunnelEncryption encryption;
+		encryption.SetKeys (layerKey, ivKey);
+		TunnelDecryption decryption;
+		decryption.SetKeys (layerKey, ivKey);
+		const uint8_t * in[AES_SELF_TEST_NUM_TUNNEL_MSGS]; 
+		uint8_t * out[AES_SELF_TEST_NUM_TUNNEL_MSGS];
+		for (int i = 0; i < AES_SELF_TEST_NUM_TUNNEL_MSGS*1024; i++)
+			encrypted[i] = i*7 + (i >> 10);
+		for (int i = 0; i < AES_SELF_TEST_NUM_TUNNEL_MSGS; i++)
+			in[i] = out[i] = encrypted + i*1024; // in place	
+		encryption.Encrypt (AES_SELF_TEST_NUM_TUNNEL_MSGS, in, out);
+		memcpy (decrypted, encrypted, AES_SELF_TEST_NUM_TUNNEL_MSGS*1024);
+		for (int i = 0; i < AES_SELF_TEST_NUM_TUNNEL_MSGS; i++)
+			in[i] = out[i] = decrypted + i*1024; 
+		decryption.Decrypt (AES_SELF_TEST_NUM_TUNNEL_MSGS, in, out);
+	}	
+
+	bool SelfTestAES ()
+	{
+		const size_t len = AES_SELF_TEST_NUM_TUNNEL_MSGS*1024;
+		std::vector<uint8_t> encrypted (len), decrypted (len), expected (len);
+		for (size_t i = 0; i < len; i++)
+			expected[i] = i*7 + (i >> 10); // original messages
+		auto maxKernel = DetectAESKernel ();
+		// portable
+		g_AESKernel = eAESKernelPortable; 
+		bool ret = SelfTestAESKernel ();
+		SelfTestTunnelCrypto (encrypted.data (), decrypted.data ());
+		if (decrypted != expected) ret = false;
+		if (!ret)
+			LogPrint (eLogError, "Crypto: AES self-test failed");
+		// each kernel against portable, first failed one and better are disabled 
+		for (int k = eAESKernelPortable + 1; k <= maxKernel; k++)
+		{
+			g_AESKernel = (AESKernel)k; 
+			std::vector<uint8_t> encrypted1 (len), decrypted1 (len);
+			SelfTestTunnelCrypto (encrypted1.data (), decrypted1.data ());
+			if (!SelfTestAESKernel () || encrypted1 != encrypted || decrypted1 != expected)
+			{
+				LogPrint (eLogError, "Crypto: ", g_AESKernelNames[k], " self-test failed. ", g_AESKernelNames[k], " disabled");
+				maxKernel = (AESKernel)(k - 1);
+				break;
+			}
+		}	
+		g_MaxAESKernel = maxKernel;
+		g_AESKernel = maxKernel;
+		LogPrint (eLogInfo, "Crypto: AES kernel is ", g_AESKernelNames[maxKernel]);
+		return ret;
 	}	
 
 /*	std::vector <std::unique_ptr<std::mutex> >  m_OpenSSLMutexes;
@@ -698,6 +1579,7 @@ namespace crypto
 	void InitCrypto ()
 	{
 		SSL_library_init ();
+		SelfTestAES ();
 /*		auto numLocks = CRYPTO_num_locks();
 		for (int i = 0; i < numLocks; i++)
 		     m_OpenSSLMutexes.emplace_back (new std::mutex);
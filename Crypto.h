@@ -114,31 +114,63 @@ namespace crypto
 	};			
 
 
-#ifdef AESNI
-	class ECBCryptoAESNI
+#if defined(__x86_64__) || defined(__i386__)
+#ifndef AESNI
+#define AESNI // AES-NI kernels are always built for x86 and selected at runtime
+#endif
+#else
+#undef AESNI // x86 only
+#endif
+
+	enum AESKernel // each kernel can use all previous
+	{
+		eAESKernelPortable = 0, // openssl
+		eAESKernelAESNI, // single block and multi-lane tunnel kernels for x86_64
+		eAESKernelVAES, // AVX2 tunnel kernels, two messages per ymm register 
+		eAESKernelVAES512, // AVX-512 tunnel kernels, four messages per zmm register
+		eNumAESKernels
+	};	
+
+	bool IsAESNISupported (); // by CPU, and self-test has passed
+	bool IsAESKernelSupported (AESKernel kernel); // by CPU and build, and self-test has passed
+	const char * GetAESKernelName (AESKernel kernel);
+	AESKernel GetAESKernel ();
+	void SetAESKernel (AESKernel kernel); // for keys set after, best supported up to kernel. For benchmarks
+
+	class ECBCrypto
 	{	
 		public:
 
+			ECBCrypto (): m_Kernel (eAESKernelPortable) {};
 			uint8_t * GetKeySchedule () { return m_KeySchedule; };
+			AESKernel GetKernel () const { return m_Kernel; }; // kernel chosen when key was set
+			bool IsAESNI () const { return m_Kernel != eAESKernelPortable; }; 
 
 		protected:
 
+#ifdef AESNI
 			void ExpandKey (const AESKey& key);
+#endif
+			AES_KEY * GetAESKey () { return (AES_KEY *)(uint8_t *)m_KeySchedule; }; 
 		
+		protected:
+
+			AESKernel m_Kernel;
+
 		private:
 
-			AESAlignedBuffer<240> m_KeySchedule;  // 14 rounds for AES-256, 240 bytes
+			AESAlignedBuffer<sizeof (AES_KEY)> m_KeySchedule;  // 240 bytes for AES-NI or openssl's AES_KEY
 	};	
 
-	class ECBEncryptionAESNI: public ECBCryptoAESNI
+	class ECBEncryption: public ECBCrypto
 	{
 		public:
 		
-			void SetKey (const AESKey& key) { ExpandKey (key); };
+			void SetKey (const AESKey& key);
 			void Encrypt (const ChipherBlock * in, ChipherBlock * out);	
 	};	
 
-	class ECBDecryptionAESNI: public ECBCryptoAESNI
+	class ECBDecryption: public ECBCrypto
 	{
 		public:
 		
@@ -146,50 +178,6 @@ namespace crypto
 			void Decrypt (const ChipherBlock * in, ChipherBlock * out);		
 	};	
 
-	typedef ECBEncryptionAESNI ECBEncryption;
-	typedef ECBDecryptionAESNI ECBDecryption;
-
-#else // use openssl
-
-	class ECBEncryption
-	{
-		public:
-		
-			void SetKey (const AESKey& key) 
-			{ 
-				AES_set_encrypt_key (key, 256, &m_Key);
-			}
-			void Encrypt (const ChipherBlock * in, ChipherBlock * out)
-			{
-				AES_encrypt (in->buf, out->buf, &m_Key);
-			}	
-
-		private:
-
-			AES_KEY m_Key;
-	};	
-
-	class ECBDecryption
-	{
-		public:
-		
-			void SetKey (const AESKey& key) 
-			{ 
-				AES_set_decrypt_key (key, 256, &m_Key); 
-			}
-			void Decrypt (const ChipherBlock * in, ChipherBlock * out)
-			{
-				AES_decrypt (in->buf, out->buf, &m_Key);
-			}	
-
-		private:
-
-			AES_KEY m_Key;
-	};		
-
-
-#endif			
-
 	class CBCEncryption
 	{
 		public:
@@ -229,6 +217,8 @@ namespace crypto
 			ECBDecryption m_ECBDecryption;
 	};	
 
+	const int TUNNEL_CRYPTO_NUM_LANES = 16; // max tunnel messages processed by interleaved AES pipeline 
+
 	class TunnelEncryption // with double IV encryption
 	{
 		public:
@@ -240,15 +230,12 @@ namespace crypto
 			}	
 
 			void Encrypt (const uint8_t * in, uint8_t * out); // 1024 bytes (16 IV + 1008 data)		
+			void Encrypt (int numMsgs, const uint8_t * const * in, uint8_t * const * out); // same keys, up to TUNNEL_CRYPTO_NUM_LANES at once
 
 		private:
 
 			ECBEncryption m_IVEncryption;
-#ifdef AESNI
 			ECBEncryption m_LayerEncryption;
-#else
-			CBCEncryption m_LayerEncryption;
-#endif
 	};
 
 	class TunnelDecryption // with double IV encryption
@@ -262,18 +249,16 @@ namespace crypto
 			}			
 
 			void Decrypt (const uint8_t * in, uint8_t * out); // 1024 bytes (16 IV + 1008 data)	
+			void Decrypt (int numMsgs, const uint8_t * const * in, uint8_t * const * out); // same keys, up to TUNNEL_CRYPTO_NUM_LANES at once
 
 		private:
 
 			ECBDecryption m_IVDecryption;
-#ifdef AESNI
 			ECBDecryption m_LayerDecryption;
-#else
-			CBCDecryption m_LayerDecryption;
-#endif
 	};	
 
-	void InitCrypto ();
+	void InitCrypto (); // also checks AES kernels
+	bool SelfTestAES (); // against known vectors
 	void TerminateCrypto ();
 }		
 }	
@@ -127,17 +127,19 @@ namespace i2p
 			d.httpServer->Start();
 
 			LogPrint(eLogInfo, "Daemon: starting NetDB");
-			i2p::data::netdb.Start();
+			i2p::data::netdb.Start(i2p::util::config::GetArg("-netdbthreads", 4), i2p::util::config::GetArg("-netdbready", 100),
+				i2p::util::config::GetArg("-netdbstore", 0));
 
 #ifdef USE_UPNP
 			LogPrint(eLogInfo, "Daemon: starting UPnP");
 			d.m_UPnP.Start ();
 #endif			
 			LogPrint(eLogInfo, "Daemon: starting Transports");
-			i2p::transport::transports.Start();
+			i2p::transport::transports.Start(i2p::util::config::GetArg("-dhthreads", 1), i2p::util::config::GetArg("-ssuthreads", 1),
+				i2p::util::config::GetArg("-ntcpthreads", 1));
 
 			LogPrint(eLogInfo, "Daemon: starting Tunnels");
-			i2p::tunnel::tunnels.Start();
+			i2p::tunnel::tunnels.Start(i2p::util::config::GetArg("-tunnelthreads", 1));
 
 			LogPrint(eLogInfo, "Daemon: starting Client");
 			i2p::client::context.Start ();
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <cassert>
+#include <future>
 #include <boost/lexical_cast.hpp>
 #include <openssl/rand.h>
 #include "Log.h"
@@ -14,8 +15,10 @@ namespace i2p
 namespace client
 {
 	ClientDestination::ClientDestination (const i2p::data::PrivateKeys& keys, bool isPublic, 
-			const std::map<std::string, std::string> * params):
-		m_IsRunning (false), m_Thread (nullptr), m_Work (m_Service),	
+			const std::map<std::string, std::string> * params, i2p::util::ServicePool * servicePool):
+		m_IsRunning (false), m_Thread (nullptr), m_ServicePool (servicePool),
+		m_OwnService (servicePool ? nullptr : new boost::asio::io_service ()),
+		m_Service (servicePool ? servicePool->GetNextService () : *m_OwnService), m_Work (m_Service),	
 		m_Keys (keys), m_IsPublic (isPublic), m_PublishReplyToken (0),
 		m_DatagramDestination (nullptr), m_PublishConfirmationTimer (m_Service), m_CleanupTimer (m_Service)
 	{
@@ -139,7 +142,8 @@ namespace client
 			m_IsRunning = true;
 			m_Pool->SetLocalDestination (shared_from_this ());
 			m_Pool->SetActive (true);			
-			m_Thread = new std::thread (std::bind (&ClientDestination::Run, this));
+			if (!m_ServicePool)
+				m_Thread = new std::thread (std::bind (&ClientDestination::Run, this));
 			m_StreamingDestination = std::make_shared<i2p::stream::StreamingDestination> (shared_from_this ()); // TODO:
 			m_StreamingDestination->Start ();	
 			for (auto it: m_StreamingDestinationsByPorts)
@@ -147,7 +151,7 @@ namespace client
 			
 			m_CleanupTimer.expires_from_now (boost::posix_time::minutes (DESTINATION_CLEANUP_TIMEOUT));
 			m_CleanupTimer.async_wait (std::bind (&ClientDestination::HandleCleanupTimer,
-				this, std::placeholders::_1));
+				shared_from_this (), std::placeholders::_1));
 		}	
 	}
 		
@@ -155,7 +159,6 @@ namespace client
 	{	
 		if (m_IsRunning)
 		{	
-			m_CleanupTimer.cancel ();
 			m_IsRunning = false;
 			m_StreamingDestination->Stop ();
 			m_StreamingDestination = nullptr;
@@ -172,16 +175,48 @@ namespace client
 				m_Pool->SetLocalDestination (nullptr);
 				i2p::tunnel::tunnels.StopTunnelPool (m_Pool);
 			}	
-			m_Service.stop ();
+			bool isOwnThread = m_Thread && m_Thread->get_id () == std::this_thread::get_id ();
+			if (isOwnThread)
+				CancelTimers (); // called from our handler, can't wait for ourselves
+			else if (!m_ServicePool || !m_ServicePool->IsPoolThread ())
+			{
+				// timers are cancelled in destination's thread, then we wait for aborted timers
+				// and handlers posted so far, since they hold the destination
+				std::promise<void> done;
+				m_Service.post ([this, &done](void)
+					{
+						CancelTimers ();
+						m_Service.post ([&done](void) { done.set_value (); });
+					});
+				done.get_future ().wait ();
+			}
+			else
+			{
+				// can't wait for pool's thread, handlers called after do nothing since not running
+				m_CleanupTimer.cancel ();
+				m_PublishConfirmationTimer.cancel ();
+			}	
 			if (m_Thread)
 			{	
-				m_Thread->join (); 
+				m_Service.stop ();
+				if (isOwnThread)
+					m_Thread->detach (); // Run exits after this handler since not running
+				else
+					m_Thread->join (); 
 				delete m_Thread;
 				m_Thread = 0;
 			}	
 		}	
 	}	
 
+	void ClientDestination::CancelTimers ()
+	{
+		m_CleanupTimer.cancel ();
+		m_PublishConfirmationTimer.cancel ();
+		for (auto& it: m_LeaseSetRequests)
+			it.second->requestTimeoutTimer.cancel ();
+	}	
+
 	std::shared_ptr<const i2p::data::LeaseSet> ClientDestination::FindLeaseSet (const i2p::data::IdentHash& ident)
 	{
 		auto it = m_RemoteLeaseSets.find (ident);
@@ -415,13 +450,13 @@ namespace client
 		auto msg = WrapMessage (floodfill, i2p::CreateDatabaseStoreMsg (m_LeaseSet, m_PublishReplyToken));			
 		m_PublishConfirmationTimer.expires_from_now (boost::posix_time::seconds(PUBLISH_CONFIRMATION_TIMEOUT));
 		m_PublishConfirmationTimer.async_wait (std::bind (&ClientDestination::HandlePublishConfirmationTimer,
-			this, std::placeholders::_1));	
+			shared_from_this (), std::placeholders::_1));	
 		outbound->SendTunnelDataMsg (floodfill->GetIdentHash (), 0, msg);	
 	}
 
 	void ClientDestination::HandlePublishConfirmationTimer (const boost::system::error_code& ecode)
 	{
-		if (ecode != boost::asio::error::operation_aborted)
+		if (ecode != boost::asio::error::operation_aborted && m_IsRunning)
 		{	
 			if (m_PublishReplyToken)
 			{
@@ -621,7 +656,7 @@ namespace client
 				});	
 			request->requestTimeoutTimer.expires_from_now (boost::posix_time::seconds(LEASESET_REQUEST_TIMEOUT));
 			request->requestTimeoutTimer.async_wait (std::bind (&ClientDestination::HandleRequestTimoutTimer,
-				this, std::placeholders::_1, dest));
+				shared_from_this (), std::placeholders::_1, dest));
 		}	
 		else
 			return false;
@@ -630,7 +665,7 @@ namespace client
 
 	void ClientDestination::HandleRequestTimoutTimer (const boost::system::error_code& ecode, const i2p::data::IdentHash& dest)
 	{
-		if (ecode != boost::asio::error::operation_aborted)
+		if (ecode != boost::asio::error::operation_aborted && m_IsRunning)
 		{
 			auto it = m_LeaseSetRequests.find (dest);
 			if (it != m_LeaseSetRequests.end ())
@@ -662,7 +697,7 @@ namespace client
 
 	void ClientDestination::HandleCleanupTimer (const boost::system::error_code& ecode)
 	{
-		if (ecode != boost::asio::error::operation_aborted)
+		if (ecode != boost::asio::error::operation_aborted && m_IsRunning)
 		{
 			CleanupRoutingSessions ();
 			CleanupRemoteLeaseSets ();
@@ -17,6 +17,7 @@
 #include "NetDb.h"
 #include "Streaming.h"
 #include "Datagram.h"
+#include "util.h"
 
 namespace i2p
 {
@@ -64,7 +65,8 @@ namespace client
 		
 		public:
 
-			ClientDestination (const i2p::data::PrivateKeys& keys, bool isPublic, const std::map<std::string, std::string> * params = nullptr);
+			ClientDestination (const i2p::data::PrivateKeys& keys, bool isPublic, const std::map<std::string, std::string> * params = nullptr,
+				i2p::util::ServicePool * servicePool = nullptr); // own thread if servicePool is not set
 			~ClientDestination ();	
 
 			virtual void Start ();
@@ -124,6 +126,7 @@ namespace client
 			bool SendLeaseSetRequest (const i2p::data::IdentHash& dest, std::shared_ptr<const i2p::data::RouterInfo>  nextFloodfill, std::shared_ptr<LeaseSetRequest> request);	
 			void HandleRequestTimoutTimer (const boost::system::error_code& ecode, const i2p::data::IdentHash& dest);
 			void HandleCleanupTimer (const boost::system::error_code& ecode);
+			void CancelTimers ();
 			void CleanupRemoteLeaseSets ();
 			void PersistTemporaryKeys ();			
 
@@ -131,7 +134,9 @@ namespace client
 
 			volatile bool m_IsRunning;
 			std::thread * m_Thread;	
-			boost::asio::io_service m_Service;
+			i2p::util::ServicePool * m_ServicePool;
+			std::unique_ptr<boost::asio::io_service> m_OwnService;
+			boost::asio::io_service& m_Service;
 			boost::asio::io_service::work m_Work;
 			i2p::data::PrivateKeys m_Keys;
 			uint8_t m_EncryptionPublicKey[256], m_EncryptionPrivateKey[256];
@@ -420,6 +420,31 @@ namespace util
 		s << " (" << i2p::transport::transports.GetInBandwidth () <<" Bps)<br>\r\n";
 		s << "<b>Sent:</b> " << i2p::transport::transports.GetTotalSentBytes ()/1000 << "K";
 		s << " (" << i2p::transport::transports.GetOutBandwidth () <<" Bps)<br>\r\n";
+		s << "<b>I2NP buffers (hits/misses):</b>";
+		for (auto& it: i2p::GetI2NPMessagesPoolsStats ())
+			s << " " << it.size << ": " << it.numHits << "/" << it.numMisses;
+		s << "<br>\r\n";
+		auto& dhKeys = i2p::transport::transports.GetDHKeysPairSupplier ();
+		s << "<b>DH keys (available/target, acquired/starved):</b> " << dhKeys.GetNumAvailable () << "/" << dhKeys.GetTargetSize ();
+		s << ", " << dhKeys.GetNumAcquired () << "/" << dhKeys.GetNumStarved () << "<br>\r\n";
+		auto ssuServer = i2p::transport::transports.GetSSUServer ();
+		if (ssuServer)
+		{
+			size_t numFree = 0, numInUse = 0;
+			uint64_t numHits = 0, numMisses = 0;
+			auto shards = ssuServer->GetShards ();
+			shards.push_back (ssuServer->GetShardV6 ());
+			for (auto shard: shards)
+			{
+				auto& packetsPool = shard->packetsPool;
+				numFree += packetsPool.GetNumFree ();
+				numInUse += packetsPool.GetNumInUse ();
+				numHits += packetsPool.GetNumHits ();
+				numMisses += packetsPool.GetNumMisses ();
+			}
+			s << "<b>SSU packets (free/in use, hits/misses):</b> " << numFree << "/" << numInUse;
+			s << ", " << numHits << "/" << numMisses << "<br>\r\n";
+		}
 		s << "<b>Data path:</b> " << i2p::util::filesystem::GetDataDir().string() << "<br>\r\n<br>\r\n";
 		s << "<b>Our external address:</b>" << "<br>\r\n" ;
 		for (auto& address : i2p::context.GetRouterInfo().GetAddresses())
@@ -562,7 +587,13 @@ namespace util
 			s << "<th>In</th>";
 			s << "<th>Buf</th>";
 			s << "<th>RTT</th>";
+			s << "<th>RTO</th>";
 			s << "<th>Window</th>";
+			s << "<th>SSThresh</th>";
+			s << "<th>Resent</th>";
+			s << "<th>Gzip</th>";
+			s << "<th>Gzip saved</th>";
+			s << "<th>Deflate, us</th>";
 			s << "<th>Status</th>";
 			s << "</tr>";
 
@@ -577,7 +608,13 @@ namespace util
 				s << "<td>" << it.second->GetReceiveQueueSize () << "</td>";
 				s << "<td>" << it.second->GetSendBufferSize () << "</td>";
 				s << "<td>" << it.second->GetRTT () << "</td>";
+				s << "<td>" << it.second->GetRTO () << "</td>";
 				s << "<td>" << it.second->GetWindowSize () << "</td>";
+				s << "<td>" << it.second->GetSlowStartThreshold () << "</td>";
+				s << "<td>" << it.second->GetNumResentPackets () << "</td>";
+				s << "<td>" << (it.second->IsCompressionEnabled () ? "on" : "off") << "</td>";
+				s << "<td>" << it.second->GetNumCompressionSavedBytes () << "</td>";
+				s << "<td>" << it.second->GetAverageDeflateTime () << "</td>";
 				s << "<td>" << (int)it.second->GetStatus () << "</td>";
 				s << "</tr><br>\r\n" << std::endl; 
 			}
@@ -635,6 +672,7 @@ namespace util
 		if (ntcpServer)
 		{	
 			s << "<b>NTCP</b><br>\r\n";
+			std::unique_lock<std::mutex> l(ntcpServer->GetNTCPSessionsMutex ());
 			for (auto it: ntcpServer->GetNTCPSessions ())
 			{
 				if (it.second && it.second->IsEstablished ())
@@ -652,26 +690,39 @@ namespace util
 		auto ssuServer = i2p::transport::transports.GetSSUServer ();
 		if (ssuServer)
 		{
+			uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
 			s << "<br>\r\n<b>SSU</b><br>\r\n";
-			for (auto it: ssuServer->GetSessions ())
+			for (auto shard: ssuServer->GetShards ())
 			{
-				auto endpoint = it.second->GetRemoteEndpoint ();
-				if (it.second->IsOutgoing ()) s << " ⇒ ";
-				s << endpoint.address ().to_string () << ":" << endpoint.port ();
-				if (!it.second->IsOutgoing ()) s << " ⇒ ";
-				s << " [" << it.second->GetNumSentBytes () << ":" << it.second->GetNumReceivedBytes () << "]";
-				if (it.second->GetRelayTag ())
-					s << " [itag:" << it.second->GetRelayTag () << "]";
-				s << "<br>\r\n" << std::endl;
+				std::unique_lock<std::mutex> l(shard->sessionsMutex);
+				for (auto it: shard->sessions)
+				{
+					auto endpoint = it.second->GetRemoteEndpoint ();
+					if (it.second->IsOutgoing ()) s << " ⇒ ";
+					s << endpoint.address ().to_string () << ":" << endpoint.port ();
+					if (!it.second->IsOutgoing ()) s << " ⇒ ";
+					s << " [" << it.second->GetNumSentBytes () << ":" << it.second->GetNumReceivedBytes () << "]";
+					s << " [rtt:" << it.second->GetData ().GetRTT () << "ms cwnd:" << it.second->GetData ().GetWindowSize ();
+					s << " resent:" << it.second->GetData ().GetNumResentFragments () << "/" << it.second->GetData ().GetNumSentFragments ();
+					s << " " << it.second->GetNumSentBytes ()/(ts - it.second->GetCreationTime () + 1) << " Bps]";
+					if (it.second->GetRelayTag ())
+						s << " [itag:" << it.second->GetRelayTag () << "]";
+					s << "<br>\r\n" << std::endl;
+				}
 			}
 			s << "<br>\r\n<b>SSU6</b><br>\r\n";
-			for (auto it: ssuServer->GetSessionsV6 ())
+			auto shardV6 = ssuServer->GetShardV6 ();
+			std::unique_lock<std::mutex> l(shardV6->sessionsMutex);
+			for (auto it: shardV6->sessions)
 			{
 				auto endpoint = it.second->GetRemoteEndpoint ();
 				if (it.second->IsOutgoing ()) s << " ⇒ ";
 				s << endpoint.address ().to_string () << ":" << endpoint.port ();
 				if (!it.second->IsOutgoing ()) s << " ⇒ ";
 				s << " [" << it.second->GetNumSentBytes () << ":" << it.second->GetNumReceivedBytes () << "]";
+				s << " [rtt:" << it.second->GetData ().GetRTT () << "ms cwnd:" << it.second->GetData ().GetWindowSize ();
+				s << " resent:" << it.second->GetData ().GetNumResentFragments () << "/" << it.second->GetData ().GetNumSentFragments ();
+				s << " " << it.second->GetNumSentBytes ()/(ts - it.second->GetCreationTime () + 1) << " Bps]";
 				s << "<br>\r\n" << std::endl;
 			}
 		}
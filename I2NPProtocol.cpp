@@ -20,17 +20,54 @@ namespace i2p
 {
 	std::shared_ptr<I2NPMessage> NewI2NPMessage ()
 	{
-		return std::make_shared<I2NPMessageBuffer<I2NP_MAX_MESSAGE_SIZE> >();
+		return I2NPMessagesPool<I2NP_MAX_MESSAGE_SIZE>::AcquireShared ();
 	}
 	
 	std::shared_ptr<I2NPMessage> NewI2NPShortMessage ()
 	{
-		return std::make_shared<I2NPMessageBuffer<I2NP_MAX_SHORT_MESSAGE_SIZE> >();
+		return I2NPMessagesPool<I2NP_MAX_SHORT_MESSAGE_SIZE>::AcquireShared ();
+	}
+
+	std::shared_ptr<I2NPMessage> NewI2NPTunnelMessage ()
+	{
+		auto msg = I2NPMessagesPool<I2NP_TUNNEL_MESSAGE_SIZE>::AcquireShared ();
+		msg->Align (12);
+		return msg;
 	}
 
 	std::shared_ptr<I2NPMessage> NewI2NPMessage (size_t len)
 	{
-		return (len < I2NP_MAX_SHORT_MESSAGE_SIZE/2) ? NewI2NPShortMessage () : NewI2NPMessage ();
+		len += I2NP_MESSAGE_RESERVED_SIZE;
+		if (len <= I2NP_SMALL_MESSAGE_SIZE)
+			return I2NPMessagesPool<I2NP_SMALL_MESSAGE_SIZE>::AcquireShared ();
+		if (len <= I2NP_TUNNEL_MESSAGE_SIZE)
+			return NewI2NPTunnelMessage ();
+		if (len <= I2NP_MEDIUM_MESSAGE_SIZE)
+			return I2NPMessagesPool<I2NP_MEDIUM_MESSAGE_SIZE>::AcquireShared ();
+		if (len <= I2NP_MAX_SHORT_MESSAGE_SIZE)
+			return NewI2NPShortMessage ();
+		if (len <= I2NP_LARGE_MESSAGE_SIZE)
+			return I2NPMessagesPool<I2NP_LARGE_MESSAGE_SIZE>::AcquireShared ();
+		return NewI2NPMessage ();
+	}	
+
+	template<int sz>
+	static I2NPMessagesPoolStats GetI2NPMessagesPoolStats ()
+	{
+		return { sz, I2NPMessagesPool<sz>::GetNumHits (), I2NPMessagesPool<sz>::GetNumMisses () };
+	}	
+
+	std::vector<I2NPMessagesPoolStats> GetI2NPMessagesPoolsStats ()
+	{
+		return 
+		{
+			GetI2NPMessagesPoolStats<I2NP_SMALL_MESSAGE_SIZE> (),
+			GetI2NPMessagesPoolStats<I2NP_TUNNEL_MESSAGE_SIZE> (),
+			GetI2NPMessagesPoolStats<I2NP_MEDIUM_MESSAGE_SIZE> (),
+			GetI2NPMessagesPoolStats<I2NP_MAX_SHORT_MESSAGE_SIZE> (),
+			GetI2NPMessagesPoolStats<I2NP_LARGE_MESSAGE_SIZE> (),
+			GetI2NPMessagesPoolStats<I2NP_MAX_MESSAGE_SIZE> ()
+		};	
 	}	
 
 	void I2NPMessage::FillI2NPMessageHeader (I2NPMessageType msgType, uint32_t replyMsgID)
@@ -69,7 +106,7 @@ namespace i2p
 
 	std::shared_ptr<I2NPMessage> CreateI2NPMessage (const uint8_t * buf, size_t len, std::shared_ptr<i2p::tunnel::InboundTunnel> from)
 	{
-		auto msg = NewI2NPMessage ();
+		auto msg = NewI2NPMessage (len);
 		if (msg->offset + len < msg->maxLen)
 		{
 			memcpy (msg->GetBuffer (), buf, len);
@@ -83,7 +120,7 @@ namespace i2p
 	
 	std::shared_ptr<I2NPMessage> CreateDeliveryStatusMsg (uint32_t msgID)
 	{
-		auto m = NewI2NPShortMessage ();
+		auto m = NewI2NPMessage (DELIVERY_STATUS_SIZE);
 		uint8_t * buf = m->GetPayload ();
 		if (msgID)
 		{
@@ -104,7 +141,7 @@ namespace i2p
 	std::shared_ptr<I2NPMessage> CreateRouterInfoDatabaseLookupMsg (const uint8_t * key, const uint8_t * from, 
 		uint32_t replyTunnelID, bool exploratory, std::set<i2p::data::IdentHash> * excludedPeers)
 	{
-		auto m = excludedPeers ? NewI2NPMessage () : NewI2NPShortMessage ();
+		auto m = NewI2NPMessage (32 + 32 + 5 + 2 + (excludedPeers ? excludedPeers->size ()*32 : 0)); // key, from, flag + reply tunnel, excluded
 		uint8_t * buf = m->GetPayload ();
 		memcpy (buf, key, 32); // key
 		buf += 32;
@@ -151,7 +188,7 @@ namespace i2p
 		const i2p::tunnel::InboundTunnel * replyTunnel, const uint8_t * replyKey, const uint8_t * replyTag)
 	{
 		int cnt = excludedFloodfills.size ();
-		auto m = cnt > 0 ? NewI2NPMessage () : NewI2NPShortMessage ();
+		auto m = NewI2NPMessage (32 + 32 + 5 + 2 + cnt*32 + 65); // key, reply GW, flag + reply tunnel, excluded, encryption
 		uint8_t * buf = m->GetPayload ();
 		memcpy (buf, dest, 32); // key
 		buf += 32;
@@ -186,7 +223,7 @@ namespace i2p
 	std::shared_ptr<I2NPMessage> CreateDatabaseSearchReply (const i2p::data::IdentHash& ident, 
 		 std::vector<i2p::data::IdentHash> routers)
 	{
-		auto m = NewI2NPShortMessage ();
+		auto m = NewI2NPMessage (32 + 1 + routers.size ()*32 + 32);
 		uint8_t * buf = m->GetPayload ();
 		size_t len = 0;
 		memcpy (buf, ident, 32);
@@ -245,7 +282,7 @@ namespace i2p
 	std::shared_ptr<I2NPMessage> CreateDatabaseStoreMsg (std::shared_ptr<const i2p::data::LeaseSet> leaseSet,  uint32_t replyToken)
 	{
 		if (!leaseSet) return nullptr;
-		auto m = NewI2NPShortMessage ();
+		auto m = NewI2NPMessage (DATABASE_STORE_HEADER_SIZE + 36 + leaseSet->GetBufferLen ());
 		uint8_t * payload = m->GetPayload ();	
 		memcpy (payload + DATABASE_STORE_KEY_OFFSET, leaseSet->GetIdentHash (), 32);
 		payload[DATABASE_STORE_TYPE_OFFSET] = 1; // LeaseSet
@@ -414,7 +451,7 @@ namespace i2p
 
 	std::shared_ptr<I2NPMessage> CreateTunnelDataMsg (const uint8_t * buf)
 	{
-		auto msg = NewI2NPShortMessage ();
+		auto msg = NewI2NPTunnelMessage ();
 		msg->Concat (buf, i2p::tunnel::TUNNEL_DATA_MSG_SIZE);	
 		msg->FillI2NPMessageHeader (eI2NPTunnelData);
 		return msg;
@@ -422,7 +459,7 @@ namespace i2p
 
 	std::shared_ptr<I2NPMessage> CreateTunnelDataMsg (uint32_t tunnelID, const uint8_t * payload)	
 	{
-		auto msg = NewI2NPShortMessage ();
+		auto msg = NewI2NPTunnelMessage ();
 		htobe32buf (msg->GetPayload (), tunnelID);
 		msg->len += 4; // tunnelID
 		msg->Concat (payload, i2p::tunnel::TUNNEL_DATA_MSG_SIZE - 4);
@@ -432,7 +469,7 @@ namespace i2p
 
 	std::shared_ptr<I2NPMessage> CreateEmptyTunnelDataMsg ()
 	{
-		auto msg = NewI2NPShortMessage ();
+		auto msg = NewI2NPTunnelMessage ();
 		msg->len += i2p::tunnel::TUNNEL_DATA_MSG_SIZE; 
 		return msg;
 	}	
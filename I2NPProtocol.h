@@ -4,12 +4,14 @@
 #include <inttypes.h>
 #include <string.h>
 #include <set>
+#include <vector>
 #include <memory>
 #include <openssl/sha.h>
 #include "I2PEndian.h"
 #include "Identity.h"
 #include "RouterInfo.h"
 #include "LeaseSet.h"
+#include "MemoryPool.h"
 
 namespace i2p
 {	
@@ -107,6 +109,13 @@ namespace tunnel
 
 	const size_t I2NP_MAX_MESSAGE_SIZE = 32768; 
 	const size_t I2NP_MAX_SHORT_MESSAGE_SIZE = 4096; 
+	const size_t I2NP_TUNNEL_MESSAGE_SIZE = 1028 + I2NP_HEADER_SIZE + 34; // TunnelData + alignment and NTCP header/padding/checksum
+	// size classes for NewI2NPMessage (len) besides short, tunnel and max 
+	const size_t I2NP_SMALL_MESSAGE_SIZE = 1024;
+	const size_t I2NP_MEDIUM_MESSAGE_SIZE = 2048;
+	const size_t I2NP_LARGE_MESSAGE_SIZE = 8192;
+	// NTCP header + I2NP header + room for wrapping into TunnelGateway
+	const size_t I2NP_MESSAGE_RESERVED_SIZE = 2 + I2NP_HEADER_SIZE + TUNNEL_GATEWAY_HEADER_SIZE + I2NP_HEADER_SIZE;
 	const unsigned int I2NP_MESSAGE_EXPIRATION_TIMEOUT = 8000; // in milliseconds (as initial RTT)
 	const unsigned int I2NP_MESSAGE_CLOCK_SKEW = 60*1000; // 1 minute in milliseconds 
 
@@ -209,9 +218,20 @@ namespace tunnel
 		uint8_t m_Buffer[sz + 32]; // 16 alignment + 16 padding
 	};
 
+	template<int sz>
+	using I2NPMessagesPool = i2p::util::MemoryPool<I2NPMessageBuffer<sz> >;
+
+	struct I2NPMessagesPoolStats
+	{
+		size_t size;
+		uint64_t numHits, numMisses;
+	};	
+	std::vector<I2NPMessagesPoolStats> GetI2NPMessagesPoolsStats ();
+
 	std::shared_ptr<I2NPMessage> NewI2NPMessage ();
 	std::shared_ptr<I2NPMessage> NewI2NPShortMessage ();
-	std::shared_ptr<I2NPMessage> NewI2NPMessage (size_t len);
+	std::shared_ptr<I2NPMessage> NewI2NPTunnelMessage ();
+	std::shared_ptr<I2NPMessage> NewI2NPMessage (size_t len); // smallest buffer for len bytes of payload
 	
 	std::shared_ptr<I2NPMessage> CreateI2NPMessage (I2NPMessageType msgType, const uint8_t * buf, size_t len, uint32_t replyMsgID = 0);	
 	std::shared_ptr<I2NPMessage> CreateI2NPMessage (const uint8_t * buf, size_t len, std::shared_ptr<i2p::tunnel::InboundTunnel> from = nullptr);
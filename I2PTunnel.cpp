@@ -42,7 +42,7 @@ namespace client
 			if (msg)
 				m_Stream->Send (msg, len); // connect and send
 			else	
-				m_Stream->Send (m_Buffer, 0); // connect
+				m_Stream->Send (nullptr, 0); // connect
 		}
 		StreamReceive ();
 		Receive ();
@@ -69,9 +69,17 @@ namespace client
 
 	void I2PTunnelConnection::Receive ()
 	{
-		m_Socket->async_read_some (boost::asio::buffer(m_Buffer, I2P_TUNNEL_CONNECTION_BUFFER_SIZE),                
-			std::bind(&I2PTunnelConnection::HandleReceived, shared_from_this (), 
-			std::placeholders::_1, std::placeholders::_2));
+		if (m_Stream)
+		{
+			// keep the stream until completed
+			auto s = shared_from_this ();
+			auto stream = m_Stream;
+			m_Socket->async_read_some (stream->PrepareSend (I2P_TUNNEL_CONNECTION_BUFFER_SIZE),
+				[s, stream](const boost::system::error_code& ecode, std::size_t bytes_transferred)
+				{
+					s->HandleReceived (ecode, bytes_transferred);
+				});
+		}
 	}	
 	
 	void I2PTunnelConnection::HandleReceived (const boost::system::error_code& ecode, std::size_t bytes_transferred)
@@ -87,7 +95,7 @@ namespace client
 			if (m_Stream)
 			{	
 				auto s = shared_from_this ();
-				m_Stream->AsyncSend (m_Buffer, bytes_transferred,
+				m_Stream->AsyncCommitSend (bytes_transferred,
 					[s](const boost::system::error_code& ecode)
 				    {
 						if (!ecode)
@@ -114,13 +122,14 @@ namespace client
 	void I2PTunnelConnection::StreamReceive ()
 	{
 		if (m_Stream)
-			m_Stream->AsyncReceive (boost::asio::buffer (m_StreamBuffer, I2P_TUNNEL_CONNECTION_BUFFER_SIZE),
+			m_Stream->AsyncReceiveBuffers (I2P_TUNNEL_CONNECTION_BUFFER_SIZE,
 				std::bind (&I2PTunnelConnection::HandleStreamReceive, shared_from_this (),
-					std::placeholders::_1, std::placeholders::_2),
+					std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
 				I2P_TUNNEL_CONNECTION_MAX_IDLE);
 	}	
 
-	void I2PTunnelConnection::HandleStreamReceive (const boost::system::error_code& ecode, std::size_t bytes_transferred)
+	void I2PTunnelConnection::HandleStreamReceive (const boost::system::error_code& ecode, 
+		const std::vector<boost::asio::const_buffer>& buffers, std::size_t bytes_transferred)
 	{
 		if (ecode)
 		{
@@ -129,15 +138,28 @@ namespace client
 				Terminate ();
 		}
 		else
-			Write (m_StreamBuffer, bytes_transferred);
+			WriteStreamData (buffers, bytes_transferred);
 	}
 
 	void I2PTunnelConnection::Write (const uint8_t * buf, size_t len)
 	{
-		m_Socket->async_send (boost::asio::buffer (buf, len),
+		boost::asio::async_write (*m_Socket, boost::asio::buffer (buf, len),
         	std::bind (&I2PTunnelConnection::HandleWrite, shared_from_this (), std::placeholders::_1));
 	}
 
+	void I2PTunnelConnection::WriteStreamData (const std::vector<boost::asio::const_buffer>& buffers, size_t len)
+	{
+		// buffers point to stream's packets, the stream keeps them until consumed
+		auto s = shared_from_this ();
+		auto stream = m_Stream;
+		boost::asio::async_write (*m_Socket, buffers,
+			[s, stream, len](const boost::system::error_code& ecode, std::size_t)
+			{
+				if (!ecode) stream->Consume (len); // packets are not needed anymore
+				s->HandleWrite (ecode);
+			});
+	}
+
 	void I2PTunnelConnection::HandleConnect (const boost::system::error_code& ecode)
 	{
 		if (ecode)
@@ -153,10 +175,9 @@ namespace client
 			else
 			{
 				// send destination first like received from I2P
-				std::string dest = m_Stream->GetRemoteIdentity ()->ToBase64 ();
-				dest += "\n";
-				memcpy (m_StreamBuffer, dest.c_str (), dest.size ());
-				HandleStreamReceive (boost::system::error_code (), dest.size ());
+				m_Destination = m_Stream->GetRemoteIdentity ()->ToBase64 ();
+				m_Destination += "\n";
+				Write ((const uint8_t *)m_Destination.c_str (), m_Destination.size ());
 			}	
 			Receive ();	
 		}
@@ -169,14 +190,16 @@ namespace client
 	{
 	}
 
-	void I2PTunnelConnectionHTTP::Write (const uint8_t * buf, size_t len)
+	void I2PTunnelConnectionHTTP::WriteStreamData (const std::vector<boost::asio::const_buffer>& buffers, size_t len)
 	{
 		if (m_HeaderSent)
-			I2PTunnelConnection::Write (buf, len);
+			I2PTunnelConnection::WriteStreamData (buffers, len);
 		else
 		{	
 			m_InHeader.clear ();
-			m_InHeader.write ((const char *)buf, len);
+			for (auto& it: buffers)
+				m_InHeader.write (boost::asio::buffer_cast<const char *>(it), boost::asio::buffer_size (it));
+			ConsumeStreamData (len); // copied
 			std::string line;
 			bool endOfHeader = false;
 			while (!endOfHeader)
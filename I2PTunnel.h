@@ -16,7 +16,7 @@ namespace i2p
 {
 namespace client
 {
-	const size_t I2P_TUNNEL_CONNECTION_BUFFER_SIZE = 8192;
+	const size_t I2P_TUNNEL_CONNECTION_BUFFER_SIZE = 8192; // max bytes per socket read or write
 	const int I2P_TUNNEL_CONNECTION_MAX_IDLE = 3600; // in seconds	
 	const int I2P_TUNNEL_DESTINATION_REQUEST_TIMEOUT = 10; // in seconds
 	// for HTTP tunnels		
@@ -42,18 +42,21 @@ namespace client
 
 			void Terminate ();	
 
-			void Receive ();
+			void Receive (); // directly to stream's send buffer
 			void HandleReceived (const boost::system::error_code& ecode, std::size_t bytes_transferred);	
-			virtual void Write (const uint8_t * buf, size_t len); // can be overloaded
+			void Write (const uint8_t * buf, size_t len);
+			virtual void WriteStreamData (const std::vector<boost::asio::const_buffer>& buffers, size_t len); // can be overloaded
 			void HandleWrite (const boost::system::error_code& ecode);	
+			void ConsumeStreamData (size_t len) { if (m_Stream) m_Stream->Consume (len); };
 
-			void StreamReceive ();
-			void HandleStreamReceive (const boost::system::error_code& ecode, std::size_t bytes_transferred);
+			void StreamReceive (); // stream's packets are written to socket as is
+			void HandleStreamReceive (const boost::system::error_code& ecode, 
+				const std::vector<boost::asio::const_buffer>& buffers, std::size_t bytes_transferred);
 			void HandleConnect (const boost::system::error_code& ecode);
 
 		private:
 
-			uint8_t m_Buffer[I2P_TUNNEL_CONNECTION_BUFFER_SIZE], m_StreamBuffer[I2P_TUNNEL_CONNECTION_BUFFER_SIZE];
+			std::string m_Destination; // sent first if not quiet
 			std::shared_ptr<boost::asio::ip::tcp::socket> m_Socket;
 			std::shared_ptr<i2p::stream::Stream> m_Stream;
 			boost::asio::ip::tcp::endpoint m_RemoteEndpoint;
@@ -70,7 +73,7 @@ namespace client
 
 		protected:
 
-			void Write (const uint8_t * buf, size_t len);
+			void WriteStreamData (const std::vector<boost::asio::const_buffer>& buffers, size_t len);
 
 		private:
 		
@@ -531,11 +531,23 @@ namespace data
 		return keys;
 	}	
 
+	struct RoutingKeysCacheEntry
+	{
+		IdentHash ident, key;
+		uint32_t day; // days since epoch, 0 if empty
+	};	
+
 	IdentHash CreateRoutingKey (const IdentHash& ident)
 	{
+		time_t t = time (nullptr);
+		uint32_t day = t/86400; // UTC
+		// same keys are looked up many times a day, SHA256 is much slower than cache lookup
+		static thread_local RoutingKeysCacheEntry cache[ROUTING_KEYS_CACHE_SIZE];
+		auto& entry = cache[ident.GetLL ()[0] % ROUTING_KEYS_CACHE_SIZE];
+		if (entry.day == day && entry.ident == ident) return entry.key;
+
 		uint8_t buf[41]; // ident + yyyymmdd
 		memcpy (buf, (const uint8_t *)ident, 32);
-		time_t t = time (nullptr);
 		struct tm tm;
 #ifdef _WIN32
 		gmtime_s(&tm, &t);
@@ -546,6 +558,9 @@ namespace data
 #endif		
 		IdentHash key;
 		SHA256(buf, 40, key);
+		entry.ident = ident;
+		entry.key = key;
+		entry.day = day;
 		return key;
 	}	
 	
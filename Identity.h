@@ -156,7 +156,8 @@ namespace data
 		bool operator< (const XORMetric& other) const { return memcmp (metric, other.metric, 32) < 0; };
 	};	
 
-	IdentHash CreateRoutingKey (const IdentHash& ident);
+	const size_t ROUTING_KEYS_CACHE_SIZE = 1024; // per thread
+	IdentHash CreateRoutingKey (const IdentHash& ident); // cached for current day
 	XORMetric operator^(const IdentHash& key1, const IdentHash& key2); 	
 	
 	// destination for delivery instuctions
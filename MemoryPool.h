@@ -0,0 +1,213 @@
+#ifndef MEMORY_POOL_H__
+#define MEMORY_POOL_H__
+
+#include <inttypes.h>
+#include <new>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <utility>
+
+namespace i2p
+{
+namespace util
+{
+	const size_t MEMORY_POOL_MAX_FREE_OBJECTS = 1024; // per thread
+	const size_t MEMORY_POOL_MIN_FREE_OBJECTS = 16; // per thread, for large objects
+	const size_t MEMORY_POOL_MAX_FREE_BYTES = 1024*1024; // per thread, objects are fewer if large
+	const size_t MEMORY_POOL_MAX_DEPOT_BYTES = 4*1024*1024; // shared by all threads
+
+	// Objects are recycled through a free list owned by the releasing thread,
+	// so an object created in one thread and dropped in another never takes a lock.
+	// Since creating and releasing threads are often different, a thread with full list
+	// moves half of it to the depot and a thread with empty list takes a batch from there
+	template<class T, size_t maxFree = MEMORY_POOL_MAX_FREE_OBJECTS>
+	class MemoryPool
+	{
+		static_assert (sizeof (T) >= sizeof (void *), "pooled object is too small");
+
+		public:
+
+			template<typename... TArgs>
+			static T * Acquire (TArgs&&... args)
+			{
+				auto& freeList = GetFreeList ();
+				void * mem = freeList.Pop ();
+				if (!mem && GetDepot ().Get (freeList))
+					mem = freeList.Pop ();
+				if (mem)
+					s_NumHits.fetch_add (1, std::memory_order_relaxed);
+				else
+				{
+					mem = ::operator new (sizeof (T));
+					s_NumMisses.fetch_add (1, std::memory_order_relaxed);
+				}
+				return new (mem) T (std::forward<TArgs>(args)...);
+			}
+
+			static void Release (T * t)
+			{
+				if (!t) return;
+				t->~T ();
+				auto& freeList = GetFreeList ();
+				if (freeList.IsFull ())
+					GetDepot ().Put (freeList);
+				if (!freeList.Push (t))
+					::operator delete (t); // depot is full too
+			}
+
+			template<typename... TArgs>
+			static std::shared_ptr<T> AcquireShared (TArgs&&... args)
+			{
+				return std::shared_ptr<T>(Acquire (std::forward<TArgs>(args)...), &MemoryPool<T, maxFree>::Release);
+			}
+
+			static uint64_t GetNumHits () { return s_NumHits.load (std::memory_order_relaxed); };
+			static uint64_t GetNumMisses () { return s_NumMisses.load (std::memory_order_relaxed); };
+
+		private:
+
+			static constexpr size_t GetCapacity () // per thread
+			{
+				return maxFree*sizeof (T) <= MEMORY_POOL_MAX_FREE_BYTES ? maxFree :
+					(MEMORY_POOL_MAX_FREE_BYTES/sizeof (T) > MEMORY_POOL_MIN_FREE_OBJECTS ?
+					MEMORY_POOL_MAX_FREE_BYTES/sizeof (T) : MEMORY_POOL_MIN_FREE_OBJECTS);
+			}
+
+			static constexpr size_t GetBatchSize () { return GetCapacity () > 1 ? GetCapacity ()/2 : 1; };
+
+			static constexpr size_t GetMaxDepotBatches ()
+			{
+				return MEMORY_POOL_MAX_DEPOT_BYTES/(sizeof (T)*GetBatchSize ()) > 0 ?
+					MEMORY_POOL_MAX_DEPOT_BYTES/(sizeof (T)*GetBatchSize ()) : 1;
+			}
+
+			struct Node { Node * next; };
+			struct Batch { Node * head, * tail; }; // GetBatchSize () nodes
+
+			struct FreeList
+			{
+				Node * head;
+				size_t size, capacity;
+
+				FreeList (): head (nullptr), size (0), capacity (GetCapacity ()) {};
+				~FreeList ()
+				{
+					// thread is exiting, give what we have to other threads
+					while (GetDepot ().Put (*this));
+					while (auto mem = Pop ()) ::operator delete (mem);
+					capacity = 0; // don't keep anything anymore
+				}
+
+				bool IsFull () const { return size >= capacity; };
+
+				void * Pop ()
+				{
+					if (!head) return nullptr;
+					auto node = head;
+					head = node->next;
+					size--;
+					return node;
+				}
+
+				bool Push (void * mem)
+				{
+					if (size >= capacity) return false;
+					auto node = static_cast<Node *>(mem);
+					node->next = head;
+					head = node;
+					size++;
+					return true;
+				}
+
+				Batch PopBatch () // size must be GetBatchSize () at least
+				{
+					Batch batch{ head, head };
+					for (size_t i = 1; i < GetBatchSize (); i++)
+						batch.tail = batch.tail->next;
+					head = batch.tail->next;
+					batch.tail->next = nullptr;
+					size -= GetBatchSize ();
+					return batch;
+				}
+
+				void PushBatch (const Batch& batch)
+				{
+					batch.tail->next = head;
+					head = batch.head;
+					size += GetBatchSize ();
+				}
+			};
+
+			struct Depot
+			{
+				std::mutex mutex;
+				std::vector<Batch> batches;
+				std::atomic<size_t> numBatches; // including being put
+
+				Depot (): numBatches (0) {};
+				~Depot ()
+				{
+					for (auto& it: batches)
+						for (auto node = it.head; node;)
+						{
+							auto next = node->next;
+							::operator delete (node);
+							node = next;
+						}
+				}
+
+				bool Put (FreeList& freeList)
+				{
+					if (freeList.size < GetBatchSize ()) return false;
+					if (numBatches.fetch_add (1, std::memory_order_relaxed) >= GetMaxDepotBatches ())
+					{
+						numBatches.fetch_sub (1, std::memory_order_relaxed);
+						return false; // full
+					}
+					auto batch = freeList.PopBatch (); // outside of lock
+					std::unique_lock<std::mutex> l(mutex);
+					batches.push_back (batch);
+					return true;
+				}
+
+				bool Get (FreeList& freeList)
+				{
+					if (!numBatches.load (std::memory_order_relaxed)) return false;
+					Batch batch;
+					{
+						std::unique_lock<std::mutex> l(mutex);
+						if (batches.empty ()) return false;
+						batch = batches.back ();
+						batches.pop_back ();
+					}
+					numBatches.fetch_sub (1, std::memory_order_relaxed);
+					freeList.PushBatch (batch);
+					return true;
+				}
+			};
+
+			static FreeList& GetFreeList ()
+			{
+				static thread_local FreeList freeList;
+				return freeList;
+			}
+
+			static Depot& GetDepot ()
+			{
+				static Depot depot;
+				return depot;
+			}
+
+			static std::atomic<uint64_t> s_NumHits, s_NumMisses;
+	};
+
+	template<class T, size_t maxFree>
+	std::atomic<uint64_t> MemoryPool<T, maxFree>::s_NumHits (0);
+	template<class T, size_t maxFree>
+	std::atomic<uint64_t> MemoryPool<T, maxFree>::s_NumMisses (0);
+}
+}
+
+#endif
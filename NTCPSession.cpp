@@ -21,8 +21,8 @@ namespace i2p
 namespace transport
 {
 	NTCPSession::NTCPSession (NTCPServer& server, std::shared_ptr<const i2p::data::RouterInfo> in_RemoteRouter): 
-		TransportSession (in_RemoteRouter),	m_Server (server), m_Socket (m_Server.GetService ()), 
-		m_TerminationTimer (m_Server.GetService ()), m_IsEstablished (false), m_IsTerminated (false),
+		TransportSession (in_RemoteRouter),	m_Server (server), m_Service (m_Server.GetNextService ()),
+		m_Socket (m_Service), m_TerminationTimer (m_Service), m_IsEstablished (false), m_IsTerminated (false),
 		m_ReceiveBufferOffset (0), m_NextMessage (nullptr), m_IsSending (false)
 	{		
 		m_DHKeysPair = transports.GetNextDHKeysPair ();
@@ -66,7 +66,7 @@ namespace transport
 
 	void NTCPSession::Done ()
 	{
-		m_Server.GetService ().post (std::bind (&NTCPSession::Terminate, shared_from_this ()));  
+		m_Service.post (std::bind (&NTCPSession::Terminate, shared_from_this ()));  
 	}	
 		
 	void NTCPSession::Terminate ()
@@ -80,7 +80,7 @@ namespace transport
 			m_Server.RemoveNTCPSession (shared_from_this ());
 			m_SendQueue.clear ();
 			m_NextMessage = nullptr;
-			m_TerminationTimer.cancel ();
+			m_TerminationTimer.Cancel ();
 			LogPrint (eLogDebug, "NTCP: session terminated");
 		}	
 	}	
@@ -554,8 +554,7 @@ namespace transport
 					LogPrint (eLogError, "NTCP: data size ", dataSize, " exceeds max size");
 					return false;
 				}
-				auto msg = (dataSize + 16U) <= I2NP_MAX_SHORT_MESSAGE_SIZE - 2 ? NewI2NPShortMessage () : NewI2NPMessage ();
-				m_NextMessage = msg;	
+				m_NextMessage = NewI2NPMessage (dataSize);	
 				memcpy (m_NextMessage->buf, buf, 16);
 				m_NextMessageOffset = 16;
 				m_NextMessage->offset = 2; // size field
@@ -595,56 +594,65 @@ namespace transport
 
 	void NTCPSession::Send (std::shared_ptr<i2p::I2NPMessage> msg)
 	{
-		m_IsSending = true;
-		boost::asio::async_write (m_Socket, CreateMsgBuffer (msg), boost::asio::transfer_all (),                      
-        	std::bind(&NTCPSession::HandleSent, shared_from_this (), std::placeholders::_1, std::placeholders::_2, std::vector<std::shared_ptr<I2NPMessage> >{ msg }));	
+		m_SendQueue.push_back (msg);
+		if (!m_IsSending) SendQueuedMessages ();
 	}
 
-	boost::asio::const_buffers_1 NTCPSession::CreateMsgBuffer (std::shared_ptr<I2NPMessage> msg)
+	size_t NTCPSession::GetMsgBufferLength (std::shared_ptr<I2NPMessage> msg) const
 	{
-		uint8_t * sendBuffer;
-		int len;
+		size_t len = msg ? msg->GetLength () : 4;
+		return (len + 6 + 15) & ~0x0F; // size, data, padding and checksum
+	}
 
+	size_t NTCPSession::CreateMsgBuffer (std::shared_ptr<I2NPMessage> msg, uint8_t * sendBuffer)
+	{
+		int len;
 		if (msg)
 		{	
 			// regular I2NP
-			if (msg->offset < 2)
-				LogPrint (eLogError, "NTCP: Malformed I2NP message"); // TODO:
-			sendBuffer = msg->GetBuffer () - 2; 
 			len = msg->GetLength ();
-			htobe16buf (sendBuffer, len);
+			memcpy (sendBuffer + 2, msg->GetBuffer (), len);
 		}	
 		else
 		{
 			// prepare timestamp
-			sendBuffer = m_TimeSyncBuffer;
 			len = 4;
-			htobuf16(sendBuffer, 0);
 			htobe32buf (sendBuffer + 2, time (0));
 		}	
+		htobe16buf (sendBuffer, msg ? len : 0);
 		int rem = (len + 6) & 0x0F; // %16
 		int padding = 0;
 		if (rem > 0) padding = 16 - rem;
 		// TODO: fill padding 
 		htobe32buf (sendBuffer + len + 2 + padding, adler32 (adler32 (0, Z_NULL, 0), sendBuffer, len + 2+ padding));
-
-		int l = len + padding + 6;
-		m_Encryption.Encrypt(sendBuffer, l, sendBuffer);	
-		return boost::asio::buffer ((const uint8_t *)sendBuffer, l);
+		return len + padding + 6;
 	}	
 
-
-	void NTCPSession::Send (const std::vector<std::shared_ptr<I2NPMessage> >& msgs)
+	void NTCPSession::SendQueuedMessages ()
 	{
+		// frame as many messages as fit to send buffer and encrypt them in one pass,
+		// since CBC state is carried from message to message anyway
+		size_t len = 0, numMsgs = 0;
+		for (auto it: m_SendQueue)
+		{
+			size_t l = GetMsgBufferLength (it);
+			if (numMsgs > 0 && len + l > NTCP_MAX_SEND_BUFFER_SIZE) break;
+			len += l;
+			numMsgs++;
+		}
+		if (m_SendBuffer.size () < len) m_SendBuffer.resize (len);
+		uint8_t * sendBuffer = m_SendBuffer.data ();
+		for (size_t i = 0; i < numMsgs; i++)
+			sendBuffer += CreateMsgBuffer (m_SendQueue[i], sendBuffer);
+		m_SendQueue.erase (m_SendQueue.begin (), m_SendQueue.begin () + numMsgs);
+		m_Encryption.Encrypt (m_SendBuffer.data (), len, m_SendBuffer.data ());
+
 		m_IsSending = true;
-		std::vector<boost::asio::const_buffer> bufs;
-		for (auto it: msgs)
-			bufs.push_back (CreateMsgBuffer (it));
-		boost::asio::async_write (m_Socket, bufs, boost::asio::transfer_all (),                      
-        	std::bind(&NTCPSession::HandleSent, shared_from_this (), std::placeholders::_1, std::placeholders::_2, msgs));
+		boost::asio::async_write (m_Socket, boost::asio::buffer (m_SendBuffer.data (), len), boost::asio::transfer_all (),                      
+        	std::bind(&NTCPSession::HandleSent, shared_from_this (), std::placeholders::_1, std::placeholders::_2));
 	}
 		
-	void NTCPSession::HandleSent (const boost::system::error_code& ecode, std::size_t bytes_transferred, std::vector<std::shared_ptr<I2NPMessage> > msgs)
+	void NTCPSession::HandleSent (const boost::system::error_code& ecode, std::size_t bytes_transferred)
 	{
 		m_IsSending = false;
 		if (ecode)
@@ -659,10 +667,7 @@ namespace transport
 			m_NumSentBytes += bytes_transferred;
 			i2p::transport::transports.UpdateSentBytes (bytes_transferred);
 			if (!m_SendQueue.empty())
-			{
-				Send (m_SendQueue);
-				m_SendQueue.clear ();
-			}	
+				SendQueuedMessages ();
 			else
 				ScheduleTermination (); // reset termination timer
 		}	
@@ -677,26 +682,21 @@ namespace transport
 
 	void NTCPSession::SendI2NPMessages (const std::vector<std::shared_ptr<I2NPMessage> >& msgs)
 	{
-		m_Server.GetService ().post (std::bind (&NTCPSession::PostI2NPMessages, shared_from_this (), msgs));  
+		m_Service.post (std::bind (&NTCPSession::PostI2NPMessages, shared_from_this (), msgs));  
 	}	
 
 	void NTCPSession::PostI2NPMessages (std::vector<std::shared_ptr<I2NPMessage> > msgs)
 	{
 		if (m_IsTerminated) return;
-		if (m_IsSending)
-		{
-			for (auto it: msgs)
-				m_SendQueue.push_back (it);
-		}	
-		else	
-			Send (msgs);
+		for (auto it: msgs)
+			m_SendQueue.push_back (it);
+		if (!m_IsSending)
+			SendQueuedMessages ();
 	}	
 		
 	void NTCPSession::ScheduleTermination ()
 	{
-		m_TerminationTimer.cancel ();
-		m_TerminationTimer.expires_from_now (boost::posix_time::seconds(NTCP_TERMINATION_TIMEOUT));
-		m_TerminationTimer.async_wait (std::bind (&NTCPSession::HandleTerminationTimer,
+		m_TerminationTimer.AsyncWait (NTCP_TERMINATION_TIMEOUT*1000, std::bind (&NTCPSession::HandleTerminationTimer,
 			shared_from_this (), std::placeholders::_1));
 	}
 
@@ -711,8 +711,8 @@ namespace transport
 	}	
 
 //-----------------------------------------
-	NTCPServer::NTCPServer (int port):
-		m_IsRunning (false), m_Thread (nullptr), m_Work (m_Service), 
+	NTCPServer::NTCPServer (int port, int numThreads):
+		m_IsRunning (false), m_Services (numThreads, "NTCP"),
 		m_NTCPAcceptor (nullptr), m_NTCPV6Acceptor (nullptr)
 	{
 	}
@@ -727,14 +727,14 @@ namespace transport
 		if (!m_IsRunning)
 		{	
 			m_IsRunning = true;
-			m_Thread = new std::thread (std::bind (&NTCPServer::Run, this));
+			m_Services.Start ();
 			// create acceptors
 			auto addresses = context.GetRouterInfo ().GetAddresses ();
 			for (auto& address : addresses)
 			{
 				if (address.transportStyle == i2p::data::RouterInfo::eTransportNTCP && address.host.is_v4 ())
 				{	
-					m_NTCPAcceptor = new boost::asio::ip::tcp::acceptor (m_Service,
+					m_NTCPAcceptor = new boost::asio::ip::tcp::acceptor (m_Services.GetService (0),
 						boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), address.port));
 
 					LogPrint (eLogInfo, "NTCP: Start listening TCP port ", address.port);
@@ -744,7 +744,7 @@ namespace transport
 				
 					if (context.SupportsV6 ())
 					{
-						m_NTCPV6Acceptor = new boost::asio::ip::tcp::acceptor (m_Service);
+						m_NTCPV6Acceptor = new boost::asio::ip::tcp::acceptor (m_Services.GetService (0));
 						m_NTCPV6Acceptor->open (boost::asio::ip::tcp::v6());
 						m_NTCPV6Acceptor->set_option (boost::asio::ip::v6_only (true));
 						m_NTCPV6Acceptor->bind (boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v6(), address.port));
@@ -762,7 +762,10 @@ namespace transport
 		
 	void NTCPServer::Stop ()
 	{	
-		m_NTCPSessions.clear ();
+		{
+			std::unique_lock<std::mutex> l(m_NTCPSessionsMutex);
+			m_NTCPSessions.clear ();
+		}
 
 		if (m_IsRunning)
 		{	
@@ -772,29 +775,7 @@ namespace transport
 			delete m_NTCPV6Acceptor;
 			m_NTCPV6Acceptor = nullptr;
 
-			m_Service.stop ();
-			if (m_Thread)
-			{	
-				m_Thread->join (); 
-				delete m_Thread;
-				m_Thread = nullptr;
-			}	
-		}	
-	}	
-
-		
-	void NTCPServer::Run () 
-	{ 
-		while (m_IsRunning)
-		{
-			try
-			{	
-				m_Service.run ();
-			}
-			catch (std::exception& ex)
-			{
-				LogPrint (eLogError, "NTCP: runtime exception: ", ex.what ());
-			}	
+			m_Services.Stop ();
 		}	
 	}	
 
@@ -802,6 +783,7 @@ namespace transport
 	{
 		if (!session || !session->GetRemoteIdentity ()) return false;
 		auto& ident = session->GetRemoteIdentity ()->GetIdentHash ();
+		std::unique_lock<std::mutex> l(m_NTCPSessionsMutex);
 		auto it = m_NTCPSessions.find (ident);
 		if (it != m_NTCPSessions.end ())
 		{
@@ -815,11 +797,15 @@ namespace transport
 	void NTCPServer::RemoveNTCPSession (std::shared_ptr<NTCPSession> session)
 	{
 		if (session && session->GetRemoteIdentity ())
+		{
+			std::unique_lock<std::mutex> l(m_NTCPSessionsMutex);
 			m_NTCPSessions.erase (session->GetRemoteIdentity ()->GetIdentHash ());
+		}
 	}	
 
 	std::shared_ptr<NTCPSession> NTCPServer::FindNTCPSession (const i2p::data::IdentHash& ident)
 	{
+		std::unique_lock<std::mutex> l(m_NTCPSessionsMutex);
 		auto it = m_NTCPSessions.find (ident);
 		if (it != m_NTCPSessions.end ())
 			return it->second;
@@ -835,20 +821,8 @@ namespace transport
 			if (!ec)
 			{
 				LogPrint (eLogDebug, "NTCP: Connected from ", ep);
-				auto it = m_BanList.find (ep.address ());
-				if (it != m_BanList.end ())
-				{
-					uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
-					if (ts < it->second)
-					{
-						LogPrint (eLogWarning, "NTCP: ", ep.address (), " is banned for ", it->second - ts, " more seconds");
-						conn = nullptr;
-					}
-					else
-						m_BanList.erase (it);
-				}
-				if (conn)
-					conn->ServerLogin ();
+				if (!IsBanned (ep.address ()))
+					conn->GetService ().post (std::bind (&NTCPSession::ServerLogin, conn));
 			}
 			else
 				LogPrint (eLogError, "NTCP: Connected from error ", ec.message ());
@@ -872,20 +846,8 @@ namespace transport
 			if (!ec)
 			{
 				LogPrint (eLogDebug, "NTCP: Connected from ", ep);
-				auto it = m_BanList.find (ep.address ());
-				if (it != m_BanList.end ())
-				{
-					uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
-					if (ts < it->second)
-					{
-						LogPrint (eLogWarning, "NTCP: ", ep.address (), " is banned for ", it->second - ts, " more seconds");
-						conn = nullptr;
-					}
-					else
-						m_BanList.erase (it);
-				}
-				if (conn)
-					conn->ServerLogin ();
+				if (!IsBanned (ep.address ()))
+					conn->GetService ().post (std::bind (&NTCPSession::ServerLogin, conn));
 			}
 			else
 				LogPrint (eLogError, "NTCP: Connected from error ", ec.message ());
@@ -902,7 +864,7 @@ namespace transport
 	void NTCPServer::Connect (const boost::asio::ip::address& address, int port, std::shared_ptr<NTCPSession> conn)
 	{
 		LogPrint (eLogDebug, "NTCP: Connecting to ", address ,":",  port);
-		m_Service.post([=]()
+		conn->GetService ().post([=]()
 		{           
 			if (this->AddNTCPSession (conn))
 				conn->GetSocket ().async_connect (boost::asio::ip::tcp::endpoint (address, port), 
@@ -928,9 +890,28 @@ namespace transport
 		}	
 	}	
 
+	bool NTCPServer::IsBanned (const boost::asio::ip::address& addr)
+	{
+		std::unique_lock<std::mutex> l(m_BanListMutex);
+		auto it = m_BanList.find (addr);
+		if (it != m_BanList.end ())
+		{
+			uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
+			if (ts < it->second)
+			{
+				LogPrint (eLogWarning, "NTCP: ", addr, " is banned for ", it->second - ts, " more seconds");
+				return true;
+			}
+			else
+				m_BanList.erase (it);
+		}
+		return false;
+	}
+
 	void NTCPServer::Ban (const boost::asio::ip::address& addr)
 	{
 		uint32_t ts = i2p::util::GetSecondsSinceEpoch ();	
+		std::unique_lock<std::mutex> l(m_BanListMutex);
 		m_BanList[addr] = ts + NTCP_BAN_EXPIRATION_TIMEOUT;
 		LogPrint (eLogWarning, "NTCP: ", addr, " has been banned for ", NTCP_BAN_EXPIRATION_TIMEOUT, " seconds");
 	}
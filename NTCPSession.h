@@ -12,6 +12,8 @@
 #include "RouterInfo.h"
 #include "I2NPProtocol.h"
 #include "TransportSession.h"
+#include "TimerWheel.h"
+#include "util.h"
 
 namespace i2p
 {
@@ -36,6 +38,7 @@ namespace transport
 
 	const size_t NTCP_MAX_MESSAGE_SIZE = 16384; 
 	const size_t NTCP_BUFFER_SIZE = 4160; // fits 4 tunnel messages (4*1028)
+	const size_t NTCP_MAX_SEND_BUFFER_SIZE = 65536; // messages written at once, at least one
 	const int NTCP_TERMINATION_TIMEOUT = 120; // 2 minutes
 	const size_t NTCP_DEFAULT_PHASE3_SIZE = 2/*size*/ + i2p::data::DEFAULT_IDENTITY_SIZE/*387*/ + 4/*ts*/ + 15/*padding*/ + 40/*signature*/; // 448 	
 	const int NTCP_BAN_EXPIRATION_TIMEOUT = 70; // in second
@@ -51,6 +54,7 @@ namespace transport
 			void Done ();
 
 			boost::asio::ip::tcp::socket& GetSocket () { return m_Socket; };
+			boost::asio::io_service& GetService () { return m_Service; };
 			bool IsEstablished () const { return m_IsEstablished; };
 			
 			void ClientLogin ();
@@ -89,9 +93,10 @@ namespace transport
 			bool DecryptNextBlock (const uint8_t * encrypted);	
 		
 			void Send (std::shared_ptr<i2p::I2NPMessage> msg);
-			boost::asio::const_buffers_1 CreateMsgBuffer (std::shared_ptr<I2NPMessage> msg);
-			void Send (const std::vector<std::shared_ptr<I2NPMessage> >& msgs);
-			void HandleSent (const boost::system::error_code& ecode, std::size_t bytes_transferred, std::vector<std::shared_ptr<I2NPMessage> > msgs);
+			size_t GetMsgBufferLength (std::shared_ptr<I2NPMessage> msg) const;
+			size_t CreateMsgBuffer (std::shared_ptr<I2NPMessage> msg, uint8_t * sendBuffer); // returns length
+			void SendQueuedMessages ();
+			void HandleSent (const boost::system::error_code& ecode, std::size_t bytes_transferred);
 			
 			
 			// timer
@@ -101,8 +106,9 @@ namespace transport
 		private:
 
 			NTCPServer& m_Server;
+			boost::asio::io_service& m_Service;
 			boost::asio::ip::tcp::socket m_Socket;
-			boost::asio::deadline_timer m_TerminationTimer;
+			i2p::util::WheelTimer m_TerminationTimer;
 			bool m_IsEstablished, m_IsTerminated;
 			
 			i2p::crypto::CBCDecryption m_Decryption;
@@ -115,7 +121,6 @@ namespace transport
 			} * m_Establisher;	
 			
 			i2p::crypto::AESAlignedBuffer<NTCP_BUFFER_SIZE + 16> m_ReceiveBuffer;
-			i2p::crypto::AESAlignedBuffer<16> m_TimeSyncBuffer;
 			int m_ReceiveBufferOffset; 
 
 			std::shared_ptr<I2NPMessage> m_NextMessage;
@@ -124,6 +129,7 @@ namespace transport
 
 			bool m_IsSending;
 			std::vector<std::shared_ptr<I2NPMessage> > m_SendQueue;
+			std::vector<uint8_t> m_SendBuffer; // framed and encrypted messages being sent, reused
 			
 			boost::asio::ip::address m_ConnectedFrom; // for ban
 	};	
@@ -133,7 +139,7 @@ namespace transport
 	{
 		public:
 
-			NTCPServer (int port);
+			NTCPServer (int port, int numThreads = 1);
 			~NTCPServer ();
 
 			void Start ();
@@ -144,12 +150,12 @@ namespace transport
 			std::shared_ptr<NTCPSession> FindNTCPSession (const i2p::data::IdentHash& ident);
 			void Connect (const boost::asio::ip::address& address, int port, std::shared_ptr<NTCPSession> conn);
 			
-			boost::asio::io_service& GetService () { return m_Service; };
+			boost::asio::io_service& GetNextService () { return m_Services.GetNextService (); }; // for new session
 			void Ban (const boost::asio::ip::address& addr);			
 
 		private:
 
-			void Run ();
+			bool IsBanned (const boost::asio::ip::address& addr);
 			void HandleAccept (std::shared_ptr<NTCPSession> conn, const boost::system::error_code& error);
 			void HandleAcceptV6 (std::shared_ptr<NTCPSession> conn, const boost::system::error_code& error);
 
@@ -158,17 +164,18 @@ namespace transport
 		private:	
 
 			bool m_IsRunning;
-			std::thread * m_Thread;	
-			boost::asio::io_service m_Service;
-			boost::asio::io_service::work m_Work;
+			i2p::util::ServicePool m_Services; // acceptors run on first one
 			boost::asio::ip::tcp::acceptor * m_NTCPAcceptor, * m_NTCPV6Acceptor;
-			std::map<i2p::data::IdentHash, std::shared_ptr<NTCPSession> > m_NTCPSessions; // access from m_Thread only
+			mutable std::mutex m_NTCPSessionsMutex;
+			std::map<i2p::data::IdentHash, std::shared_ptr<NTCPSession> > m_NTCPSessions;
+			std::mutex m_BanListMutex;
 			std::map<boost::asio::ip::address, uint32_t> m_BanList; // IP -> ban expiration time in seconds
 
 		public:
 
 			// for HTTP/I2PControl
 			const decltype(m_NTCPSessions)& GetNTCPSessions () const { return m_NTCPSessions; };
+			std::mutex& GetNTCPSessionsMutex () const { return m_NTCPSessionsMutex; };
 	};	
 }	
 }	
@@ -25,7 +25,9 @@ namespace data
 	const char NetDb::m_NetDbPath[] = "netDb";
 	NetDb netdb;
 
-	NetDb::NetDb (): m_IsRunning (false), m_Thread (nullptr), m_Reseeder (nullptr)
+	NetDb::NetDb (): m_IsRunning (false), m_Thread (nullptr), m_IsLoading (false), 
+		m_NextChunkToLoad (0), m_NumRoutersLoaded (0), m_NumRoutersToLoad (0), m_LoadStartTime (0), 
+		m_Store (nullptr), m_Reseeder (nullptr)
 	{
 	}
 	
@@ -35,11 +37,16 @@ namespace data
 		delete m_Reseeder;
 	}	
 
-	void NetDb::Start ()
+	void NetDb::Start (int numLoadThreads, int readyPercent, bool usePackedStore)
 	{	
-		Load ();
-		if (m_RouterInfos.size () < 25) // reseed if # of router less than 50
-			Reseed ();
+		Load (numLoadThreads, usePackedStore);
+		WaitForLoad (readyPercent);
+		if (GetNumRouters () < 25) 
+		{
+			WaitForLoad (100); // rest might be enough
+			if (GetNumRouters () < 25) // reseed if # of router less than 50
+				Reseed ();
+		}
 
 		m_IsRunning = true;
 		m_Thread = new std::thread (std::bind (&NetDb::Run, this));
@@ -47,6 +54,8 @@ namespace data
 	
 	void NetDb::Stop ()
 	{
+		m_IsLoading = false; // abort loading if still in progress
+		FinishLoad ();
 		if (m_IsRunning)
 		{	
 			for (auto it: m_RouterInfos)
@@ -54,6 +63,7 @@ namespace data
 			DeleteObsoleteProfiles ();
 			m_RouterInfos.clear ();
 			m_Floodfills.clear ();
+			m_RandomRouters.Clear ();
 			if (m_Thread)
 			{	
 				m_IsRunning = false;
@@ -65,6 +75,8 @@ namespace data
 			m_LeaseSets.clear();
 			m_Requests.Stop ();
 		}	
+		delete m_Store;
+		m_Store = nullptr;
 	}	
 	
 	void NetDb::Run ()
@@ -102,6 +114,8 @@ namespace data
 					}	
 				}			
 				if (!m_IsRunning) break;
+				if (m_IsLoading && m_NumRoutersLoaded >= m_NumRoutersToLoad)
+					FinishLoad ();
 
 				uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
 				if (ts - lastManageRequest >= 15) // manage requests every 15 seconds
@@ -111,7 +125,7 @@ namespace data
 				}	
 				if (ts - lastSave >= 60) // save routers, manage leasesets and validate subscriptions every minute
 				{
-					if (lastSave)
+					if (lastSave && !m_IsLoading) // can't iterate routers while loading
 					{
 						SaveUpdated ();
 						ManageLeaseSets ();
@@ -164,7 +178,10 @@ namespace data
 			auto ts = r->GetTimestamp ();
 			r->Update (buf, len);
 			if (r->GetTimestamp () > ts)
+			{	
 				LogPrint (eLogInfo, "NetDb: RouterInfo updated: ", ident.ToBase64());
+				m_RandomRouters.Update (r); // caps or addresses might change
+			}	
 		}	
 		else	
 		{	
@@ -176,10 +193,11 @@ namespace data
 					std::unique_lock<std::mutex> l(m_RouterInfosMutex);
 					m_RouterInfos[r->GetIdentHash ()] = r;
 				}
+				m_RandomRouters.Add (r);
 				if (r->IsFloodfill ())
 				{
 					std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-					m_Floodfills.push_back (r);
+					m_Floodfills[r->GetIdentHash ()] = r;
 				}
 			}	
 		}	
@@ -245,9 +263,9 @@ namespace data
 	
 	void NetDb::SetUnreachable (const IdentHash& ident, bool unreachable)
 	{
-		auto it = m_RouterInfos.find (ident);
-		if (it != m_RouterInfos.end ())
-			return it->second->SetUnreachable (unreachable);
+		auto r = FindRouter (ident);
+		if (r)
+			return r->SetUnreachable (unreachable);
 	}
 
 	// TODO: Move to reseed and/or scheduled tasks. (In java version, scheduler fix this as well as sort RIs.)
@@ -288,7 +306,7 @@ namespace data
 			LogPrint (eLogWarning, "NetDb: failed to reseed after 10 attempts");
 	}
 
-	void NetDb::Load ()
+	void NetDb::Load (int numThreads, bool usePackedStore)
 	{
 		boost::filesystem::path p(i2p::util::filesystem::GetDataDir() / m_NetDbPath);
 		if (!boost::filesystem::exists (p))
@@ -299,41 +317,175 @@ namespace data
 		// make sure we cleanup netDb from previous attempts
 		m_RouterInfos.clear ();	
 		m_Floodfills.clear ();	
+		m_RandomRouters.Clear ();
 
-		// load routers now
-		uint64_t ts = i2p::util::GetMillisecondsSinceEpoch ();	
-		int numRouters = 0;
+		// list files first, it's fast. Parsing and signature verification are done by load threads
+		m_FilesToLoad.clear ();
+		m_RecordsToLoad.clear ();
+		m_NumRoutersToLoad = 0;
 		boost::filesystem::directory_iterator end;
 		for (boost::filesystem::directory_iterator it (p); it != end; ++it)
 		{
 			if (boost::filesystem::is_directory (it->status()))
 			{
+				std::vector<std::string> files;
 				for (boost::filesystem::directory_iterator it1 (it->path ()); it1 != end; ++it1)
 				{
 #if BOOST_VERSION > 10500
-					const std::string& fullPath = it1->path().string();
+					files.push_back (it1->path().string());
 #else
-					const std::string& fullPath = it1->path();
+					files.push_back (it1->path());
 #endif
+				}	
+				m_NumRoutersToLoad += files.size ();
+				m_FilesToLoad.push_back (std::move (files));
+			}	
+		}
+
+		if (usePackedStore)
+		{
+			m_Store = new NetDbStore ((p / NETDB_STORE_FILE_NAME).string ());
+			if (m_Store->Open ())
+			{
+				if (m_NumRoutersToLoad > 0)
+				{
+					// files left from previous runs without store
+					std::vector<std::string> files;
+					for (auto& it: m_FilesToLoad)
+						files.insert (files.end (), it.begin (), it.end ());
+					m_Store->Import (files);
+					m_FilesToLoad.clear ();
+					m_NumRoutersToLoad = 0;
+				}
+				auto records = m_Store->GetRecords ();
+				m_NumRoutersToLoad = records.size ();
+				for (size_t i = 0; i < records.size (); i += NETDB_STORE_LOAD_CHUNK_SIZE)
+					m_RecordsToLoad.push_back (std::vector<NetDbStore::Record>(records.begin () + i, 
+						records.begin () + std::min (i + NETDB_STORE_LOAD_CHUNK_SIZE, records.size ())));
+			}
+			else
+			{
+				LogPrint (eLogError, "NetDb: can't open packed store, using files");
+				delete m_Store;
+				m_Store = nullptr;
+			}
+		}
+		
+		// load routers now
+		m_LoadStartTime = i2p::util::GetMillisecondsSinceEpoch ();
+		m_NextChunkToLoad = 0;
+		m_NumRoutersLoaded = 0;
+		m_IsLoading = true;
+		int numChunks = m_FilesToLoad.size () + m_RecordsToLoad.size ();
+		if (numThreads < 1) numThreads = 1;
+		if (numThreads > NETDB_MAX_NUM_LOAD_THREADS) numThreads = NETDB_MAX_NUM_LOAD_THREADS;
+		if (numThreads > numChunks) numThreads = numChunks;
+		std::unique_lock<std::mutex> l(m_LoadMutex);
+		for (int i = 0; i < numThreads; i++)
+			m_LoadThreads.push_back (new std::thread (std::bind (&NetDb::LoadRouters, this)));
+		LogPrint (eLogInfo, "NetDb: loading ", m_NumRoutersToLoad, " routers in ", numThreads, " threads");
+	}	
+
+	void NetDb::LoadRouters ()
+	{
+		uint64_t ts = m_LoadStartTime;
+		auto isExpired = [ts](std::shared_ptr<RouterInfo> r)
+		{
+			return r->IsUnreachable () || (r->UsesIntroducer () && ts >= r->GetTimestamp () + 3600*1000LL); // 1 hour
+		};
+		std::vector<std::shared_ptr<RouterInfo> > routers;
+		size_t ind, numChunks = m_FilesToLoad.size () + m_RecordsToLoad.size (), num;
+		while (m_IsLoading && (ind = m_NextChunkToLoad++) < numChunks)
+		{
+			routers.clear ();
+			if (ind < m_FilesToLoad.size ())
+			{
+				auto& files = m_FilesToLoad[ind];
+				for (auto& fullPath: files)
+				{	
 					auto r = std::make_shared<RouterInfo>(fullPath);
-					if (!r->IsUnreachable () && (!r->UsesIntroducer () || ts < r->GetTimestamp () + 3600*1000LL)) // 1 hour
-					{	
-						r->DeleteBuffer ();
-						r->ClearProperties (); // properties are not used for regular routers
-						m_RouterInfos[r->GetIdentHash ()] = r;
-						if (r->IsFloodfill ())
-							m_Floodfills.push_back (r);
-						numRouters++;
-					}	
+					if (!isExpired (r))
+						routers.push_back (r);
 					else
 					{	
 						if (boost::filesystem::exists (fullPath))  
 							boost::filesystem::remove (fullPath);
 					}	
 				}	
-			}	
+				num = files.size ();
+			}
+			else
+			{
+				auto& records = m_RecordsToLoad[ind - m_FilesToLoad.size ()];
+				for (auto& it: records)
+				{
+					auto r = std::make_shared<RouterInfo>(it.buf, it.len, false); // verified when received or imported
+					r->SetUpdated (false);
+					if (!isExpired (r) && r->GetIdentHash () == it.ident)
+						routers.push_back (r);
+					else
+						m_Store->Remove (it.ident);
+				}
+				num = records.size ();
+			}
+			for (auto& r: routers)
+			{
+				r->DeleteBuffer ();
+				r->ClearProperties (); // properties are not used for regular routers
+			}
+			// insert whole chunk at once
+			{
+				std::unique_lock<std::mutex> l(m_RouterInfosMutex);
+				for (auto& r: routers)
+					if (!m_RouterInfos.insert (std::make_pair (r->GetIdentHash (), r)).second)
+						r = nullptr; // already received from network, keep it
+			}
+			{
+				std::unique_lock<std::mutex> l(m_FloodfillsMutex);
+				for (auto& r: routers)
+					if (r && r->IsFloodfill ())
+						m_Floodfills[r->GetIdentHash ()] = r;
+			}
+			for (auto& r: routers)
+				if (r) m_RandomRouters.Add (r);
+			std::unique_lock<std::mutex> l(m_LoadMutex);
+			m_NumRoutersLoaded += num;
+			m_Loaded.notify_all ();
 		}
-		LogPrint (eLogInfo, "NetDb: ", numRouters, " routers loaded (", m_Floodfills.size (), " floodfils)");
+	}
+
+	void NetDb::WaitForLoad (int percent)
+	{
+		std::unique_lock<std::mutex> l(m_LoadMutex);
+		m_Loaded.wait (l, [this, percent]() 
+			{ 
+				return !m_IsLoading || m_NumRoutersLoaded*100 >= m_NumRoutersToLoad*percent; 
+			});
+	}
+
+	void NetDb::FinishLoad ()
+	{
+		std::vector<std::thread *> threads;
+		{
+			std::unique_lock<std::mutex> l(m_LoadMutex);
+			threads.swap (m_LoadThreads);
+		}
+		if (threads.empty ()) 
+		{
+			m_IsLoading = false; // nothing to load or finished already
+			return;
+		}
+		for (auto it: threads)
+		{
+			it->join ();
+			delete it;
+		}	
+		m_IsLoading = false;
+		m_FilesToLoad.clear ();
+		m_RecordsToLoad.clear (); // points to store's mapped file
+		if (m_Store) m_Store->Flush (); // removed expired
+		LogPrint (eLogInfo, "NetDb: ", m_RouterInfos.size (), " routers loaded (", m_Floodfills.size (), " floodfils) in ", 
+			i2p::util::GetMillisecondsSinceEpoch () - m_LoadStartTime, " ms");
 	}	
 
 	void NetDb::SaveUpdated ()
@@ -352,8 +504,13 @@ namespace data
 		{	
 			if (it.second->IsUpdated ())
 			{
-				std::string f = GetFilePath(fullDirectory, it.second.get()).string();
-				it.second->SaveToFile (f);
+				if (m_Store)
+					m_Store->Put (it.first, it.second->GetBuffer (), it.second->GetBufferLen ());
+				else
+				{	
+					std::string f = GetFilePath(fullDirectory, it.second.get()).string();
+					it.second->SaveToFile (f);
+				}
 				it.second->SetUpdated (false);
 				it.second->SetUnreachable (false);
 				it.second->DeleteBuffer ();
@@ -396,7 +553,12 @@ namespace data
 				{	
 					total--;
 					// delete RI file
-					if (boost::filesystem::exists (GetFilePath (fullDirectory, it.second.get ())))
+					if (m_Store)
+					{
+						m_Store->Remove (it.first);
+						deletedCount++;
+					}	
+					else if (boost::filesystem::exists (GetFilePath (fullDirectory, it.second.get ())))
 					{    
 						boost::filesystem::remove (GetFilePath (fullDirectory, it.second.get ()));
 						deletedCount++;
@@ -405,11 +567,17 @@ namespace data
 					if (it.second->IsFloodfill ())
 					{
 						std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-						m_Floodfills.remove (it.second);
+						m_Floodfills.erase (it.first);
 					}
 				}
 			}	
 		}	
+		if (m_Store)
+		{
+			m_Store->Flush ();
+			if (m_Store->NeedsCompaction ())
+				m_Store->Compact ();
+		}	
 		if (count > 0)
 			LogPrint (eLogInfo, "NetDb: ", count, " new/updated routers saved");
 		if (deletedCount > 0)
@@ -422,6 +590,7 @@ namespace data
 				if (it->second->IsUnreachable ())
 				{	
 					it->second->SaveProfile ();
+					m_RandomRouters.Remove (it->first);
 					it = m_RouterInfos.erase (it);
 				}	
 				else
@@ -677,7 +846,12 @@ namespace data
 				if (router)
 				{
 					LogPrint (eLogDebug, "NetDb: requested RouterInfo ", key, " found");
-					router->LoadBuffer ();
+					if (m_Store)
+					{	
+						if (!router->GetBuffer ()) m_Store->LoadBuffer (*router);
+					}	
+					else
+						router->LoadBuffer ();
 					if (router->GetBuffer ()) 
 						replyMsg = CreateDatabaseStoreMsg (router);
 				}
@@ -807,77 +981,50 @@ namespace data
 
 	std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter () const
 	{
-		return GetRandomRouter (
-			[](std::shared_ptr<const RouterInfo> router)->bool 
+		return m_RandomRouters.GetRandomRouter (RandomRouterIndex::eAll, 0,
+			[](std::shared_ptr<const RouterInfo>)->bool 
 			{ 
-				return !router->IsHidden (); 
+				return true; // hidden are not indexed
 			});
 	}	
 	
 	std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter (std::shared_ptr<const RouterInfo> compatibleWith) const
 	{
-		return GetRandomRouter (
+		return m_RandomRouters.GetRandomRouter (RandomRouterIndex::eAll, compatibleWith->GetSupportedTransports (),
 			[compatibleWith](std::shared_ptr<const RouterInfo> router)->bool 
 			{ 
-				return !router->IsHidden () && router != compatibleWith && 
-					router->IsCompatible (*compatibleWith); 
+				return router != compatibleWith && router->IsCompatible (*compatibleWith); 
 			});
 	}	
 
 	std::shared_ptr<const RouterInfo> NetDb::GetRandomPeerTestRouter () const
 	{
-		return GetRandomRouter (
+		return m_RandomRouters.GetRandomRouter (RandomRouterIndex::ePeerTesting, 0,
 			[](std::shared_ptr<const RouterInfo> router)->bool 
 			{ 
-				return !router->IsHidden () && router->IsPeerTesting (); 
+				return router->IsPeerTesting (); 
 			});
 	}
 
 	std::shared_ptr<const RouterInfo> NetDb::GetRandomIntroducer () const
 	{
-		return GetRandomRouter (
+		return m_RandomRouters.GetRandomRouter (RandomRouterIndex::eIntroducer, 0,
 			[](std::shared_ptr<const RouterInfo> router)->bool 
 			{ 
-				return !router->IsHidden () && router->IsIntroducer (); 
+				return router->IsIntroducer (); 
 			});
 	}	
 	
 	std::shared_ptr<const RouterInfo> NetDb::GetHighBandwidthRandomRouter (std::shared_ptr<const RouterInfo> compatibleWith) const
 	{
-		return GetRandomRouter (
+		return m_RandomRouters.GetRandomRouter (RandomRouterIndex::eHighBandwidth, compatibleWith->GetSupportedTransports (),
 			[compatibleWith](std::shared_ptr<const RouterInfo> router)->bool 
 			{ 
-				return !router->IsHidden () && router != compatibleWith &&
-					router->IsCompatible (*compatibleWith) && 
-					(router->GetCaps () & RouterInfo::eHighBandwidth);
+				return router != compatibleWith && router->IsCompatible (*compatibleWith) && 
+					router->IsHighBandwidth ();
 			});
 	}	
 	
-	template<typename Filter>
-	std::shared_ptr<const RouterInfo> NetDb::GetRandomRouter (Filter filter) const
-	{
-		if (!m_RouterInfos.size ()) return 0;
-		uint32_t ind = rand () % m_RouterInfos.size ();	
-		for (int j = 0; j < 2; j++)
-		{	
-			uint32_t i = 0;
-			std::unique_lock<std::mutex> l(m_RouterInfosMutex);
-			for (auto it: m_RouterInfos)
-			{	
-				if (i >= ind)
-				{	
-					if (!it.second->IsUnreachable () && filter (it.second))
-						return it.second;
-				}	
-				else 
-					i++;
-			}
-			// we couldn't find anything, try second pass
-			ind = 0;
-		}	
-		return nullptr; // seems we have too few routers
-	}	
-	
 	void NetDb::PostI2NPMsg (std::shared_ptr<const I2NPMessage> msg)
 	{
 		if (msg) m_Queue.Put (msg);	
@@ -887,71 +1034,32 @@ namespace data
 		const std::set<IdentHash>& excluded) const
 	{
 		std::shared_ptr<const RouterInfo> r;
-		XORMetric minMetric;
 		IdentHash destKey = CreateRoutingKey (destination);
-		minMetric.SetMax ();
 		std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-		for (auto it: m_Floodfills)
-		{	
-			if (!it->IsUnreachable ())
-			{	
-				XORMetric m = destKey ^ it->GetIdentHash ();
-				if (m < minMetric && !excluded.count (it->GetIdentHash ()))
-				{
-					minMetric = m;
-					r = it;
-				}
-			}	
-		}	
+		VisitClosestRouters (m_Floodfills, destKey, 
+			[&r, &excluded](const std::pair<const IdentHash, std::shared_ptr<RouterInfo> >& it)->bool
+			{
+				if (it.second->IsUnreachable () || excluded.count (it.first)) return true; // next
+				r = it.second;
+				return false;
+			});
 		return r;
 	}	
 
 	std::vector<IdentHash> NetDb::GetClosestFloodfills (const IdentHash& destination, size_t num,
 		std::set<IdentHash>& excluded) const
 	{
-		struct Sorted
-		{
-			std::shared_ptr<const RouterInfo> r;
-			XORMetric metric;
-			bool operator< (const Sorted& other) const { return metric < other.metric; };
-		};
-
-		std::set<Sorted> sorted;
-		IdentHash destKey = CreateRoutingKey (destination);
-		{
-			std::unique_lock<std::mutex> l(m_FloodfillsMutex);
-			for (auto it: m_Floodfills)
-			{
-				if (!it->IsUnreachable ())
-				{	
-					XORMetric m = destKey ^ it->GetIdentHash ();
-					if (sorted.size () < num)
-						sorted.insert ({it, m});
-					else if (m < sorted.rbegin ()->metric)
-					{
-						sorted.insert ({it, m});
-						sorted.erase (std::prev (sorted.end ()));
-					}
-				}
-			}
-		}
-
 		std::vector<IdentHash> res;	
-		size_t i = 0;			
-		for (auto it: sorted)
-		{
-			if (i < num)
+		if (!num) return res;
+		IdentHash destKey = CreateRoutingKey (destination);
+		std::unique_lock<std::mutex> l(m_FloodfillsMutex);
+		VisitClosestRouters (m_Floodfills, destKey, 
+			[&res, &excluded, num](const std::pair<const IdentHash, std::shared_ptr<RouterInfo> >& it)->bool
 			{
-				auto& ident = it.r->GetIdentHash ();
-				if (!excluded.count (ident))
-				{	
-					res.push_back (ident);
-					i++;
-				}
-			}
-			else
-				break;
-		}	
+				if (!it.second->IsUnreachable () && !excluded.count (it.first)) 
+					res.push_back (it.first);
+				return res.size () < num;
+			});
 		return res;
 	}
 
@@ -959,22 +1067,16 @@ namespace data
 		const std::set<IdentHash>& excluded) const
 	{
 		std::shared_ptr<const RouterInfo> r;
-		XORMetric minMetric;
 		IdentHash destKey = CreateRoutingKey (destination);
-		minMetric.SetMax ();
 		// must be called from NetDb thread only
-		for (auto it: m_RouterInfos)
-		{	
-			if (!it.second->IsFloodfill ())
-			{	
-				XORMetric m = destKey ^ it.first;
-				if (m < minMetric && !excluded.count (it.first))
-				{
-					minMetric = m;
-					r = it.second;
-				}
-			}	
-		}	
+		std::unique_lock<std::mutex> l(m_RouterInfosMutex); // routers might still be loading
+		VisitClosestRouters (m_RouterInfos, destKey, 
+			[&r, &excluded](const std::pair<const IdentHash, std::shared_ptr<RouterInfo> >& it)->bool
+			{
+				if (it.second->IsFloodfill () || excluded.count (it.first)) return true; // next
+				r = it.second;
+				return false;
+			});
 		return r;
 	}	
 	
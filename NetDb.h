@@ -8,6 +8,8 @@
 #include <string>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include <boost/filesystem.hpp>
 #include "Base.h"
 #include "Queue.h"
@@ -18,12 +20,18 @@
 #include "TunnelPool.h"
 #include "Reseed.h"
 #include "NetDbRequests.h"
+#include "NetDbStore.h"
+#include "NetDbIndex.h"
 
 namespace i2p
 {
 namespace data
 {		
 	
+	const int NETDB_MAX_NUM_LOAD_THREADS = 16;
+	const char NETDB_STORE_FILE_NAME[] = "routerInfos.pack";
+	const size_t NETDB_STORE_LOAD_CHUNK_SIZE = 256; // routers
+
 	class NetDb
 	{
 		public:
@@ -31,7 +39,7 @@ namespace data
 			NetDb ();
 			~NetDb ();
 
-			void Start ();
+			void Start (int numLoadThreads = 1, int readyPercent = 100, bool usePackedStore = false); // returns once readyPercent of stored routers are loaded
 			void Stop ();
 			
 			void AddRouterInfo (const uint8_t * buf, int len);
@@ -70,7 +78,10 @@ namespace data
 		private:
 
 			bool CreateNetDb(boost::filesystem::path directory);
-			void Load ();
+			void Load (int numThreads, bool usePackedStore);
+			void LoadRouters (); // load thread
+			void WaitForLoad (int percent);
+			void FinishLoad ();
 			void SaveUpdated ();
 			void Run (); // exploratory thread
 			void Explore (int numDestinations);	
@@ -78,8 +89,6 @@ namespace data
 			void ManageLeaseSets ();
 			void ManageRequests ();
 
-			template<typename Filter>
-			std::shared_ptr<const RouterInfo> GetRandomRouter (Filter filter) const;	
 		
 		private:
 
@@ -87,11 +96,24 @@ namespace data
 			mutable std::mutex m_RouterInfosMutex;
 			std::map<IdentHash, std::shared_ptr<RouterInfo> > m_RouterInfos;
 			mutable std::mutex m_FloodfillsMutex;
-			std::list<std::shared_ptr<RouterInfo> > m_Floodfills;
+			std::map<IdentHash, std::shared_ptr<RouterInfo> > m_Floodfills; // sorted for closest lookups
+			RandomRouterIndex m_RandomRouters;
 			
 			bool m_IsRunning;
 			std::thread * m_Thread;	
-			i2p::util::Queue<std::shared_ptr<const I2NPMessage> > m_Queue; // of I2NPDatabaseStoreMsg
+			i2p::util::LockFreeQueue<std::shared_ptr<const I2NPMessage> > m_Queue; // of I2NPDatabaseStoreMsg
+
+			std::atomic<bool> m_IsLoading;
+			std::vector<std::thread *> m_LoadThreads;
+			std::vector<std::vector<std::string> > m_FilesToLoad; // per r? directory
+			std::vector<std::vector<NetDbStore::Record> > m_RecordsToLoad; // chunks of packed store
+			std::atomic<size_t> m_NextChunkToLoad, m_NumRoutersLoaded;
+			size_t m_NumRoutersToLoad;
+			uint64_t m_LoadStartTime;
+			std::mutex m_LoadMutex;
+			std::condition_variable m_Loaded;
+
+			NetDbStore * m_Store; // nullptr if routers are stored in files
 
 			GzipInflator m_Inflator;
 			Reseeder * m_Reseeder;
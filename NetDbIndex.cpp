@@ -0,0 +1,107 @@
+#include "NetDbIndex.h"
+
+namespace i2p
+{
+namespace data
+{
+	RandomRouterIndex::Snapshot::Snapshot ()
+	{
+		std::shared_ptr<const Bucket> empty = std::make_shared<Bucket> ();
+		for (auto& it: buckets)
+			for (auto& bucket: it)
+				bucket = empty;
+	}
+
+	RandomRouterIndex::RandomRouterIndex ():
+		m_Snapshot (std::make_shared<Snapshot> ())
+	{
+	}
+
+	void RandomRouterIndex::Add (std::shared_ptr<RouterInfo> r)
+	{
+		if (r->IsHidden ()) return;
+		bool categories[eNumCategories] =
+		{
+			true,
+			r->IsHighBandwidth (),
+			r->IsFloodfill (),
+			r->IsIntroducer (),
+			r->IsPeerTesting ()
+		};
+		Entry entry;
+		entry.transports = r->GetSupportedTransports () % RANDOM_ROUTER_INDEX_NUM_TRANSPORTS_SETS;
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (m_Entries.count (r->GetIdentHash ())) return; // already added
+		// copy affected buckets only, others are shared with current snapshot
+		auto snapshot = std::make_shared<Snapshot> (*m_Snapshot);
+		for (int i = 0; i < eNumCategories; i++)
+		{
+			if (categories[i])
+			{
+				auto bucket = std::make_shared<Bucket> (*snapshot->buckets[i][entry.transports]);
+				entry.positions[i] = bucket->size ();
+				bucket->push_back (r);
+				snapshot->buckets[i][entry.transports] = bucket;
+			}
+			else
+				entry.positions[i] = -1;
+		}
+		m_Entries[r->GetIdentHash ()] = entry;
+		Publish (snapshot);
+	}
+
+	void RandomRouterIndex::Remove (const IdentHash& ident)
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		auto it = m_Entries.find (ident);
+		if (it == m_Entries.end ()) return;
+		auto& entry = it->second;
+		auto snapshot = std::make_shared<Snapshot> (*m_Snapshot);
+		for (int i = 0; i < eNumCategories; i++)
+		{
+			int pos = entry.positions[i];
+			if (pos < 0) continue;
+			// move last one to the place of removed
+			auto bucket = std::make_shared<Bucket> (*snapshot->buckets[i][entry.transports]);
+			if (pos + 1 < (int)bucket->size ())
+			{
+				(*bucket)[pos] = bucket->back ();
+				m_Entries[(*bucket)[pos]->GetIdentHash ()].positions[i] = pos;
+			}
+			bucket->pop_back ();
+			snapshot->buckets[i][entry.transports] = bucket;
+		}
+		m_Entries.erase (it);
+		Publish (snapshot);
+	}
+
+	void RandomRouterIndex::Clear ()
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		m_Entries.clear ();
+		Publish (std::make_shared<Snapshot> ());
+	}
+
+	size_t RandomRouterIndex::GetSize (Category category) const
+	{
+		auto snapshot = GetSnapshot ();
+		size_t size = 0;
+		for (auto& bucket: snapshot->buckets[category])
+			size += bucket->size ();
+		return size;
+	}
+
+	std::shared_ptr<const RandomRouterIndex::Snapshot> RandomRouterIndex::GetSnapshot () const
+	{
+		std::unique_lock<std::mutex> l(m_SnapshotMutex);
+		return m_Snapshot;
+	}
+
+	void RandomRouterIndex::Publish (std::shared_ptr<const Snapshot> snapshot)
+	{
+		std::unique_lock<std::mutex> l(m_SnapshotMutex);
+		m_Snapshot.swap (snapshot);
+		// previous one is released when parameter is destroyed, after the lock
+	}
+}
+}
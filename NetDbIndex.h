@@ -0,0 +1,144 @@
+#ifndef NETDB_INDEX_H__
+#define NETDB_INDEX_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <iterator>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+#include "Identity.h"
+#include "RouterInfo.h"
+
+namespace i2p
+{
+namespace data
+{
+	// Visits routers of std::map sorted by ident in order of XOR distance of ident to key,
+	// until visitor returns false. Routers under common prefix form contiguous range of map,
+	// so it's descent of binary trie with lower_bound for every split.
+	template<typename Routers, typename Visitor>
+	bool VisitClosestRouters (const Routers& routers, typename Routers::const_iterator begin,
+		typename Routers::const_iterator end, const IdentHash& key, int bit, Visitor& visitor)
+	{
+		if (begin == end) return true;
+		if (bit >= 256 || std::next (begin) == end)
+		{
+			for (auto it = begin; it != end; ++it)
+				if (!visitor (*it)) return false;
+			return true;
+		}
+		// first router with this bit set. All routers of the range have same bits before it
+		IdentHash split (begin->first);
+		int byte = bit >> 3;
+		uint8_t mask = 0x80 >> (bit & 0x07);
+		split[byte] = (split[byte] & ~(mask | (mask - 1))) | mask;
+		memset (split + byte + 1, 0, 31 - byte);
+		auto mid = routers.lower_bound (split);
+		if (key[byte] & mask)
+			return VisitClosestRouters (routers, mid, end, key, bit + 1, visitor) &&
+				VisitClosestRouters (routers, begin, mid, key, bit + 1, visitor);
+		else
+			return VisitClosestRouters (routers, begin, mid, key, bit + 1, visitor) &&
+				VisitClosestRouters (routers, mid, end, key, bit + 1, visitor);
+	}
+
+	template<typename Routers, typename Visitor>
+	void VisitClosestRouters (const Routers& routers, const IdentHash& key, Visitor visitor)
+	{
+		VisitClosestRouters (routers, routers.begin (), routers.end (), key, 0, visitor);
+	}
+
+	const int RANDOM_ROUTER_INDEX_NUM_TRANSPORTS_SETS = 16; // all combinations of RouterInfo::SupportedTranports
+	const int RANDOM_ROUTER_INDEX_MAX_ATTEMPTS = 16; // before checking all candidates
+	// Routers by capability and set of supported transports, for uniform random selection in O(1).
+	// Hidden routers are not included. Must be updated if router's caps or addresses change.
+	// Readers pick from immutable snapshot of buckets, writers build new one and swap it, 
+	// so lookups never wait for updates
+	class RandomRouterIndex
+	{
+		public:
+
+			enum Category
+			{
+				eAll = 0,
+				eHighBandwidth,
+				eFloodfill,
+				eIntroducer,
+				ePeerTesting,
+				eNumCategories
+			};
+
+			RandomRouterIndex ();
+
+			void Add (std::shared_ptr<RouterInfo> r);
+			void Remove (const IdentHash& ident);
+			void Update (std::shared_ptr<RouterInfo> r) { Remove (r->GetIdentHash ()); Add (r); };
+			void Clear ();
+			size_t GetSize (Category category) const;
+
+			// transports is mask of SupportedTranports at least one of them router must support, 0 for any
+			template<typename Filter>
+			std::shared_ptr<const RouterInfo> GetRandomRouter (Category category, uint8_t transports, Filter filter) const
+			{
+				auto snapshot = GetSnapshot ();
+				auto& buckets = snapshot->buckets[category];
+				size_t total = 0;
+				for (int t = 0; t < RANDOM_ROUTER_INDEX_NUM_TRANSPORTS_SETS; t++)
+					if (!transports || (t & transports)) total += buckets[t]->size ();
+				if (!total) return nullptr;
+				for (int i = 0; i < RANDOM_ROUTER_INDEX_MAX_ATTEMPTS; i++)
+				{
+					std::shared_ptr<const RouterInfo> r;
+					size_t ind = rand () % total;
+					for (int t = 0; t < RANDOM_ROUTER_INDEX_NUM_TRANSPORTS_SETS; t++)
+					{
+						if (transports && !(t & transports)) continue;
+						if (ind < buckets[t]->size ())
+						{
+							r = (*buckets[t])[ind];
+							break;
+						}
+						ind -= buckets[t]->size ();
+					}
+					if (!r->IsUnreachable () && filter (r)) return r;
+				}
+				// most of candidates are rejected by filter, try all of them
+				for (int t = 0; t < RANDOM_ROUTER_INDEX_NUM_TRANSPORTS_SETS; t++)
+					if (!transports || (t & transports))
+						for (auto& r: *buckets[t])
+							if (!r->IsUnreachable () && filter (r))
+								return r;
+				return nullptr;
+			}
+
+		private:
+
+			typedef std::vector<std::shared_ptr<const RouterInfo> > Bucket;
+			struct Snapshot
+			{
+				std::shared_ptr<const Bucket> buckets[eNumCategories][RANDOM_ROUTER_INDEX_NUM_TRANSPORTS_SETS];
+
+				Snapshot ();
+			};
+
+			struct Entry
+			{
+				uint8_t transports;
+				int positions[eNumCategories]; // in bucket, -1 if not there
+			};
+
+			std::shared_ptr<const Snapshot> GetSnapshot () const;
+			void Publish (std::shared_ptr<const Snapshot> snapshot);
+
+			std::mutex m_Mutex; // writers
+			mutable std::mutex m_SnapshotMutex; // guards m_Snapshot pointer only
+			std::shared_ptr<const Snapshot> m_Snapshot;
+			std::map<IdentHash, Entry> m_Entries;
+	};
+}
+}
+
+#endif
@@ -0,0 +1,287 @@
+#include <string.h>
+#include <fstream>
+#include <iterator>
+#include <boost/filesystem.hpp>
+#include "I2PEndian.h"
+#include "Log.h"
+#include "NetDbStore.h"
+
+namespace i2p
+{
+namespace data
+{
+	NetDbStore::NetDbStore (const std::string& fullPath):
+		m_FullPath (fullPath), m_Size (0), m_LiveSize (0)
+	{
+	}
+
+	NetDbStore::~NetDbStore ()
+	{
+		Close ();
+	}
+
+	bool NetDbStore::Open ()
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (!boost::filesystem::exists (m_FullPath))
+		{
+			std::ofstream f (m_FullPath, std::ofstream::binary | std::ofstream::out);
+			if (!f.is_open ())
+			{
+				LogPrint (eLogError, "NetDbStore: can't create ", m_FullPath);
+				return false;
+			}
+			f.write (NETDB_STORE_MAGIC, NETDB_STORE_HEADER_SIZE);
+		}
+		if (!Map ()) return false;
+		auto buf = (const uint8_t *)m_Region->get_address ();
+		if (m_Size < NETDB_STORE_HEADER_SIZE || memcmp (buf, NETDB_STORE_MAGIC, NETDB_STORE_HEADER_SIZE))
+		{
+			LogPrint (eLogError, "NetDbStore: ", m_FullPath, " is not a netDb store");
+			Unmap ();
+			return false;
+		}
+		// build index
+		m_Index.clear ();
+		m_LiveSize = 0;
+		size_t offset = NETDB_STORE_HEADER_SIZE;
+		while (offset + NETDB_STORE_RECORD_HEADER_SIZE <= m_Size)
+		{
+			size_t len = bufbe32toh (buf + offset);
+			if (offset + NETDB_STORE_RECORD_HEADER_SIZE + len > m_Size) break; // write was interrupted
+			IdentHash ident (buf + offset + 4);
+			auto it = m_Index.find (ident);
+			if (it != m_Index.end ())
+			{
+				m_LiveSize -= NETDB_STORE_RECORD_HEADER_SIZE + it->second.second;
+				m_Index.erase (it);
+			}
+			if (len)
+			{
+				m_Index[ident] = std::make_pair (offset + NETDB_STORE_RECORD_HEADER_SIZE, len);
+				m_LiveSize += NETDB_STORE_RECORD_HEADER_SIZE + len;
+			}
+			offset += NETDB_STORE_RECORD_HEADER_SIZE + len;
+		}
+		if (offset < m_Size)
+		{
+			LogPrint (eLogWarning, "NetDbStore: ", m_Size - offset, " bytes of incomplete record truncated");
+			Unmap ();
+			boost::system::error_code ec;
+			boost::filesystem::resize_file (m_FullPath, offset, ec);
+			if (ec || !Map ()) return false;
+		}
+		LogPrint (eLogInfo, "NetDbStore: ", m_Index.size (), " routers in ", m_Size, " bytes");
+		return true;
+	}
+
+	void NetDbStore::Close ()
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		Unmap ();
+		m_Index.clear ();
+		m_Pending.clear ();
+		m_PendingIndex.clear ();
+	}
+
+	bool NetDbStore::Map ()
+	{
+		try
+		{
+			m_Size = boost::filesystem::file_size (m_FullPath);
+			m_File.reset (new boost::interprocess::file_mapping (m_FullPath.c_str (), boost::interprocess::read_only));
+			m_Region.reset (new boost::interprocess::mapped_region (*m_File, boost::interprocess::read_only));
+		}
+		catch (std::exception& ex)
+		{
+			LogPrint (eLogError, "NetDbStore: can't map ", m_FullPath, ": ", ex.what ());
+			Unmap ();
+			return false;
+		}
+		return true;
+	}
+
+	void NetDbStore::Unmap ()
+	{
+		m_Region.reset (nullptr);
+		m_File.reset (nullptr);
+	}
+
+	std::vector<NetDbStore::Record> NetDbStore::GetRecords () const
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		std::vector<Record> records;
+		if (!m_Region) return records;
+		auto buf = (const uint8_t *)m_Region->get_address ();
+		records.reserve (m_Index.size ());
+		for (auto& it: m_Index)
+			records.push_back ({ it.first, buf + it.second.first, it.second.second });
+		return records;
+	}
+
+	bool NetDbStore::LoadBuffer (RouterInfo& r) const
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (!m_Region) return false;
+		auto it = m_Index.find (r.GetIdentHash ());
+		if (it == m_Index.end ()) return false;
+		r.SetBuffer ((const uint8_t *)m_Region->get_address () + it->second.first, it->second.second);
+		return true;
+	}
+
+	void NetDbStore::AddRecord (std::vector<uint8_t>& buf, const IdentHash& ident, const uint8_t * data, size_t len)
+	{
+		auto offset = buf.size ();
+		buf.resize (offset + NETDB_STORE_RECORD_HEADER_SIZE + len);
+		htobe32buf (buf.data () + offset, len);
+		memcpy (buf.data () + offset + 4, ident, 32);
+		if (len) memcpy (buf.data () + offset + NETDB_STORE_RECORD_HEADER_SIZE, data, len);
+	}
+
+	void NetDbStore::Put (const IdentHash& ident, const uint8_t * buf, size_t len)
+	{
+		if (!buf || !len) return;
+		std::unique_lock<std::mutex> l(m_Mutex);
+		m_PendingIndex.push_back (std::make_pair (ident, std::make_pair (m_Pending.size () + NETDB_STORE_RECORD_HEADER_SIZE, len)));
+		AddRecord (m_Pending, ident, buf, len);
+	}
+
+	void NetDbStore::Remove (const IdentHash& ident)
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		bool found = m_Index.count (ident);
+		for (auto it = m_PendingIndex.begin (); !found && it != m_PendingIndex.end (); ++it)
+			found = it->first == ident;
+		if (!found) return; // nothing to remove
+		m_PendingIndex.push_back (std::make_pair (ident, std::make_pair (m_Pending.size () + NETDB_STORE_RECORD_HEADER_SIZE, 0)));
+		AddRecord (m_Pending, ident, nullptr, 0);
+	}
+
+	void NetDbStore::Flush ()
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (m_Pending.empty ()) return;
+		std::ofstream f (m_FullPath, std::ofstream::binary | std::ofstream::out | std::ofstream::app);
+		if (f.is_open ())
+			f.write ((char *)m_Pending.data (), m_Pending.size ());
+		f.close ();
+		if (!f)
+		{
+			LogPrint (eLogError, "NetDbStore: can't write to ", m_FullPath);
+			return; // keep pending, try next time
+		}
+		for (auto& it: m_PendingIndex)
+		{
+			auto it1 = m_Index.find (it.first);
+			if (it1 != m_Index.end ())
+			{
+				m_LiveSize -= NETDB_STORE_RECORD_HEADER_SIZE + it1->second.second;
+				m_Index.erase (it1);
+			}
+			if (it.second.second)
+			{
+				m_Index[it.first] = std::make_pair (m_Size + it.second.first, it.second.second);
+				m_LiveSize += NETDB_STORE_RECORD_HEADER_SIZE + it.second.second;
+			}
+		}
+		m_Pending.clear ();
+		m_PendingIndex.clear ();
+		// remap to see appended records
+		Unmap ();
+		Map ();
+	}
+
+	bool NetDbStore::NeedsCompaction () const
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		return m_Size > NETDB_STORE_MIN_COMPACTION_SIZE && m_Size - NETDB_STORE_HEADER_SIZE > 2*m_LiveSize;
+	}
+
+	void NetDbStore::Compact ()
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (!m_Region) return;
+		// copy live records to new file and replace old one
+		std::string tmpPath = m_FullPath + ".tmp";
+		std::ofstream f (tmpPath, std::ofstream::binary | std::ofstream::out | std::ofstream::trunc);
+		if (!f.is_open ())
+		{
+			LogPrint (eLogError, "NetDbStore: can't create ", tmpPath);
+			return;
+		}
+		f.write (NETDB_STORE_MAGIC, NETDB_STORE_HEADER_SIZE);
+		auto buf = (const uint8_t *)m_Region->get_address ();
+		std::map<IdentHash, std::pair<size_t, size_t> > index;
+		std::vector<uint8_t> record;
+		size_t offset = NETDB_STORE_HEADER_SIZE;
+		for (auto& it: m_Index)
+		{
+			record.clear ();
+			AddRecord (record, it.first, buf + it.second.first, it.second.second);
+			f.write ((char *)record.data (), record.size ());
+			index[it.first] = std::make_pair (offset + NETDB_STORE_RECORD_HEADER_SIZE, it.second.second);
+			offset += record.size ();
+		}
+		f.close ();
+		boost::system::error_code ec;
+		if (!f)
+		{
+			LogPrint (eLogError, "NetDbStore: can't write to ", tmpPath);
+			boost::filesystem::remove (tmpPath, ec);
+			return;
+		}
+		auto oldSize = m_Size;
+		Unmap (); // can't replace mapped file on Windows
+		boost::filesystem::rename (tmpPath, m_FullPath, ec);
+		if (ec)
+		{
+			LogPrint (eLogError, "NetDbStore: can't replace ", m_FullPath, ": ", ec.message ());
+			boost::filesystem::remove (tmpPath, ec);
+			Map ();
+			return;
+		}
+		m_Index.swap (index);
+		m_LiveSize = offset - NETDB_STORE_HEADER_SIZE;
+		Map ();
+		LogPrint (eLogInfo, "NetDbStore: compacted from ", oldSize, " to ", m_Size, " bytes");
+	}
+
+	size_t NetDbStore::Import (const std::vector<std::string>& files)
+	{
+		std::vector<std::string> imported, rejected;
+		for (auto& fullPath: files)
+		{
+			std::ifstream s (fullPath, std::ifstream::binary);
+			if (!s.is_open ()) continue;
+			std::vector<uint8_t> buf ((std::istreambuf_iterator<char>(s)), std::istreambuf_iterator<char>());
+			if (buf.size () < 40 || buf.size () > (size_t)MAX_RI_BUFFER_SIZE)
+			{
+				LogPrint (eLogWarning, "NetDbStore: can't import malformed ", fullPath);
+				continue;
+			}
+			// records are trusted when loaded, verify signature now
+			RouterInfo r (buf.data (), buf.size ());
+			if (r.IsUnreachable ())
+			{
+				LogPrint (eLogWarning, "NetDbStore: skip unreachable or unverified ", fullPath);
+				rejected.push_back (fullPath);
+				continue;
+			}
+			Put (r.GetIdentHash (), buf.data (), buf.size ());
+			imported.push_back (fullPath);
+		}
+		Flush ();
+		{
+			std::unique_lock<std::mutex> l(m_Mutex);
+			if (!m_Pending.empty ()) return 0; // failed to write, keep files
+		}
+		boost::system::error_code ec;
+		for (auto& it: imported)
+			boost::filesystem::remove (it, ec);
+		for (auto& it: rejected)
+			boost::filesystem::remove (it, ec); // would be removed by file loader as well
+		LogPrint (eLogInfo, "NetDbStore: ", imported.size (), " routers imported from files");
+		return imported.size ();
+	}
+}
+}
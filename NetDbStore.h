@@ -0,0 +1,76 @@
+#ifndef NETDB_STORE_H__
+#define NETDB_STORE_H__
+
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "Identity.h"
+#include "RouterInfo.h"
+
+namespace i2p
+{
+namespace data
+{
+	// Single append-only file of RouterInfos instead of file per router.
+	// Header is 8 bytes magic, followed by records of 4 bytes length, 32 bytes ident hash
+	// and RouterInfo itself. Zero length means router has been removed. Last record wins
+	const char NETDB_STORE_MAGIC[] = "i2pdNDB1";
+	const size_t NETDB_STORE_HEADER_SIZE = 8;
+	const size_t NETDB_STORE_RECORD_HEADER_SIZE = 36;
+	const size_t NETDB_STORE_MIN_COMPACTION_SIZE = 1024*1024; // don't compact smaller files
+	class NetDbStore
+	{
+		public:
+
+			struct Record
+			{
+				IdentHash ident;
+				const uint8_t * buf; // points to mapped file
+				size_t len;
+			};
+
+			NetDbStore (const std::string& fullPath);
+			~NetDbStore ();
+
+			bool Open (); // create if doesn't exist
+			void Close ();
+
+			std::vector<Record> GetRecords () const; // valid until next Flush or Compact
+			bool LoadBuffer (RouterInfo& r) const;
+			void Put (const IdentHash& ident, const uint8_t * buf, size_t len);
+			void Remove (const IdentHash& ident);
+			void Flush (); // append everything since last flush in one write
+			bool NeedsCompaction () const;
+			void Compact ();
+			size_t Import (const std::vector<std::string>& files); // routerInfo-*.dat, removed after import
+
+			size_t GetNumRouters () const { return m_Index.size (); };
+			size_t GetSize () const { return m_Size; };
+
+		private:
+
+			bool Map ();
+			void Unmap ();
+			void AddRecord (std::vector<uint8_t>& buf, const IdentHash& ident, const uint8_t * data, size_t len);
+
+		private:
+
+			std::string m_FullPath;
+			mutable std::mutex m_Mutex;
+			std::unique_ptr<boost::interprocess::file_mapping> m_File;
+			std::unique_ptr<boost::interprocess::mapped_region> m_Region;
+			std::map<IdentHash, std::pair<size_t, size_t> > m_Index; // ident -> offset of RouterInfo, length
+			size_t m_Size, m_LiveSize; // whole file and records in index
+
+			std::vector<uint8_t> m_Pending;
+			std::vector<std::pair<IdentHash, std::pair<size_t, size_t> > > m_PendingIndex; // offset in m_Pending, zero length if removed
+	};
+}
+}
+
+#endif
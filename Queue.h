@@ -1,10 +1,13 @@
 #ifndef QUEUE_H__
 #define QUEUE_H__
 
+#include <inttypes.h>
 #include <queue>
 #include <vector>
 #include <mutex>
+#include <atomic>
 #include <thread>
+#include <chrono>
 #include <condition_variable>
 #include <functional>
 
@@ -118,8 +121,290 @@ namespace util
 			std::condition_variable m_NonEmpty;
 	};	
 
+	const size_t LOCK_FREE_QUEUE_DEFAULT_CAPACITY = 4096; // must be power of 2
+	const int LOCK_FREE_QUEUE_MIN_SPIN = 16;
+	const int LOCK_FREE_QUEUE_MAX_SPIN = 4096;
+
+	// Bounded multi-producer/single-consumer ring (Vyukov's algorithm).
+	// Same interface as Queue. Consumer spins adaptively before parking on condvar,
+	// producers touch the mutex only if the consumer is parked or the ring is full.
+	// Once ring is full, all elements go to overflow until consumer drains it, so order is kept
+	template<typename Element>
+	class LockFreeQueue
+	{
+		public:
+
+			LockFreeQueue (size_t capacity = LOCK_FREE_QUEUE_DEFAULT_CAPACITY):
+				m_Capacity (capacity), m_Mask (capacity - 1), m_Cells (new Cell[capacity]),
+				m_EnqueuePos (0), m_DequeuePos (0), m_NumOverflowed (0), m_IsParked (false),
+				m_IsWokenUp (false), m_SpinCount (LOCK_FREE_QUEUE_MIN_SPIN)
+			{
+				for (size_t i = 0; i < m_Capacity; i++)
+					m_Cells[i].sequence.store (i, std::memory_order_relaxed);
+			}
+
+			~LockFreeQueue () { delete[] m_Cells; };
+
+			void Put (Element e)
+			{
+				PutElement (e);
+				NotifyConsumer ();
+			}
+
+			void Put (const std::vector<Element>& vec)
+			{
+				if (!vec.empty ())
+				{
+					for (auto it: vec)
+						PutElement (it);
+					NotifyConsumer ();
+				}
+			}
+
+			Element GetNext ()
+			{
+				auto el = Spin ();
+				while (!el)
+				{
+					if (Park (std::chrono::milliseconds (1000))) return Get (); // woken up
+					el = Get ();
+				}
+				return el;
+			}
+
+			Element GetNextWithTimeout (int usec)
+			{
+				auto el = Spin ();
+				if (!el)
+				{
+					Park (std::chrono::milliseconds (usec));
+					el = Get ();
+				}
+				return el;
+			}
+
+			void Wait ()
+			{
+				if (SpinUntilNonEmpty ()) return;
+				while (IsEmpty ())
+					if (Park (std::chrono::milliseconds (1000))) break; // woken up
+			}
+
+			bool Wait (int sec, int usec)
+			{
+				if (SpinUntilNonEmpty ()) return true;
+				return Park (std::chrono::seconds (sec) + std::chrono::milliseconds (usec)) || !IsEmpty ();
+			}
+
+			bool IsEmpty () { return !GetSize (); };
+
+			int GetSize ()
+			{
+				return m_EnqueuePos.load (std::memory_order_relaxed) - m_DequeuePos.load (std::memory_order_relaxed) +
+					m_NumOverflowed.load (std::memory_order_relaxed);
+			}
+
+			void WakeUp ()
+			{
+				std::unique_lock<std::mutex> l(m_Mutex);
+				m_IsWokenUp = true;
+				m_NonEmpty.notify_all ();
+			}
+
+			Element Get ()
+			{
+				Element el = nullptr;
+				if (!TryGet (el) && m_NumOverflowed.load (std::memory_order_acquire) > 0)
+				{
+					std::unique_lock<std::mutex> l(m_Mutex);
+					if (!m_Overflow.empty () && IsRingDrained ())
+					{
+						el = m_Overflow.front ();
+						m_Overflow.pop ();
+						m_NumOverflowed.fetch_sub (1, std::memory_order_relaxed);
+					}
+				}
+				return el;
+			}
+
+			size_t Get (std::vector<Element>& els, size_t maxNum) // batch, non-blocking
+			{
+				size_t num = 0;
+				while (num < maxNum)
+				{
+					auto el = Get ();
+					if (!el) break;
+					els.push_back (el);
+					num++;
+				}
+				return num;
+			}
+
+			Element Peek () // consumer only
+			{
+				auto pos = m_DequeuePos.load (std::memory_order_relaxed);
+				auto& cell = m_Cells[pos & m_Mask];
+				if (cell.sequence.load (std::memory_order_acquire) == pos + 1)
+					return cell.data;
+				if (m_NumOverflowed.load (std::memory_order_acquire) > 0)
+				{
+					std::unique_lock<std::mutex> l(m_Mutex);
+					if (!m_Overflow.empty () && IsRingDrained ()) return m_Overflow.front ();
+				}
+				return nullptr;
+			}
+
+		private:
+
+			void PutElement (const Element& e)
+			{
+				// elements in ring are older than overflowed ones, consumer takes from ring first.
+				// never block producer since it might be consumer itself
+				if (m_NumOverflowed.load (std::memory_order_acquire) > 0 || !TryPut (e))
+				{
+					std::unique_lock<std::mutex> l(m_Mutex);
+					m_Overflow.push (e);
+					m_NumOverflowed.fetch_add (1, std::memory_order_release);
+				}
+			}
+
+			bool TryPut (const Element& e)
+			{
+				auto pos = m_EnqueuePos.load (std::memory_order_relaxed);
+				for (;;)
+				{
+					auto& cell = m_Cells[pos & m_Mask];
+					auto seq = cell.sequence.load (std::memory_order_acquire);
+					auto diff = (intptr_t)seq - (intptr_t)pos;
+					if (!diff)
+					{
+						if (m_EnqueuePos.compare_exchange_weak (pos, pos + 1, std::memory_order_relaxed))
+						{
+							cell.data = e;
+							cell.sequence.store (pos + 1, std::memory_order_release);
+							return true;
+						}
+					}
+					else if (diff < 0)
+						return false; // full
+					else
+						pos = m_EnqueuePos.load (std::memory_order_relaxed);
+				}
+			}
+
+			bool IsRingDrained () const // consumer only, after overflowed element is seen
+			{
+				// a slot claimed but not published yet holds element older than overflowed ones,
+				// consumer must wait for it rather than take from overflow
+				return m_DequeuePos.load (std::memory_order_relaxed) == m_EnqueuePos.load (std::memory_order_relaxed);
+			}
+
+			bool TryGet (Element& e)
+			{
+				auto pos = m_DequeuePos.load (std::memory_order_relaxed);
+				auto& cell = m_Cells[pos & m_Mask];
+				if (cell.sequence.load (std::memory_order_acquire) != pos + 1)
+					return false; // empty or producer hasn't finished yet
+				e = std::move (cell.data);
+				cell.data = nullptr;
+				cell.sequence.store (pos + m_Capacity, std::memory_order_release);
+				m_DequeuePos.store (pos + 1, std::memory_order_relaxed);
+				return true;
+			}
+
+			Element Spin ()
+			{
+				int spinCount = m_SpinCount;
+				for (int i = 0; i < spinCount; i++)
+				{
+					auto el = Get ();
+					if (el) 
+					{
+						AdjustSpinCount (i > 0);
+						return el;
+					}
+					if ((i & 0x0F) == 0x0F) std::this_thread::yield ();
+				}
+				AdjustSpinCount (false);
+				return nullptr;
+			}
+
+			bool SpinUntilNonEmpty ()
+			{
+				int spinCount = m_SpinCount;
+				for (int i = 0; i < spinCount; i++)
+				{
+					if (!IsEmpty ())
+					{
+						AdjustSpinCount (i > 0);
+						return true;
+					}
+					if ((i & 0x0F) == 0x0F) std::this_thread::yield ();
+				}
+				AdjustSpinCount (false);
+				return false;
+			}
+
+			void AdjustSpinCount (bool spinHelped)
+			{
+				// spin longer if elements arrive while spinning, shorter if we park anyway
+				if (spinHelped)
+				{
+					if (m_SpinCount < LOCK_FREE_QUEUE_MAX_SPIN) m_SpinCount *= 2;
+				}
+				else if (m_SpinCount > LOCK_FREE_QUEUE_MIN_SPIN)
+					m_SpinCount /= 2;
+			}
+
+			template<class Rep, class Period>
+			bool Park (const std::chrono::duration<Rep, Period>& timeout) // returns true if woken up
+			{
+				std::unique_lock<std::mutex> l(m_Mutex);
+				m_IsParked.store (true, std::memory_order_relaxed);
+				std::atomic_thread_fence (std::memory_order_seq_cst);
+				if (IsEmpty () && !m_IsWokenUp)
+					m_NonEmpty.wait_for (l, timeout);
+				m_IsParked.store (false, std::memory_order_relaxed);
+				bool wokenUp = m_IsWokenUp;
+				m_IsWokenUp = false;
+				return wokenUp;
+			}
+
+			void NotifyConsumer ()
+			{
+				std::atomic_thread_fence (std::memory_order_seq_cst);
+				if (m_IsParked.load (std::memory_order_relaxed))
+				{
+					std::unique_lock<std::mutex> l(m_Mutex);
+					m_NonEmpty.notify_one ();
+				}
+			}
+
+		private:
+
+			struct Cell
+			{
+				std::atomic<size_t> sequence;
+				Element data;
+			};
+
+			const size_t m_Capacity, m_Mask;
+			Cell * m_Cells;
+			char m_Pad0[64];
+			std::atomic<size_t> m_EnqueuePos;
+			char m_Pad1[64];
+			std::atomic<size_t> m_DequeuePos;
+			std::atomic<int> m_NumOverflowed;
+			std::atomic<bool> m_IsParked;
+			bool m_IsWokenUp;
+			int m_SpinCount; // consumer only
+			std::queue<Element> m_Overflow;
+			std::mutex m_Mutex;
+			std::condition_variable m_NonEmpty;
+	};
+
 	template<class Msg>
-	class MsgQueue: public Queue<Msg *>
+	class MsgQueue: public LockFreeQueue<Msg *>
 	{
 		public:
 
@@ -132,7 +417,7 @@ namespace util
 				if (m_IsRunning)
 				{
 					m_IsRunning = false;
-					Queue<Msg *>::WakeUp ();					
+					LockFreeQueue<Msg *>::WakeUp ();					
 					m_Thread.join();
 				}
 			}
@@ -145,7 +430,7 @@ namespace util
 			{
 				while (m_IsRunning)
 				{
-					while (auto msg = Queue<Msg *>::Get ())
+					while (auto msg = LockFreeQueue<Msg *>::Get ())
 					{
 						msg->Process ();
 						delete msg;
@@ -153,7 +438,7 @@ namespace util
 					if (m_OnEmpty != nullptr)
 						m_OnEmpty ();
 					if (m_IsRunning)
-						Queue<Msg *>::Wait ();
+						LockFreeQueue<Msg *>::Wait ();
 				}	
 			}	
 			
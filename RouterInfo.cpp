@@ -22,13 +22,13 @@ namespace data
 		ReadFromFile ();
 	}	
 
-	RouterInfo::RouterInfo (const uint8_t * buf, int len):
+	RouterInfo::RouterInfo (const uint8_t * buf, int len, bool verifySignature):
 		m_IsUpdated (true), m_IsUnreachable (false), m_SupportedTransports (0), m_Caps (0)
 	{
 		m_Buffer = new uint8_t[MAX_RI_BUFFER_SIZE];
 		memcpy (m_Buffer, buf, len);
 		m_BufferLen = len;
-		ReadFromBuffer (true);
+		ReadFromBuffer (verifySignature);
 	}	
 
 	RouterInfo::~RouterInfo ()
@@ -451,6 +451,15 @@ namespace data
 		return m_Buffer; 
 	}
 
+	void RouterInfo::SetBuffer (const uint8_t * buf, int len)
+	{
+		if (len > MAX_RI_BUFFER_SIZE) return;
+		if (!m_Buffer)
+			m_Buffer = new uint8_t[MAX_RI_BUFFER_SIZE];
+		memcpy (m_Buffer, buf, len);
+		m_BufferLen = len;
+	}	
+
 	void RouterInfo::CreateBuffer (const PrivateKeys& privateKeys)
 	{
 		m_Timestamp = i2p::util::GetMillisecondsSinceEpoch (); // refresh timstamp
@@ -103,7 +103,7 @@ namespace data
 			RouterInfo (): m_Buffer (nullptr) { };
 			RouterInfo (const RouterInfo& ) = default;
 			RouterInfo& operator=(const RouterInfo& ) = default;
-			RouterInfo (const uint8_t * buf, int len);
+			RouterInfo (const uint8_t * buf, int len, bool verifySignature = true);
 			~RouterInfo ();
 			
 			std::shared_ptr<const IdentityEx> GetRouterIdentity () const { return m_RouterIdentity; };
@@ -136,7 +136,8 @@ namespace data
 			bool IsHighBandwidth () const { return m_Caps & RouterInfo::eHighBandwidth; };
 			bool IsExtraBandwidth () const { return m_Caps & RouterInfo::eExtraBandwidth; };	
 			
-			uint8_t GetCaps () const { return m_Caps; };	
+			uint8_t GetCaps () const { return m_Caps; };
+			uint8_t GetSupportedTransports () const { return m_SupportedTransports; };	
 			void SetCaps (uint8_t caps);
 			void SetCaps (const char * caps);
 
@@ -145,6 +146,7 @@ namespace data
 
 			const uint8_t * GetBuffer () const { return m_Buffer; };
 			const uint8_t * LoadBuffer (); // load if necessary
+			void SetBuffer (const uint8_t * buf, int len); // from packed store
 			int GetBufferLen () const { return m_BufferLen; };			
 			void CreateBuffer (const PrivateKeys& privateKeys);
 
@@ -552,9 +552,21 @@ namespace client
 			Terminate ();
 			return;
 		}
-		m_Socket.async_read_some (boost::asio::buffer(m_Buffer + m_BufferOffset, SAM_SOCKET_BUFFER_SIZE - m_BufferOffset),                
-			std::bind((m_SocketType == eSAMSocketTypeStream) ? &SAMSocket::HandleReceived : &SAMSocket::HandleMessage,
-			shared_from_this (), std::placeholders::_1, std::placeholders::_2));
+		if (m_SocketType == eSAMSocketTypeStream && m_Stream)
+		{
+			// directly to stream's send buffer, keep the stream until completed
+			auto s = shared_from_this ();
+			auto stream = m_Stream;
+			m_Socket.async_read_some (stream->PrepareSend (SAM_SOCKET_BUFFER_SIZE),
+				[s, stream](const boost::system::error_code& ecode, std::size_t bytes_transferred)
+				{
+					s->HandleStreamDataReceived (ecode, bytes_transferred);
+				});
+		}
+		else
+			m_Socket.async_read_some (boost::asio::buffer(m_Buffer + m_BufferOffset, SAM_SOCKET_BUFFER_SIZE - m_BufferOffset),                
+				std::bind((m_SocketType == eSAMSocketTypeStream) ? &SAMSocket::HandleReceived : &SAMSocket::HandleMessage,
+				shared_from_this (), std::placeholders::_1, std::placeholders::_2));
 	}
 
 	void SAMSocket::HandleReceived (const boost::system::error_code& ecode, std::size_t bytes_transferred)
@@ -582,16 +594,39 @@ namespace client
 		}
 	}
 
+	void SAMSocket::HandleStreamDataReceived (const boost::system::error_code& ecode, std::size_t bytes_transferred)
+	{
+		if (ecode)
+        {
+			LogPrint (eLogError, "SAM: read error: ", ecode.message ());
+			if (ecode != boost::asio::error::operation_aborted)
+				Terminate ();
+		}
+		else if (m_Stream)
+		{
+			auto s = shared_from_this ();
+			m_Stream->AsyncCommitSend (bytes_transferred,
+				[s](const boost::system::error_code& ecode)
+				{
+					if (!ecode)
+						s->Receive ();
+					else
+						s->Terminate ();
+				});
+		}
+	}
+
 	void SAMSocket::I2PReceive ()
 	{
 		if (m_Stream)
-			m_Stream->AsyncReceive (boost::asio::buffer (m_StreamBuffer, SAM_SOCKET_BUFFER_SIZE),
+			m_Stream->AsyncReceiveBuffers (SAM_SOCKET_BUFFER_SIZE,
 				std::bind (&SAMSocket::HandleI2PReceive, shared_from_this (),
-					std::placeholders::_1, std::placeholders::_2),
+					std::placeholders::_1, std::placeholders::_2, std::placeholders::_3),
 				SAM_SOCKET_CONNECTION_MAX_IDLE);
 	}	
 
-	void SAMSocket::HandleI2PReceive (const boost::system::error_code& ecode, std::size_t bytes_transferred)
+	void SAMSocket::HandleI2PReceive (const boost::system::error_code& ecode, 
+		const std::vector<boost::asio::const_buffer>& buffers, std::size_t bytes_transferred)
 	{
 		if (ecode)
 		{
@@ -601,8 +636,15 @@ namespace client
 		}
 		else
 		{
-			boost::asio::async_write (m_Socket, boost::asio::buffer (m_StreamBuffer, bytes_transferred),
-        		std::bind (&SAMSocket::HandleWriteI2PData, shared_from_this (), std::placeholders::_1));
+			// buffers point to stream's packets, the stream keeps them until consumed
+			auto s = shared_from_this ();
+			auto stream = m_Stream;
+			boost::asio::async_write (m_Socket, buffers,
+				[s, stream, bytes_transferred](const boost::system::error_code& ecode, std::size_t)
+				{
+					if (!ecode) stream->Consume (bytes_transferred);
+					s->HandleWriteI2PData (ecode);
+				});
 		}
 	}
 
@@ -636,7 +678,9 @@ namespace client
 				size_t l = stream->GetRemoteIdentity ()->ToBuffer (ident, 1024);
 				size_t l1 = i2p::data::ByteStreamToBase64 (ident, l, (char *)m_StreamBuffer, SAM_SOCKET_BUFFER_SIZE);
 				m_StreamBuffer[l1] = '\n';
-				HandleI2PReceive (boost::system::error_code (), l1 +1); // we send identity like it has been received from stream
+				// we send identity like it has been received from stream
+				boost::asio::async_write (m_Socket, boost::asio::buffer (m_StreamBuffer, l1 + 1),
+        			std::bind (&SAMSocket::HandleWriteI2PData, shared_from_this (), std::placeholders::_1));
 			}	
 			else
 				I2PReceive ();
@@ -94,9 +94,11 @@ namespace client
 			void HandleMessageReplySent (const boost::system::error_code& ecode, std::size_t bytes_transferred, bool close);
 			void Receive ();
 			void HandleReceived (const boost::system::error_code& ecode, std::size_t bytes_transferred);
+			void HandleStreamDataReceived (const boost::system::error_code& ecode, std::size_t bytes_transferred); // to stream's send buffer
 
 			void I2PReceive ();	
-			void HandleI2PReceive (const boost::system::error_code& ecode, std::size_t bytes_transferred);
+			void HandleI2PReceive (const boost::system::error_code& ecode, 
+				const std::vector<boost::asio::const_buffer>& buffers, std::size_t bytes_transferred);
 			void HandleI2PAccept (std::shared_ptr<i2p::stream::Stream> stream);
 			void HandleWriteI2PData (const boost::system::error_code& ecode);
 			void HandleI2PDatagramReceive (const i2p::data::IdentityEx& from, uint16_t fromPort, uint16_t toPort, const uint8_t * buf, size_t len);
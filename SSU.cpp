@@ -1,4 +1,8 @@
 #include <string.h>
+#ifdef __linux__
+#include <errno.h>
+#include <sys/socket.h>
+#endif
 #include <boost/bind.hpp>
 #include "Log.h"
 #include "Timestamp.h"
@@ -10,109 +14,206 @@ namespace i2p
 {
 namespace transport
 {
-	SSUServer::SSUServer (int port): m_Thread (nullptr), m_ThreadV6 (nullptr), m_ReceiversThread (nullptr),
-		m_Work (m_Service), m_WorkV6 (m_ServiceV6), m_ReceiversWork (m_ReceiversService), 
+	SSUPacketPool::SSUPacketPool (): m_FreePackets (SSU_PACKET_POOL_MAX_SIZE),
+		m_NumFree (0), m_NumInUse (0), m_NumHits (0), m_NumMisses (0)
+	{
+		for (size_t i = 0; i < SSU_PACKET_POOL_INITIAL_SIZE; i++)
+			m_FreePackets.Put (new SSUPacket ());
+		m_NumFree = SSU_PACKET_POOL_INITIAL_SIZE;
+	}
+
+	SSUPacketPool::~SSUPacketPool ()
+	{
+		while (auto packet = m_FreePackets.Get ())
+			delete packet;
+	}
+
+	SSUPacket * SSUPacketPool::Acquire ()
+	{
+		auto packet = m_FreePackets.Get ();
+		if (packet)
+		{
+			m_NumFree--;
+			m_NumHits.fetch_add (1, std::memory_order_relaxed);
+		}
+		else
+		{
+			packet = new SSUPacket ();
+			m_NumMisses.fetch_add (1, std::memory_order_relaxed);
+		}
+		packet->next = nullptr;
+		m_NumInUse++;
+		return packet;
+	}
+
+	void SSUPacketPool::Release (SSUPacket * packet)
+	{
+		while (packet)
+		{
+			auto next = packet->next;
+			m_NumInUse--;
+			// keep ring from overflowing, overflow would allocate
+			if (m_NumFree.fetch_add (1, std::memory_order_relaxed) < SSU_PACKET_POOL_MAX_SIZE)
+				m_FreePackets.Put (packet);
+			else
+			{
+				m_NumFree--;
+				delete packet;
+			}
+			packet = next;
+		}
+	}
+
+	SSUShard::SSUShard (): thread (nullptr), receiversThread (nullptr),
+		work (service), receiversWork (receiversService), socket (receiversService)
+	{
+#ifdef __linux__
+		for (size_t i = 0; i < SSU_MAX_NUM_BATCHED_PACKETS; i++)
+			receiveBatch[i] = packetsPool.Acquire ();
+#endif
+	}
+
+	SSUShard::~SSUShard ()
+	{
+#ifdef __linux__
+		for (size_t i = 0; i < SSU_MAX_NUM_BATCHED_PACKETS; i++)
+			packetsPool.Release (receiveBatch[i]);
+#endif
+	}
+
+	SSUServer::SSUServer (int port, int numShards): m_IsRunning (false),
 		m_Endpoint (boost::asio::ip::udp::v4 (), port), m_EndpointV6 (boost::asio::ip::udp::v6 (), port), 
-		m_Socket (m_ReceiversService, m_Endpoint), m_SocketV6 (m_ReceiversService), 
-		m_IntroducersUpdateTimer (m_Service), m_PeerTestsCleanupTimer (m_Service)	
+		m_Shards (CreateShards (numShards)), m_ShardV6 (new SSUShard ()),
+		m_IntroducersUpdateTimer (m_Shards[0]->service), m_PeerTestsCleanupTimer (m_Shards[0]->service)	
 	{
-		m_Socket.set_option (boost::asio::socket_base::receive_buffer_size (65535));
-		m_Socket.set_option (boost::asio::socket_base::send_buffer_size (65535));
+		for (auto& shard: m_Shards)
+		{
+			shard->socket.open (boost::asio::ip::udp::v4 ());
+#ifdef __linux__
+			if (m_Shards.size () > 1)
+				shard->socket.set_option (boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> (true));
+#endif
+			shard->socket.bind (m_Endpoint);
+			shard->socket.set_option (boost::asio::socket_base::receive_buffer_size (65535));
+			shard->socket.set_option (boost::asio::socket_base::send_buffer_size (65535));
+		}	
 		if (context.SupportsV6 ())
 		{
-			m_SocketV6.open (boost::asio::ip::udp::v6());
-			m_SocketV6.set_option (boost::asio::ip::v6_only (true));
-			m_SocketV6.set_option (boost::asio::socket_base::receive_buffer_size (65535));
-			m_SocketV6.set_option (boost::asio::socket_base::send_buffer_size (65535));
-			m_SocketV6.bind (m_EndpointV6);
+			auto& socketV6 = m_ShardV6->socket;
+			socketV6.open (boost::asio::ip::udp::v6());
+			socketV6.set_option (boost::asio::ip::v6_only (true));
+			socketV6.set_option (boost::asio::socket_base::receive_buffer_size (65535));
+			socketV6.set_option (boost::asio::socket_base::send_buffer_size (65535));
+			socketV6.bind (m_EndpointV6);
 		}
+		if (m_Shards.size () > 1)
+			LogPrint (eLogInfo, "SSU: ", m_Shards.size (), " v4 shards share port ", port);
 	}
 	
 	SSUServer::~SSUServer ()
 	{
 	}
 
+	std::vector<std::unique_ptr<SSUShard> > SSUServer::CreateShards (int numShards)
+	{
+#ifdef __linux__
+		if (numShards > SSU_MAX_NUM_SHARDS) numShards = SSU_MAX_NUM_SHARDS;
+#else
+		if (numShards > 1) 
+			LogPrint (eLogWarning, "SSU: multiple shards require SO_REUSEPORT, using one");
+		numShards = 1;
+#endif
+		if (numShards < 1) numShards = 1;
+		std::vector<std::unique_ptr<SSUShard> > shards;
+		for (int i = 0; i < numShards; i++)
+			shards.emplace_back (new SSUShard ());
+		return shards;
+	}	
+
+	std::vector<SSUShard *> SSUServer::GetAllShards () const
+	{
+		auto shards = GetShards ();
+		shards.push_back (m_ShardV6.get ());
+		return shards;
+	}	
+
+	SSUShard& SSUServer::GetShard (const boost::asio::ip::udp::endpoint& e) const
+	{
+		if (e.address ().is_v6 ()) return *m_ShardV6;
+		if (m_Shards.size () == 1) return *m_Shards[0];
+		uint64_t h = ((uint64_t)e.address ().to_v4 ().to_ulong () << 16) | e.port ();
+		h *= 0x9E3779B97F4A7C15ULL; // spread adjacent addresses and ports
+		return *m_Shards[(h >> 32) % m_Shards.size ()];
+	}	
+
 	void SSUServer::Start ()
 	{
 		m_IsRunning = true;
-		m_ReceiversThread = new std::thread (std::bind (&SSUServer::RunReceivers, this)); 
-		m_Thread = new std::thread (std::bind (&SSUServer::Run, this));
-		m_ReceiversService.post (std::bind (&SSUServer::Receive, this));  
+		for (auto& shard: m_Shards)
+			StartShard (shard.get ());
 		if (context.SupportsV6 ())
-		{	
-			m_ThreadV6 = new std::thread (std::bind (&SSUServer::RunV6, this));
-			m_ReceiversService.post (std::bind (&SSUServer::ReceiveV6, this));  
-		}
+			StartShard (m_ShardV6.get ());
 		SchedulePeerTestsCleanupTimer ();	
 		ScheduleIntroducersUpdateTimer (); // wait for 30 seconds and decide if we need introducers
 	}
 
+	void SSUServer::StartShard (SSUShard * shard)
+	{
+		shard->receiversThread = new std::thread (std::bind (&SSUServer::RunReceivers, this, shard)); 
+		shard->thread = new std::thread (std::bind (&SSUServer::Run, this, shard));
+		shard->receiversService.post (std::bind (&SSUServer::Receive, this, shard));  
+	}	
+
 	void SSUServer::Stop ()
 	{
 		DeleteAllSessions ();
 		m_IsRunning = false;
-		m_Service.stop ();
-		m_Socket.close ();
-		m_ServiceV6.stop ();
-		m_SocketV6.close ();
-		m_ReceiversService.stop ();
-		if (m_ReceiversThread)
+		auto shards = GetAllShards ();
+		for (auto shard: shards)
 		{	
-			m_ReceiversThread->join (); 
-			delete m_ReceiversThread;
-			m_ReceiversThread = nullptr;
-		}
-		if (m_Thread)
-		{	
-			m_Thread->join (); 
-			delete m_Thread;
-			m_Thread = nullptr;
-		}
-		if (m_ThreadV6)
+			shard->service.stop ();
+			shard->socket.close ();
+			shard->receiversService.stop ();
+		}	
+		for (auto shard: shards)
 		{	
-			m_ThreadV6->join (); 
-			delete m_ThreadV6;
-			m_ThreadV6 = nullptr;
-		}
-	}
-
-	void SSUServer::Run () 
-	{ 
-		while (m_IsRunning)
-		{
-			try
+			if (shard->receiversThread)
 			{	
-				m_Service.run ();
+				shard->receiversThread->join (); 
+				delete shard->receiversThread;
+				shard->receiversThread = nullptr;
+			}
+			if (shard->thread)
+			{	
+				shard->thread->join (); 
+				delete shard->thread;
+				shard->thread = nullptr;
 			}
-			catch (std::exception& ex)
-			{
-				LogPrint (eLogError, "SSU: server runtime exception: ", ex.what ());
-			}	
 		}	
 	}
 
-	void SSUServer::RunV6 () 
+	void SSUServer::Run (SSUShard * shard) 
 	{ 
 		while (m_IsRunning)
 		{
 			try
 			{	
-				m_ServiceV6.run ();
+				shard->service.run ();
 			}
 			catch (std::exception& ex)
 			{
-				LogPrint (eLogError, "SSU: v6 server runtime exception: ", ex.what ());
+				LogPrint (eLogError, "SSU: server runtime exception: ", ex.what ());
 			}	
 		}	
-	}	
+	}
 
-	void SSUServer::RunReceivers () 
+	void SSUServer::RunReceivers (SSUShard * shard) 
 	{ 
 		while (m_IsRunning)
 		{
 			try
 			{	
-				m_ReceiversService.run ();
+				shard->receiversService.run ();
 			}
 			catch (std::exception& ex)
 			{
@@ -123,114 +224,219 @@ namespace transport
 	
 	void SSUServer::AddRelay (uint32_t tag, const boost::asio::ip::udp::endpoint& relay)
 	{
+		std::unique_lock<std::mutex> l(m_RelaysMutex);
 		m_Relays[tag] = relay;
 	}	
 
 	std::shared_ptr<SSUSession> SSUServer::FindRelaySession (uint32_t tag)
 	{
-		auto it = m_Relays.find (tag);
-		if (it != m_Relays.end ())
-			return FindSession (it->second);
-		return nullptr;
+		boost::asio::ip::udp::endpoint relay;
+		{
+			std::unique_lock<std::mutex> l(m_RelaysMutex);
+			auto it = m_Relays.find (tag);
+			if (it == m_Relays.end ()) return nullptr;
+			relay = it->second;
+		}
+		return FindSession (relay);
 	}
 
 	void SSUServer::Send (const uint8_t * buf, size_t len, const boost::asio::ip::udp::endpoint& to)
 	{
-		if (to.protocol () == boost::asio::ip::udp::v4()) 
-			m_Socket.send_to (boost::asio::buffer (buf, len), to);
-		else
-			m_SocketV6.send_to (boost::asio::buffer (buf, len), to);
+		auto& shard = GetShard (to);
+#ifdef __linux__
+		auto& batch = shard.sendBatch;
+		if (len <= sizeof (batch.packets[0].buf))
+		{	
+			std::unique_lock<std::mutex> l(batch.mutex);
+			if (batch.numPackets >= SSU_MAX_NUM_BATCHED_PACKETS) // full
+				SendBatch (batch, shard.socket);
+			if (!batch.numPackets) // first packet, flush after current handler
+				shard.service.post (std::bind (&SSUServer::FlushSendBatch, this, &shard));
+			auto& packet = batch.packets[batch.numPackets];
+			memcpy (packet.buf, buf, len);
+			packet.len = len;
+			packet.from = to;
+			batch.numPackets++;
+			return;
+		}	
+#endif
+		shard.socket.send_to (boost::asio::buffer (buf, len), to);
 	}	
 
-	void SSUServer::Receive ()
+	void SSUServer::Receive (SSUShard * shard)
 	{
-		SSUPacket * packet = new SSUPacket ();
-		m_Socket.async_receive_from (boost::asio::buffer (packet->buf, SSU_MTU_V4), packet->from,
-			std::bind (&SSUServer::HandleReceivedFrom, this, std::placeholders::_1, std::placeholders::_2, packet)); 
+#ifdef __linux__
+		// wait until readable and take everything with recvmmsg 
+		shard->socket.async_receive (boost::asio::null_buffers (), 
+			std::bind (&SSUServer::HandleReceivedBatch, this, std::placeholders::_1, shard));
+#else
+		SSUPacket * packet = shard->packetsPool.Acquire ();
+		shard->socket.async_receive_from (boost::asio::buffer (packet->buf, shard == m_ShardV6.get () ? SSU_MTU_V6 : SSU_MTU_V4), packet->from,
+			std::bind (&SSUServer::HandleReceivedFrom, this, std::placeholders::_1, std::placeholders::_2, packet, shard)); 
+#endif
 	}
 
-	void SSUServer::ReceiveV6 ()
+#ifdef __linux__
+	void SSUServer::HandleReceivedBatch (const boost::system::error_code& ecode, SSUShard * shard)
+	{
+		bool v6 = shard == m_ShardV6.get ();
+		if (ecode)
+		{
+			LogPrint (eLogError, "SSU: ", v6 ? "v6 " : "", "receive error: ", ecode.message ());
+			return;
+		}	
+		auto batch = shard->receiveBatch;
+		size_t mtu = v6 ? SSU_MTU_V6 : SSU_MTU_V4;
+		mmsghdr msgs[SSU_MAX_NUM_BATCHED_PACKETS];
+		iovec iovs[SSU_MAX_NUM_BATCHED_PACKETS];
+		memset (msgs, 0, sizeof (msgs));
+		for (size_t i = 0; i < SSU_MAX_NUM_BATCHED_PACKETS; i++)
+		{
+			iovs[i].iov_base = batch[i]->buf;
+			iovs[i].iov_len = mtu;
+			msgs[i].msg_hdr.msg_name = batch[i]->from.data ();
+			msgs[i].msg_hdr.msg_namelen = batch[i]->from.capacity ();
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}	
+		int num = recvmmsg (shard->socket.native_handle (), msgs, SSU_MAX_NUM_BATCHED_PACKETS, MSG_DONTWAIT, nullptr);
+		if (num > 0)
+		{
+			SSUPacket * packets[SSU_MAX_NUM_BATCHED_PACKETS];
+			for (int i = 0; i < num; i++)
+			{
+				packets[i] = batch[i];
+				packets[i]->len = msgs[i].msg_len;
+				packets[i]->from.resize (msgs[i].msg_hdr.msg_namelen);
+				batch[i] = shard->packetsPool.Acquire ();
+			}	
+			DispatchReceivedPackets (packets, num);
+		}
+		else if (num < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+			LogPrint (eLogError, "SSU: ", v6 ? "v6 " : "", "recvmmsg error: ", strerror (errno));
+		Receive (shard);
+	}	
+
+	void SSUServer::FlushSendBatch (SSUShard * shard)
 	{
-		SSUPacket * packet = new SSUPacket ();
-		m_SocketV6.async_receive_from (boost::asio::buffer (packet->buf, SSU_MTU_V6), packet->from,
-			std::bind (&SSUServer::HandleReceivedFromV6, this, std::placeholders::_1, std::placeholders::_2, packet)); 
+		std::unique_lock<std::mutex> l(shard->sendBatch.mutex);
+		SendBatch (shard->sendBatch, shard->socket);
 	}	
 
-	void SSUServer::HandleReceivedFrom (const boost::system::error_code& ecode, std::size_t bytes_transferred, SSUPacket * packet)
+	void SSUServer::SendBatch (SSUSendBatch& batch, boost::asio::ip::udp::socket& socket)
 	{
-		if (!ecode)
+		// batch.mutex must be locked
+		size_t num = batch.numPackets, sent = 0;
+		if (!num) return;
+		mmsghdr msgs[SSU_MAX_NUM_BATCHED_PACKETS];
+		iovec iovs[SSU_MAX_NUM_BATCHED_PACKETS];
+		memset (msgs, 0, sizeof (msgs));
+		for (size_t i = 0; i < num; i++)
 		{
-			packet->len = bytes_transferred;
-			std::vector<SSUPacket *> packets;
-			packets.push_back (packet);
-
-			boost::system::error_code ec;
-			size_t moreBytes = m_Socket.available(ec);
-			while (moreBytes && packets.size () < 25)
-			{
-				packet = new SSUPacket ();
-				packet->len = m_Socket.receive_from (boost::asio::buffer (packet->buf, SSU_MTU_V4), packet->from);
-				packets.push_back (packet);
-				moreBytes = m_Socket.available();
-			}
-
-			m_Service.post (std::bind (&SSUServer::HandleReceivedPackets, this, packets, &m_Sessions));
-			Receive ();
-		}
-		else
+			auto& packet = batch.packets[i];
+			iovs[i].iov_base = packet.buf;
+			iovs[i].iov_len = packet.len;
+			msgs[i].msg_hdr.msg_name = packet.from.data ();
+			msgs[i].msg_hdr.msg_namelen = packet.from.size ();
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}	
+		while (sent < num)
+		{
+			int n = sendmmsg (socket.native_handle (), msgs + sent, num - sent, MSG_DONTWAIT);
+			if (n <= 0) break; 
+			sent += n;
+		}	
+		// socket buffer is full or error, send the rest one by one waiting if necessary
+		for (; sent < num; sent++)
 		{	
-			LogPrint (eLogError, "SSU: receive error: ", ecode.message ());
-			delete packet;
+			auto& packet = batch.packets[sent];
+			boost::system::error_code ec;
+			socket.send_to (boost::asio::buffer (packet.buf, packet.len), packet.from, 0, ec);
+			if (ec)
+				LogPrint (eLogWarning, "SSU: send error: ", ec.message ());
 		}	
-	}
+		batch.numPackets = 0;
+	}	
+#endif
 
-	void SSUServer::HandleReceivedFromV6 (const boost::system::error_code& ecode, std::size_t bytes_transferred, SSUPacket * packet)
+	void SSUServer::HandleReceivedFrom (const boost::system::error_code& ecode, std::size_t bytes_transferred, 
+		SSUPacket * packet, SSUShard * shard)
 	{
+		bool v6 = shard == m_ShardV6.get ();
 		if (!ecode)
 		{
 			packet->len = bytes_transferred;
-			std::vector<SSUPacket *> packets;
-			packets.push_back (packet);
+			SSUPacket * packets[SSU_MAX_NUM_BATCHED_PACKETS];
+			size_t numPackets = 0;
+			packets[numPackets++] = packet;
 
-			size_t moreBytes = m_SocketV6.available ();
-			while (moreBytes && packets.size () < 25)
+			boost::system::error_code ec;
+			size_t moreBytes = shard->socket.available (ec);
+			while (moreBytes && numPackets < SSU_MAX_NUM_BATCHED_PACKETS)
 			{
-				packet = new SSUPacket ();
-				packet->len = m_SocketV6.receive_from (boost::asio::buffer (packet->buf, SSU_MTU_V6), packet->from);
-				packets.push_back (packet);
-				moreBytes = m_SocketV6.available();
+				packet = shard->packetsPool.Acquire ();
+				packet->len = shard->socket.receive_from (boost::asio::buffer (packet->buf, v6 ? SSU_MTU_V6 : SSU_MTU_V4), packet->from);
+				packets[numPackets++] = packet;
+				moreBytes = shard->socket.available (ec);
 			}
 
-			m_ServiceV6.post (std::bind (&SSUServer::HandleReceivedPackets, this, packets, &m_SessionsV6));
-			ReceiveV6 ();
+			DispatchReceivedPackets (packets, numPackets);
+			Receive (shard);
 		}
 		else
 		{	
-			LogPrint (eLogError, "SSU: v6 receive error: ", ecode.message ());
-			delete packet;
+			LogPrint (eLogError, "SSU: ", v6 ? "v6 " : "", "receive error: ", ecode.message ());
+			shard->packetsPool.Release (packet);
 		}	
 	}
 
-	void SSUServer::HandleReceivedPackets (std::vector<SSUPacket *> packets, 
-		std::map<boost::asio::ip::udp::endpoint, std::shared_ptr<SSUSession> > * sessions)
+	void SSUServer::DispatchReceivedPackets (SSUPacket ** packets, size_t num)
+	{
+		// socket the kernel picked might be not the one of shard owning the session,
+		// chain packets per owning shard keeping their order
+		SSUShard * shards[SSU_MAX_NUM_BATCHED_PACKETS];
+		SSUPacket * chains[SSU_MAX_NUM_BATCHED_PACKETS];
+		size_t numShards = 0;
+		for (size_t i = num; i-- > 0;)
+		{
+			auto packet = packets[i];
+			auto shard = &GetShard (packet->from);
+			size_t j = 0;
+			while (j < numShards && shards[j] != shard) j++;
+			if (j == numShards)
+			{	
+				shards[j] = shard;
+				chains[j] = nullptr;
+				numShards++;
+			}	
+			packet->next = chains[j];
+			chains[j] = packet;
+		}	
+		for (size_t j = 0; j < numShards; j++)
+			shards[j]->service.post (std::bind (&SSUServer::HandleReceivedPackets, this, chains[j], shards[j]));
+	}	
+
+	void SSUServer::HandleReceivedPackets (SSUPacket * packets, SSUShard * shard)
 	{
 		std::shared_ptr<SSUSession> session;	
-		for (auto it1: packets)
+		for (auto packet = packets; packet; packet = packet->next)
 		{
-			auto packet = it1;
 			try
 			{	
 				if (!session || session->GetRemoteEndpoint () != packet->from) // we received packet for other session than previous
 				{
 					if (session) session->FlushData ();
-					auto it = sessions->find (packet->from);
-					if (it != sessions->end ())
+					session = nullptr;
+					std::unique_lock<std::mutex> l(shard->sessionsMutex);
+					auto it = shard->sessions.find (packet->from);
+					if (it != shard->sessions.end ())
 						session = it->second;
 					if (!session)
 					{
 						session = std::make_shared<SSUSession> (*this, packet->from);
 						session->WaitForConnect ();
-						(*sessions)[packet->from] = session;
+						shard->sessions[packet->from] = session;
 						LogPrint (eLogInfo, "SSU: new session from ", packet->from.address ().to_string (), ":", packet->from.port (), " created");
 					}
 				}
@@ -242,9 +448,10 @@ namespace transport
 				if (session) session->FlushData ();
 				session = nullptr;
 			}	
-			delete packet;
 		}
 		if (session) session->FlushData ();
+		// packets return to the pool of this shard, shards receive and process evenly in long run
+		shard->packetsPool.Release (packets);
 	}
 
 	std::shared_ptr<SSUSession> SSUServer::FindSession (std::shared_ptr<const i2p::data::RouterInfo> router) const
@@ -263,9 +470,10 @@ namespace transport
 
 	std::shared_ptr<SSUSession> SSUServer::FindSession (const boost::asio::ip::udp::endpoint& e) const
 	{
-		auto& sessions = e.address ().is_v6 () ?  m_SessionsV6 : m_Sessions; 
-		auto it = sessions.find (e);
-		if (it != sessions.end ())
+		auto& shard = GetShard (e);
+		std::unique_lock<std::mutex> l(shard.sessionsMutex);
+		auto it = shard.sessions.find (e);
+		if (it != shard.sessions.end ())
 			return it->second;
 		else
 			return nullptr;
@@ -286,23 +494,30 @@ namespace transport
 		if (router)
 		{
 			if (router->UsesIntroducer ())
-				m_Service.post (std::bind (&SSUServer::CreateSessionThroughIntroducer, this, router, peerTest)); // always V4 thread
+			{
+				// in shard of v4 endpoint the session will be stored with
+				auto address = router->GetSSUAddress (true); 
+				if (address)
+					GetService (boost::asio::ip::udp::endpoint (address->host, address->port)).post (
+						std::bind (&SSUServer::CreateSessionThroughIntroducer, this, router, peerTest)); 
+			}	
 			else
 			{
 				boost::asio::ip::udp::endpoint remoteEndpoint (addr, port);
-				auto& s = addr.is_v6 () ? m_ServiceV6 : m_Service;
-				s.post (std::bind (&SSUServer::CreateDirectSession, this, router, remoteEndpoint, peerTest));
+				GetService (remoteEndpoint).post (std::bind (&SSUServer::CreateDirectSession, this, router, remoteEndpoint, peerTest));
 			}
 		}
 	}
 
 	void SSUServer::CreateDirectSession (std::shared_ptr<const i2p::data::RouterInfo> router, boost::asio::ip::udp::endpoint remoteEndpoint, bool peerTest)
 	{	
-		auto& sessions = remoteEndpoint.address ().is_v6 () ? m_SessionsV6 : m_Sessions;	
-		auto it = sessions.find (remoteEndpoint);
-		if (it != sessions.end ())
+		auto& shard = GetShard (remoteEndpoint);
+		std::unique_lock<std::mutex> l(shard.sessionsMutex);
+		auto it = shard.sessions.find (remoteEndpoint);
+		if (it != shard.sessions.end ())
 		{	
 			auto session = it->second;
+			l.unlock ();
 			if (peerTest && session->GetState () == eSessionStateEstablished)
 				session->SendPeerTest ();
 		}	
@@ -310,7 +525,8 @@ namespace transport
 		{
 			// otherwise create new session					
 			auto session = std::make_shared<SSUSession> (*this, remoteEndpoint, router, peerTest);
-			sessions[remoteEndpoint] = session;
+			shard.sessions[remoteEndpoint] = session;
+			l.unlock ();
 			// connect 					
 			LogPrint (eLogInfo, "SSU: Creating new session to [", i2p::data::GetIdentHashAbbreviation (router->GetIdentHash ()), "] ",
 				remoteEndpoint.address ().to_string (), ":", remoteEndpoint.port ());
@@ -326,11 +542,10 @@ namespace transport
 			if (address)
 			{
 				boost::asio::ip::udp::endpoint remoteEndpoint (address->host, address->port);
-				auto it = m_Sessions.find (remoteEndpoint);
 				// check if session if presented alredy
-				if (it != m_Sessions.end ())
+				auto session = FindSession (remoteEndpoint);
+				if (session)
 				{	
-					auto session = it->second;
 					if (peerTest && session->GetState () == eSessionStateEstablished)
 						session->SendPeerTest ();
 					return; 
@@ -349,12 +564,8 @@ namespace transport
 						if (ep.address ().is_v4 ()) // ipv4 only
 						{	
 							if (!introducer) introducer = intr; // we pick first one for now
-							it = m_Sessions.find (ep); 
-							if (it != m_Sessions.end ())
-							{
-								introducerSession = it->second;
-								break; 
-							}	
+							introducerSession = FindSession (ep); 
+							if (introducerSession) break; 
 						}
 					}
 					if (!introducer)
@@ -370,11 +581,17 @@ namespace transport
 						LogPrint (eLogInfo, "SSU: Creating new session to introducer");
 						boost::asio::ip::udp::endpoint introducerEndpoint (introducer->iHost, introducer->iPort);
 						introducerSession = std::make_shared<SSUSession> (*this, introducerEndpoint, router);
-						m_Sessions[introducerEndpoint] = introducerSession;													
+						auto& introducerShard = GetShard (introducerEndpoint);
+						std::unique_lock<std::mutex> l(introducerShard.sessionsMutex);
+						introducerShard.sessions[introducerEndpoint] = introducerSession;													
 					}
 					// create session	
-					auto session = std::make_shared<SSUSession> (*this, remoteEndpoint, router, peerTest);
-					m_Sessions[remoteEndpoint] = session;
+					session = std::make_shared<SSUSession> (*this, remoteEndpoint, router, peerTest);
+					{
+						auto& shard = GetShard (remoteEndpoint);
+						std::unique_lock<std::mutex> l(shard.sessionsMutex);
+						shard.sessions[remoteEndpoint] = session;
+					}
 					// introduce
 					LogPrint (eLogInfo, "SSU: Introduce new session to [", i2p::data::GetIdentHashAbbreviation (router->GetIdentHash ()),
 							"] through introducer ", introducer->iHost, ":", introducer->iPort);
@@ -384,7 +601,9 @@ namespace transport
 						uint8_t buf[1];
 						Send (buf, 0, remoteEndpoint); // send HolePunch
 					}	
-					introducerSession->Introduce (*introducer, router);
+					// introducer session might belong to other shard
+					GetService (introducerSession->GetRemoteEndpoint ()).post (
+						std::bind (&SSUSession::Introduce, introducerSession, *introducer, router));
 				}
 				else	
 					LogPrint (eLogWarning, "SSU: Can't connect to unreachable router and no introducers present");
@@ -399,31 +618,37 @@ namespace transport
 		if (session)
 		{
 			session->Close ();
-			auto& ep = session->GetRemoteEndpoint ();
-			if (ep.address ().is_v6 ())
-				m_SessionsV6.erase (ep);
-			else
-				m_Sessions.erase (ep);
+			auto& shard = GetShard (session->GetRemoteEndpoint ());
+			std::unique_lock<std::mutex> l(shard.sessionsMutex);
+			shard.sessions.erase (session->GetRemoteEndpoint ());
 		}	
 	}	
 
 	void SSUServer::DeleteAllSessions ()
 	{
-		for (auto it: m_Sessions)
-			it.second->Close ();
-		m_Sessions.clear ();
-
-		for (auto it: m_SessionsV6)
-			it.second->Close ();
-		m_SessionsV6.clear ();
+		auto shards = GetAllShards ();
+		for (auto shard: shards)
+		{	
+			std::map<boost::asio::ip::udp::endpoint, std::shared_ptr<SSUSession> > sessions;
+			{
+				std::unique_lock<std::mutex> l(shard->sessionsMutex);
+				sessions.swap (shard->sessions);
+			}	
+			for (auto it: sessions)
+				it.second->Close ();
+		}	
 	}
 
 	template<typename Filter>
 	std::shared_ptr<SSUSession> SSUServer::GetRandomV4Session (Filter filter) // v4 only
 	{
 		std::vector<std::shared_ptr<SSUSession> > filteredSessions;
-		for (auto s :m_Sessions)
-			if (filter (s.second)) filteredSessions.push_back (s.second);
+		for (auto& shard: m_Shards)
+		{	
+			std::unique_lock<std::mutex> l(shard->sessionsMutex);
+			for (auto s :shard->sessions)
+				if (filter (s.second)) filteredSessions.push_back (s.second);
+		}
 		if (filteredSessions.size () > 0)
 		{
 			auto ind = rand () % filteredSessions.size ();
@@ -495,7 +720,7 @@ namespace transport
 				auto session = FindSession (it);
 				if (session && ts < session->GetCreationTime () + SSU_TO_INTRODUCER_SESSION_DURATION)
 				{
-					session->SendKeepAlive ();
+					GetService (it).post (std::bind (&SSUSession::SendKeepAlive, session));
 					newList.push_back (it);
 					numIntroducers++;
 				}
@@ -538,11 +763,13 @@ namespace transport
 
 	void SSUServer::NewPeerTest (uint32_t nonce, PeerTestParticipant role, std::shared_ptr<SSUSession> session)
 	{
+		std::unique_lock<std::mutex> l(m_PeerTestsMutex);
 		m_PeerTests[nonce] = { i2p::util::GetMillisecondsSinceEpoch (), role, session };
 	}
 
 	PeerTestParticipant SSUServer::GetPeerTestParticipant (uint32_t nonce)
 	{
+		std::unique_lock<std::mutex> l(m_PeerTestsMutex);
 		auto it = m_PeerTests.find (nonce);
 		if (it != m_PeerTests.end ())
 			return it->second.role;
@@ -552,6 +779,7 @@ namespace transport
 
 	std::shared_ptr<SSUSession> SSUServer::GetPeerTestSession (uint32_t nonce)
 	{
+		std::unique_lock<std::mutex> l(m_PeerTestsMutex);
 		auto it = m_PeerTests.find (nonce);
 		if (it != m_PeerTests.end ())
 			return it->second.session;
@@ -561,6 +789,7 @@ namespace transport
 
 	void SSUServer::UpdatePeerTest (uint32_t nonce, PeerTestParticipant role)
 	{
+		std::unique_lock<std::mutex> l(m_PeerTestsMutex);
 		auto it = m_PeerTests.find (nonce);
 		if (it != m_PeerTests.end ())
 			it->second.role = role;
@@ -568,6 +797,7 @@ namespace transport
 	
 	void SSUServer::RemovePeerTest (uint32_t nonce)
 	{
+		std::unique_lock<std::mutex> l(m_PeerTestsMutex);
 		m_PeerTests.erase (nonce);
 	}	
 
@@ -584,6 +814,7 @@ namespace transport
 		{
 			int numDeleted = 0;	
 			uint64_t ts = i2p::util::GetMillisecondsSinceEpoch ();	
+			std::unique_lock<std::mutex> l(m_PeerTestsMutex);
 			for (auto it = m_PeerTests.begin (); it != m_PeerTests.end ();)
 			{
 				if (ts > it->second.creationTime + SSU_PEER_TEST_TIMEOUT*1000LL)
@@ -594,6 +825,7 @@ namespace transport
 				else
 					it++;	 
 			}
+			l.unlock ();
 			if (numDeleted > 0)
 				LogPrint (eLogDebug, "SSU: ", numDeleted, " peer tests have been expired");
 			SchedulePeerTestsCleanupTimer ();
@@ -4,16 +4,19 @@
 #include <inttypes.h>
 #include <string.h>
 #include <map>
+#include <vector>
 #include <list>
 #include <set>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <boost/asio.hpp>
 #include "Crypto.h"
 #include "I2PEndian.h"
 #include "Identity.h"
 #include "RouterInfo.h"
 #include "I2NPProtocol.h"
+#include "Queue.h"
 #include "SSUSession.h"
 
 namespace i2p
@@ -24,19 +27,78 @@ namespace transport
 	const int SSU_PEER_TEST_TIMEOUT = 60; // 60 seconds		
 	const int SSU_TO_INTRODUCER_SESSION_DURATION = 3600; // 1 hour
 	const size_t SSU_MAX_NUM_INTRODUCERS = 3;
+	const size_t SSU_MAX_NUM_BATCHED_PACKETS = 32; // per recvmmsg/sendmmsg
+	const size_t SSU_PACKET_POOL_INITIAL_SIZE = 256;
+	const size_t SSU_PACKET_POOL_MAX_SIZE = 2048; // must be power of 2
 
 	struct SSUPacket
 	{
 		i2p::crypto::AESAlignedBuffer<1500> buf;
 		boost::asio::ip::udp::endpoint from;
 		size_t len;
+		SSUPacket * next; // received packets are handed to session thread as a chain
+	};	
+
+	// Received packets are acquired by receivers thread and released by session threads.
+	// Free list is a ring, so neither side allocates once the pool has warmed up
+	class SSUPacketPool
+	{
+		public:
+
+			SSUPacketPool ();
+			~SSUPacketPool ();
+
+			SSUPacket * Acquire (); // receivers thread only
+			void Release (SSUPacket * packet); // releases whole chain
+
+			size_t GetNumFree () const { return m_NumFree.load (std::memory_order_relaxed); };
+			size_t GetNumInUse () const { return m_NumInUse.load (std::memory_order_relaxed); };
+			uint64_t GetNumHits () const { return m_NumHits.load (std::memory_order_relaxed); };
+			uint64_t GetNumMisses () const { return m_NumMisses.load (std::memory_order_relaxed); };
+
+		private:
+
+			i2p::util::LockFreeQueue<SSUPacket *> m_FreePackets;
+			std::atomic<size_t> m_NumFree, m_NumInUse;
+			std::atomic<uint64_t> m_NumHits, m_NumMisses;
+	};	
+
+	// packets sent during one handler, flushed by one sendmmsg afterwards
+	struct SSUSendBatch
+	{
+		std::mutex mutex;
+		SSUPacket packets[SSU_MAX_NUM_BATCHED_PACKETS];
+		size_t numPackets = 0;
+	};	
+
+	const int SSU_MAX_NUM_SHARDS = 16;
+
+	// Sessions are spread over shards by hash of remote endpoint. Every shard has own socket,
+	// receive thread and processing thread. v4 sockets share the port with SO_REUSEPORT,
+	// received packets are passed to the shard owning the sender's session
+	struct SSUShard
+	{
+		SSUShard ();
+		~SSUShard ();
+
+		std::thread * thread, * receiversThread;
+		boost::asio::io_service service, receiversService;
+		boost::asio::io_service::work work, receiversWork;
+		boost::asio::ip::udp::socket socket;
+		std::map<boost::asio::ip::udp::endpoint, std::shared_ptr<SSUSession> > sessions;
+		mutable std::mutex sessionsMutex;
+		SSUPacketPool packetsPool; // acquired by receive thread, released by processing thread
+#ifdef __linux__
+		SSUPacket * receiveBatch[SSU_MAX_NUM_BATCHED_PACKETS];
+		SSUSendBatch sendBatch;
+#endif
 	};	
 	
 	class SSUServer
 	{
 		public:
 
-			SSUServer (int port);
+			SSUServer (int port, int numShards = 1);
 			~SSUServer ();
 			void Start ();
 			void Stop ();
@@ -50,8 +112,7 @@ namespace transport
 			void DeleteSession (std::shared_ptr<SSUSession> session);
 			void DeleteAllSessions ();			
 
-			boost::asio::io_service& GetService () { return m_Service; };
-			boost::asio::io_service& GetServiceV6 () { return m_ServiceV6; };
+			boost::asio::io_service& GetService (const boost::asio::ip::udp::endpoint& e) { return GetShard (e).service; };
 			const boost::asio::ip::udp::endpoint& GetEndpoint () const { return m_Endpoint; };			
 			void Send (const uint8_t * buf, size_t len, const boost::asio::ip::udp::endpoint& to);
 			void AddRelay (uint32_t tag, const boost::asio::ip::udp::endpoint& relay);
@@ -65,15 +126,20 @@ namespace transport
 
 		private:
 
-			void Run ();
-			void RunV6 ();
-			void RunReceivers ();
-			void Receive ();
-			void ReceiveV6 ();
-			void HandleReceivedFrom (const boost::system::error_code& ecode, std::size_t bytes_transferred, SSUPacket * packet);
-			void HandleReceivedFromV6 (const boost::system::error_code& ecode, std::size_t bytes_transferred, SSUPacket * packet);
-			void HandleReceivedPackets (std::vector<SSUPacket *> packets,
-				std::map<boost::asio::ip::udp::endpoint, std::shared_ptr<SSUSession> >* sessions);
+			SSUShard& GetShard (const boost::asio::ip::udp::endpoint& e) const;
+			void StartShard (SSUShard * shard);
+			void Run (SSUShard * shard);
+			void RunReceivers (SSUShard * shard);
+			void Receive (SSUShard * shard);
+			void HandleReceivedFrom (const boost::system::error_code& ecode, std::size_t bytes_transferred, 
+				SSUPacket * packet, SSUShard * shard);
+#ifdef __linux__
+			void HandleReceivedBatch (const boost::system::error_code& ecode, SSUShard * shard);
+			void FlushSendBatch (SSUShard * shard);
+			void SendBatch (SSUSendBatch& batch, boost::asio::ip::udp::socket& socket);
+#endif
+			void DispatchReceivedPackets (SSUPacket ** packets, size_t num);
+			void HandleReceivedPackets (SSUPacket * packets, SSUShard * shard);
 
 			void CreateSessionThroughIntroducer (std::shared_ptr<const i2p::data::RouterInfo> router, bool peerTest = false);			
 			template<typename Filter>
@@ -86,6 +152,9 @@ namespace transport
 			void SchedulePeerTestsCleanupTimer ();
 			void HandlePeerTestsCleanupTimer (const boost::system::error_code& ecode);
 
+			std::vector<SSUShard *> GetAllShards () const; // v4 and v6
+			static std::vector<std::unique_ptr<SSUShard> > CreateShards (int numShards);
+
 		private:
 
 			struct PeerTest
@@ -96,21 +165,25 @@ namespace transport
 			};	
 			
 			bool m_IsRunning;
-			std::thread * m_Thread, * m_ThreadV6, * m_ReceiversThread;	
-			boost::asio::io_service m_Service, m_ServiceV6, m_ReceiversService;
-			boost::asio::io_service::work m_Work, m_WorkV6, m_ReceiversWork;
 			boost::asio::ip::udp::endpoint m_Endpoint, m_EndpointV6;
-			boost::asio::ip::udp::socket m_Socket, m_SocketV6;
-			boost::asio::deadline_timer m_IntroducersUpdateTimer, m_PeerTestsCleanupTimer;
+			std::vector<std::unique_ptr<SSUShard> > m_Shards; // v4
+			std::unique_ptr<SSUShard> m_ShardV6;
+			boost::asio::deadline_timer m_IntroducersUpdateTimer, m_PeerTestsCleanupTimer; // in first shard
 			std::list<boost::asio::ip::udp::endpoint> m_Introducers; // introducers we are connected to
-			std::map<boost::asio::ip::udp::endpoint, std::shared_ptr<SSUSession> > m_Sessions, m_SessionsV6;
 			std::map<uint32_t, boost::asio::ip::udp::endpoint> m_Relays; // we are introducer
+			std::mutex m_RelaysMutex;
 			std::map<uint32_t, PeerTest> m_PeerTests; // nonce -> creation time in milliseconds
+			std::mutex m_PeerTestsMutex;
 
 		public:
 			// for HTTP only
-			const decltype(m_Sessions)& GetSessions () const { return m_Sessions; };
-			const decltype(m_SessionsV6)& GetSessionsV6 () const { return m_SessionsV6; };
+			std::vector<SSUShard *> GetShards () const 
+			{ 
+				std::vector<SSUShard *> shards;
+				for (auto& it: m_Shards) shards.push_back (it.get ());
+				return shards;
+			};
+			SSUShard * GetShardV6 () const { return m_ShardV6.get (); };
 	};
 }
 }
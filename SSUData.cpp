@@ -10,25 +10,79 @@ namespace i2p
 {
 namespace transport
 {
-	void IncompleteMessage::AttachNextFragment (const uint8_t * fragment, size_t fragmentSize)
+	bool IncompleteMessage::AddFragment (int fragmentNum, const uint8_t * fragment, size_t len, bool isLast)
 	{
-		if (msg->len + fragmentSize > msg->maxLen)
+		if (fragmentNum >= SSU_MAX_NUM_FRAGMENTS || receivedFragments.test (fragmentNum)) return false;
+		if (numFragments && (isLast || fragmentNum >= numFragments)) return false; // beyond last
+		if (isLast)
 		{
-			LogPrint (eLogWarning, "SSU: I2NP message size ", msg->maxLen, " is not enough");
-			auto newMsg = NewI2NPMessage ();
+			if ((receivedFragments >> fragmentNum).any ())
+			{
+				// otherwise count would match with some fragments below missing
+				LogPrint (eLogError, "SSU: Last fragment ", fragmentNum, " is before received ones");
+				return false;
+			}	
+			numFragments = fragmentNum + 1;
+			if (!fragmentNum || fragmentSize) 
+			{	
+				if (!CopyFragment (fragmentNum, fragment, len)) return false;
+			}	
+			else // can't place it yet, rare
+				lastFragment.reset (new Fragment (fragmentNum, fragment, len, true));
+		}
+		else
+		{
+			if (!fragmentSize)
+				fragmentSize = len;
+			else if (len != fragmentSize)
+			{
+				LogPrint (eLogError, "SSU: Fragment ", fragmentNum, " size ", len, " doesn't match ", fragmentSize);
+				return false;
+			}	
+			if (!CopyFragment (fragmentNum, fragment, len)) return false;
+			if (lastFragment)
+			{
+				bool copied = CopyFragment (lastFragment->fragmentNum, lastFragment->buf, lastFragment->len);
+				lastFragment = nullptr;
+				if (!copied) return false;
+			}	
+		}
+		receivedFragments.set (fragmentNum);
+		numReceivedFragments++;
+		lastFragmentInsertTime = i2p::util::GetSecondsSinceEpoch ();
+		return true;
+	}
+
+	bool IncompleteMessage::CopyFragment (int fragmentNum, const uint8_t * fragment, size_t len)
+	{
+		// fragments follow SSU header of I2NP message
+		size_t offset = msg->GetSSUHeader () - msg->buf + fragmentNum*fragmentSize;
+		if (offset + len > msg->maxLen)
+		{
+			LogPrint (eLogDebug, "SSU: I2NP message size ", msg->maxLen, " is not enough");
+			auto newMsg = NewI2NPMessage (2*(offset + len)); // more fragments are likely to come
 			*newMsg = *msg;
 			msg = newMsg;
+			offset = msg->GetSSUHeader () - msg->buf + fragmentNum*fragmentSize;
+			if (offset + len > msg->maxLen)
+			{
+				LogPrint (eLogError, "SSU: I2NP buffer overflow ", msg->maxLen);
+				return false;
+			}	
 		}
-		if (msg->Concat (fragment, fragmentSize) < fragmentSize)
-			LogPrint (eLogError, "SSU: I2NP buffer overflow ", msg->maxLen);
-		nextFragmentNum++;
+		memcpy (msg->buf + offset, fragment, len);
+		if (offset + len > msg->len) msg->len = offset + len;
+		return true;
 	}
 
 	SSUData::SSUData (SSUSession& session):
 		m_Session (session), m_ResendTimer (session.GetService ()), m_DecayTimer (session.GetService ()),
 		m_IncompleteMessagesCleanupTimer (session.GetService ()), 
 		m_MaxPacketSize (session.IsV6 () ? SSU_V6_MAX_PACKET_SIZE : SSU_V4_MAX_PACKET_SIZE), 
-		m_PacketSize (m_MaxPacketSize)
+		m_PacketSize (m_MaxPacketSize), m_ResendTimerTime (0), m_RTT (0), m_RTTVar (0), 
+		m_RTO (RESEND_INTERVAL*1000), m_WindowSize (SSU_INITIAL_WINDOW_SIZE), 
+		m_SlowStartThreshold (SSU_MAX_WINDOW_SIZE), m_NumAckedInWindow (0), m_NumFragmentsInFlight (0), 
+		m_LastWindowDecreaseTime (0), m_NextSendTime (0), m_NumSentFragments (0), m_NumResentFragments (0)
 	{
 	}
 
@@ -43,9 +97,11 @@ namespace transport
 		
 	void SSUData::Stop ()
 	{
-		m_ResendTimer.cancel ();
-		m_DecayTimer.cancel ();
-		m_IncompleteMessagesCleanupTimer.cancel ();
+		m_ResendTimer.Cancel ();
+		m_ResendTimerTime = 0;
+		m_OutgoingQueue.clear ();
+		m_DecayTimer.Cancel ();
+		m_IncompleteMessagesCleanupTimer.Cancel ();
 	}	
 		
 	void SSUData::AdjustPacketSize (std::shared_ptr<const i2p::data::RouterInfo> remoteRouter)
@@ -86,12 +142,74 @@ namespace transport
 		auto it = m_SentMessages.find (msgID);
 		if (it != m_SentMessages.end ())
 		{
+			uint64_t ts = i2p::util::GetMillisecondsSinceEpoch ();
+			if (!it->second->numResends) // Karn's algorithm, ambiguous otherwise
+				UpdateRTT (ts - it->second->sendTime);
+			int numFragments = 0;
+			for (auto& f: it->second->fragments)
+				if (f) numFragments++;
 			m_SentMessages.erase (it);	
-			if (m_SentMessages.empty ())
-				m_ResendTimer.cancel ();
+			ProcessFragmentsAck (numFragments, ts);
+			if (m_SentMessages.empty () && m_OutgoingQueue.empty ())
+			{	
+				m_ResendTimer.Cancel ();
+				m_ResendTimerTime = 0;
+			}	
 		}
 	}		
 
+	void SSUData::ProcessFragmentsAck (int numFragments, uint64_t ts)
+	{
+		m_NumFragmentsInFlight -= numFragments;
+		if (m_NumFragmentsInFlight < 0) m_NumFragmentsInFlight = 0;
+		if (m_WindowSize < m_SlowStartThreshold)
+			m_WindowSize += numFragments; // slow start
+		else
+		{
+			// congestion avoidance, one more fragment per window acked
+			m_NumAckedInWindow += numFragments;
+			if (m_NumAckedInWindow >= m_WindowSize)
+			{
+				m_NumAckedInWindow -= m_WindowSize;
+				m_WindowSize++;
+			}
+		}
+		if (m_WindowSize > SSU_MAX_WINDOW_SIZE) m_WindowSize = SSU_MAX_WINDOW_SIZE;
+		if (!m_OutgoingQueue.empty ())
+			SendQueuedMessages (ts);
+	}
+
+	void SSUData::UpdateRTT (int rtt)
+	{
+		if (rtt < 0) return;
+		if (!m_RTT)
+		{
+			m_RTT = rtt ? rtt : 1;
+			m_RTTVar = rtt/2;
+		}
+		else
+		{
+			m_RTTVar = (3*m_RTTVar + std::abs (m_RTT - rtt))/4;
+			m_RTT = (7*m_RTT + rtt)/8;
+			if (!m_RTT) m_RTT = 1;
+		}
+		m_RTO = m_RTT + 4*m_RTTVar;
+		if (m_RTO < SSU_MIN_RTO) m_RTO = SSU_MIN_RTO;
+		if (m_RTO > SSU_MAX_RTO) m_RTO = SSU_MAX_RTO;
+	}
+
+	void SSUData::DecreaseWindow (uint64_t ts)
+	{
+		// once per RTT, losses of the same window are one congestion event
+		if (ts < m_LastWindowDecreaseTime + (m_RTT ? m_RTT : m_RTO)) return;
+		m_LastWindowDecreaseTime = ts;
+		m_SlowStartThreshold = m_WindowSize/2;
+		if (m_SlowStartThreshold < SSU_MIN_WINDOW_SIZE) m_SlowStartThreshold = SSU_MIN_WINDOW_SIZE;
+		m_WindowSize = m_SlowStartThreshold;
+		m_NumAckedInWindow = 0;
+		LogPrint (eLogDebug, "SSU: window decreased to ", m_WindowSize, ", RTO=", m_RTO);
+	}
+
 	void SSUData::ProcessAcks (uint8_t *& buf, uint8_t flag)
 	{
 		if (flag & DATA_FLAG_EXPLICIT_ACKS_INCLUDED)
@@ -106,6 +224,7 @@ namespace transport
 		if (flag & DATA_FLAG_ACK_BITFIELDS_INCLUDED)
 		{
 			// explicit ACK bitfields
+			int numAckedFragments = 0;
 			uint8_t numBitfields =*buf;
 			buf++;
 			for (int i = 0; i < numBitfields; i++)
@@ -130,17 +249,24 @@ namespace transport
 						{			
 							if (bitfield & mask)
 							{
-								if (fragment < numSentFragments)
+								if (fragment < numSentFragments && it->second->fragments[fragment])
+								{	
 									it->second->fragments[fragment].reset (nullptr);
+									numAckedFragments++;
+								}	
 							}				
 							fragment++;
 							mask <<= 1;
 						}
 					}	
+					else
+						fragment += 7;
 					buf++;
 				}
 				while (isNonLast); 
 			}	
+			if (numAckedFragments)
+				ProcessFragmentsAck (numAckedFragments, i2p::util::GetMillisecondsSinceEpoch ());
 		}		
 	}
 
@@ -170,8 +296,8 @@ namespace transport
 			auto it = m_IncompleteMessages.find (msgID);
 			if (it == m_IncompleteMessages.end ()) 
 			{
-				// create new message
-				auto msg = NewI2NPShortMessage ();
+				// create new message, exact size if it's single fragment, or estimated from fragment's position
+				auto msg = NewI2NPMessage ((fragmentNum + (isLast ? 1 : 2))*fragmentSize);
 				msg->len -= I2NP_SHORT_HEADER_SIZE;
 				it = m_IncompleteMessages.insert (std::make_pair (msgID, 
 					std::unique_ptr<IncompleteMessage>(new IncompleteMessage (msg)))).first;
@@ -179,48 +305,13 @@ namespace transport
 			std::unique_ptr<IncompleteMessage>& incompleteMessage = it->second;
 
 			// handle current fragment
-			if (fragmentNum == incompleteMessage->nextFragmentNum)
-			{
-				// expected fragment
-				incompleteMessage->AttachNextFragment (buf, fragmentSize);
-				if (!isLast && !incompleteMessage->savedFragments.empty ())
-				{
-					// try saved fragments
-					for (auto it1 = incompleteMessage->savedFragments.begin (); it1 != incompleteMessage->savedFragments.end ();)
-					{
-						auto& savedFragment = *it1;
-						if (savedFragment->fragmentNum == incompleteMessage->nextFragmentNum)
-						{
-							incompleteMessage->AttachNextFragment (savedFragment->buf, savedFragment->len);
-							isLast = savedFragment->isLast;
-							incompleteMessage->savedFragments.erase (it1++);
-						}
-						else
-							break;
-					}
-					if (isLast)
-						LogPrint (eLogDebug, "SSU: Message ", msgID, " complete");
-				}	
-			}	
+			bool isComplete = false;
+			if (incompleteMessage->AddFragment (fragmentNum, buf, fragmentSize, isLast))
+				isComplete = incompleteMessage->IsComplete ();
 			else
-			{	
-				if (fragmentNum < incompleteMessage->nextFragmentNum)
-					// duplicate fragment
-					LogPrint (eLogWarning, "SSU: Duplicate fragment ", (int)fragmentNum, " of message ", msgID, ", ignored");
-				else
-				{
-					// missing fragment
-					LogPrint (eLogWarning, "SSU: Missing fragments from ", (int)incompleteMessage->nextFragmentNum, " to ", fragmentNum - 1, " of message ", msgID);
-					auto savedFragment = new Fragment (fragmentNum, buf, fragmentSize, isLast);
-					if (incompleteMessage->savedFragments.insert (std::unique_ptr<Fragment>(savedFragment)).second)
-						incompleteMessage->lastFragmentInsertTime = i2p::util::GetSecondsSinceEpoch ();
-					else	
-						LogPrint (eLogWarning, "SSU: Fragment ", (int)fragmentNum, " of message ", msgID, " already saved");
-				}
-				isLast = false;
-			}	
+				LogPrint (eLogWarning, "SSU: Duplicate or invalid fragment ", (int)fragmentNum, " of message ", msgID, ", ignored");
 
-			if (isLast)
+			if (isComplete)
 			{
 				// delete incomplete message
 				auto msg = incompleteMessage->msg;
@@ -291,23 +382,57 @@ namespace transport
 	}
 
 	void SSUData::Send (std::shared_ptr<i2p::I2NPMessage> msg)
+	{
+		if (m_OutgoingQueue.size () >= SSU_MAX_OUTGOING_QUEUE_SIZE)
+		{
+			LogPrint (eLogWarning, "SSU: outgoing queue is full, message dropped");
+			return;
+		}	
+		m_OutgoingQueue.push_back (msg);
+		SendQueuedMessages (i2p::util::GetMillisecondsSinceEpoch ());
+	}		
+
+	void SSUData::SendQueuedMessages (uint64_t ts)
+	{
+		while (!m_OutgoingQueue.empty ())
+		{
+			if (m_NumFragmentsInFlight >= m_WindowSize) return; // wait for acks
+			if (m_NextSendTime > ts*1000)
+			{
+				// too early, pacing
+				ScheduleResend (ts, m_NextSendTime/1000 + 1);
+				return;
+			}	
+			auto msg = m_OutgoingQueue.front ();
+			m_OutgoingQueue.pop_front ();
+			int numFragments = SendMessage (msg, ts);
+			if (m_RTT)
+			{
+				// spread window over RTT
+				if (m_NextSendTime < ts*1000) m_NextSendTime = ts*1000;
+				m_NextSendTime += (uint64_t)numFragments*m_RTT*1000/m_WindowSize;
+			}	
+		}	
+	}	
+
+	int SSUData::SendMessage (std::shared_ptr<i2p::I2NPMessage> msg, uint64_t ts)
 	{
 		uint32_t msgID = msg->ToSSU ();
 		if (m_SentMessages.count (msgID) > 0)
 		{
 			LogPrint (eLogWarning, "SSU: message ", msgID, " already sent");
-			return;
+			return 0;
 		}	
-		if (m_SentMessages.empty ()) // schedule resend at first message only
-			ScheduleResend ();
 		
 		auto ret = m_SentMessages.insert (std::make_pair (msgID, std::unique_ptr<SentMessage>(new SentMessage))); 
 		std::unique_ptr<SentMessage>& sentMessage = ret.first->second;
 		if (ret.second)	
 		{
-			sentMessage->nextResendTime = i2p::util::GetSecondsSinceEpoch () + RESEND_INTERVAL;
+			sentMessage->sendTime = ts;
+			sentMessage->nextResendTime = ts + m_RTO;
 			sentMessage->numResends = 0;
 		}	
+		ScheduleResend (ts, sentMessage->nextResendTime);
 		auto& fragments = sentMessage->fragments;
 		size_t payloadSize = m_PacketSize - sizeof (SSUHeader) - 9; // 9  =  flag + #frg(1) + messageID(4) + frag info (3) 
 		size_t len = msg->GetLength ();
@@ -363,6 +488,9 @@ namespace transport
 				len = 0;
 			fragmentNum++;
 		}	
+		m_NumFragmentsInFlight += fragmentNum;
+		m_NumSentFragments += fragmentNum;
+		return fragmentNum;
 	}		
 
 	void SSUData::SendMsgAck (uint32_t msgID)
@@ -411,12 +539,13 @@ namespace transport
 		m_Session.Send (buf, len);
 	}	
 
-	void SSUData::ScheduleResend()
+	void SSUData::ScheduleResend (uint64_t ts, uint64_t resendTime)
 	{		
-		m_ResendTimer.cancel ();
-		m_ResendTimer.expires_from_now (boost::posix_time::seconds(RESEND_INTERVAL));
+		// one timer for resends and pacing, moved only if needed earlier
+		if (m_ResendTimerTime && m_ResendTimerTime <= resendTime) return;
+		m_ResendTimerTime = resendTime;
 		auto s = m_Session.shared_from_this();
-		m_ResendTimer.async_wait ([s](const boost::system::error_code& ecode)
+		m_ResendTimer.AsyncWait (resendTime > ts ? resendTime - ts : 0, [s](const boost::system::error_code& ecode)
 			{ s->m_Data.HandleResendTimer (ecode); });
 	}
 
@@ -424,7 +553,9 @@ namespace transport
 	{
 		if (ecode != boost::asio::error::operation_aborted)
 		{
-			uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
+			m_ResendTimerTime = 0;
+			uint64_t ts = i2p::util::GetMillisecondsSinceEpoch (), nextResendTime = 0;
+			bool isLost = false;
 			for (auto it = m_SentMessages.begin (); it != m_SentMessages.end ();)
 			{
 				if (ts >= it->second->nextResendTime)
@@ -437,6 +568,7 @@ namespace transport
 								try
 								{	
 									m_Session.Send (f->buf, f->len); // resend
+									m_NumResentFragments++;
 								}
 								catch (boost::system::system_error& ec)
 								{
@@ -445,28 +577,35 @@ namespace transport
 							}	
 
 						it->second->numResends++;
-						it->second->nextResendTime += it->second->numResends*RESEND_INTERVAL;
-						it++;
+						// exponential backoff
+						uint64_t interval = (uint64_t)m_RTO << it->second->numResends;
+						if (interval > SSU_MAX_RTO) interval = SSU_MAX_RTO;
+						it->second->nextResendTime = ts + interval;
+						isLost = true;
 					}	
 					else
 					{
 						LogPrint (eLogError, "SSU: message has not been ACKed after ", MAX_NUM_RESENDS, " attempts, deleted");
+						for (auto& f: it->second->fragments)
+							if (f) m_NumFragmentsInFlight--;
 						it = m_SentMessages.erase (it);
+						continue;
 					}	
 				}	
-				else
-					it++;
+				if (!nextResendTime || it->second->nextResendTime < nextResendTime)
+					nextResendTime = it->second->nextResendTime;
+				it++;
 			}
-			ScheduleResend ();	
+			if (isLost) DecreaseWindow (ts);
+			if (nextResendTime) ScheduleResend (ts, nextResendTime);
+			SendQueuedMessages (ts);
 		}	
 	}	
 
 	void SSUData::ScheduleDecay ()
 	{		
-		m_DecayTimer.cancel ();
-		m_DecayTimer.expires_from_now (boost::posix_time::seconds(DECAY_INTERVAL));
 		auto s = m_Session.shared_from_this();
-		m_ResendTimer.async_wait ([s](const boost::system::error_code& ecode)
+		m_DecayTimer.AsyncWait (DECAY_INTERVAL*1000, [s](const boost::system::error_code& ecode)
 			{ s->m_Data.HandleDecayTimer (ecode); });
 	}	
 
@@ -478,10 +617,8 @@ namespace transport
 
 	void SSUData::ScheduleIncompleteMessagesCleanup ()
 	{
-		m_IncompleteMessagesCleanupTimer.cancel ();
-		m_IncompleteMessagesCleanupTimer.expires_from_now (boost::posix_time::seconds(INCOMPLETE_MESSAGES_CLEANUP_TIMEOUT));
 		auto s = m_Session.shared_from_this();
-		m_IncompleteMessagesCleanupTimer.async_wait ([s](const boost::system::error_code& ecode)
+		m_IncompleteMessagesCleanupTimer.AsyncWait (INCOMPLETE_MESSAGES_CLEANUP_TIMEOUT*1000, [s](const boost::system::error_code& ecode)
 			{ s->m_Data.HandleIncompleteMessagesCleanupTimer (ecode); });
 	}
 		
@@ -6,11 +6,14 @@
 #include <map>
 #include <vector>
 #include <set>
+#include <bitset>
+#include <deque>
 #include <memory>
 #include <boost/asio.hpp>
 #include "I2NPProtocol.h"
 #include "Identity.h"
 #include "RouterInfo.h"
+#include "TimerWheel.h"
 
 namespace i2p
 {
@@ -24,11 +27,18 @@ namespace transport
 	const size_t UDP_HEADER_SIZE = 8;
 	const size_t SSU_V4_MAX_PACKET_SIZE = SSU_MTU_V4 - IPV4_HEADER_SIZE - UDP_HEADER_SIZE; // 1456
 	const size_t SSU_V6_MAX_PACKET_SIZE = SSU_MTU_V6 - IPV6_HEADER_SIZE - UDP_HEADER_SIZE; // 1424
-	const int RESEND_INTERVAL = 3; // in seconds
+	const int RESEND_INTERVAL = 3; // in seconds, until first RTT sample
 	const int MAX_NUM_RESENDS = 5;
+	const int SSU_MIN_RTO = 200; // in milliseconds
+	const int SSU_MAX_RTO = 15000; // in milliseconds, resend interval never grows beyond
+	const int SSU_MIN_WINDOW_SIZE = 2; // in fragments
+	const int SSU_INITIAL_WINDOW_SIZE = 16; // in fragments
+	const int SSU_MAX_WINDOW_SIZE = 1024; // in fragments
+	const size_t SSU_MAX_OUTGOING_QUEUE_SIZE = 1024; // messages waiting for window
 	const int DECAY_INTERVAL = 20; // in seconds
 	const int INCOMPLETE_MESSAGES_CLEANUP_TIMEOUT = 30; // in seconds
 	const unsigned int MAX_NUM_RECEIVED_MESSAGES = 1000; // how many msgID we store for duplicates check
+	const int SSU_MAX_NUM_FRAGMENTS = 128; // fragment number is 7 bits
 	// data flags
 	const uint8_t DATA_FLAG_EXTENDED_DATA_INCLUDED = 0x02;
 	const uint8_t DATA_FLAG_WANT_REPLY = 0x04;
@@ -49,29 +59,29 @@ namespace transport
 			fragmentNum (n), len (l), isLast (last) { memcpy (buf, b, len); };		
 	};	
 
-	struct FragmentCmp
-	{
-		bool operator() (const std::unique_ptr<Fragment>& f1, const std::unique_ptr<Fragment>& f2) const
-  		{	
-			return f1->fragmentNum < f2->fragmentNum; 
-		};
-	};	
-	
+	// All fragments but last have the same size, so every fragment is copied
+	// to its final place in the message as soon as it arrives, in any order
 	struct IncompleteMessage
 	{
 		std::shared_ptr<I2NPMessage> msg;
-		int nextFragmentNum;	
+		size_t fragmentSize; // of all fragments but last, 0 if not known yet
+		int numFragments; // 0 until last fragment is received
+		int numReceivedFragments;
+		std::bitset<SSU_MAX_NUM_FRAGMENTS> receivedFragments;
+		std::unique_ptr<Fragment> lastFragment; // if received before fragment size is known
 		uint32_t lastFragmentInsertTime; // in seconds
-		std::set<std::unique_ptr<Fragment>, FragmentCmp> savedFragments;
 		
-		IncompleteMessage (std::shared_ptr<I2NPMessage> m): msg (m), nextFragmentNum (0), lastFragmentInsertTime (0) {};
-		void AttachNextFragment (const uint8_t * fragment, size_t fragmentSize);	
+		IncompleteMessage (std::shared_ptr<I2NPMessage> m): msg (m), fragmentSize (0), 
+			numFragments (0), numReceivedFragments (0), lastFragmentInsertTime (0) {};
+		bool AddFragment (int fragmentNum, const uint8_t * fragment, size_t len, bool isLast); // false if duplicate or invalid
+		bool IsComplete () const { return numFragments && numReceivedFragments == numFragments; }; // all received are below last
+		bool CopyFragment (int fragmentNum, const uint8_t * fragment, size_t len); // fragmentSize must be known
 	};
 
 	struct SentMessage
 	{
-		std::vector<std::unique_ptr<Fragment> > fragments;
-		uint32_t nextResendTime; // in seconds
+		std::vector<std::unique_ptr<Fragment> > fragments; // acked fragments are reset
+		uint64_t sendTime, nextResendTime; // in milliseconds
 		int numResends;
 	};	
 	
@@ -93,6 +103,13 @@ namespace transport
 			void AdjustPacketSize (std::shared_ptr<const i2p::data::RouterInfo> remoteRouter);	
 			void UpdatePacketSize (const i2p::data::IdentHash& remoteIdent);
 
+			int GetRTT () const { return m_RTT; }; // 0 if not measured yet
+			int GetRTO () const { return m_RTO; };
+			int GetWindowSize () const { return m_WindowSize; };
+			size_t GetOutgoingQueueSize () const { return m_OutgoingQueue.size (); };
+			uint64_t GetNumSentFragments () const { return m_NumSentFragments; };
+			uint64_t GetNumResentFragments () const { return m_NumResentFragments; };
+
 		private:
 
 			void SendMsgAck (uint32_t msgID);
@@ -100,8 +117,14 @@ namespace transport
 			void ProcessAcks (uint8_t *& buf, uint8_t flag);
 			void ProcessFragments (uint8_t * buf);
 			void ProcessSentMessageAck (uint32_t msgID);	
+			void ProcessFragmentsAck (int numFragments, uint64_t ts);
+
+			void SendQueuedMessages (uint64_t ts);
+			int SendMessage (std::shared_ptr<i2p::I2NPMessage> msg, uint64_t ts); // returns number of fragments
+			void UpdateRTT (int rtt);
+			void DecreaseWindow (uint64_t ts);
 
-			void ScheduleResend ();
+			void ScheduleResend (uint64_t ts, uint64_t resendTime);
 			void HandleResendTimer (const boost::system::error_code& ecode);	
 
 			void ScheduleDecay ();
@@ -116,9 +139,18 @@ namespace transport
 			SSUSession& m_Session;
 			std::map<uint32_t, std::unique_ptr<IncompleteMessage> > m_IncompleteMessages;
 			std::map<uint32_t, std::unique_ptr<SentMessage> > m_SentMessages;
+			std::deque<std::shared_ptr<i2p::I2NPMessage> > m_OutgoingQueue; // wait for window or pacing
 			std::set<uint32_t> m_ReceivedMessages;
-			boost::asio::deadline_timer m_ResendTimer, m_DecayTimer, m_IncompleteMessagesCleanupTimer;
+			i2p::util::WheelTimer m_ResendTimer, m_DecayTimer, m_IncompleteMessagesCleanupTimer;
 			int m_MaxPacketSize, m_PacketSize;
+			uint64_t m_ResendTimerTime; // in milliseconds, 0 if not scheduled
+			// RTT estimation as in RFC 6298, in milliseconds 
+			int m_RTT, m_RTTVar, m_RTO;
+			// congestion control with slow start and AIMD, in fragments
+			int m_WindowSize, m_SlowStartThreshold, m_NumAckedInWindow, m_NumFragmentsInFlight;
+			uint64_t m_LastWindowDecreaseTime; // in milliseconds
+			uint64_t m_NextSendTime; // in microseconds, packets are paced over RTT
+			uint64_t m_NumSentFragments, m_NumResentFragments;
 			i2p::I2NPMessagesHandler m_Handler;
 	};	
 }
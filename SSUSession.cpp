@@ -41,7 +41,7 @@ namespace transport
 
 	boost::asio::io_service& SSUSession::GetService () 
 	{ 
-		return IsV6 () ? m_Server.GetServiceV6 () : m_Server.GetService (); 
+		return m_Server.GetService (m_RemoteEndpoint); 
 	}
 	
 	void SSUSession::CreateAESandMacKey (const uint8_t * pubKey)
@@ -212,7 +212,7 @@ namespace transport
 		}
 
 		LogPrint (eLogDebug, "SSU message: session created");
-		m_Timer.cancel (); // connect timer
+		m_Timer.Cancel (); // connect timer
 		SignedData s; // x,y, our IP, our port, remote IP, remote port, relayTag, signed on time 
 		auto headerSize = GetSSUHeaderSize (buf);	
 		if (headerSize >= len)
@@ -622,7 +622,8 @@ namespace transport
 				LogPrint (eLogInfo, "SSU: RelayReponse connecting to endpoint ", remoteEndpoint);
 				if (i2p::context.GetRouterInfo ().UsesIntroducer ()) // if we are unreachable
 					m_Server.Send (buf, 0, remoteEndpoint); // send HolePunch
-				m_Server.CreateDirectSession (it->second, remoteEndpoint, false);
+				m_Server.GetService (remoteEndpoint).post (std::bind (&SSUServer::CreateDirectSession, 
+					&m_Server, it->second, remoteEndpoint, false));
 			}	
 			// delete request
 			m_RelayRequests.erase (it);
@@ -764,9 +765,7 @@ namespace transport
 
 	void SSUSession::ScheduleConnectTimer ()
 	{
-		m_Timer.cancel ();
-		m_Timer.expires_from_now (boost::posix_time::seconds(SSU_CONNECT_TIMEOUT));
-		m_Timer.async_wait (std::bind (&SSUSession::HandleConnectTimer,
+		m_Timer.AsyncWait (SSU_CONNECT_TIMEOUT*1000, std::bind (&SSUSession::HandleConnectTimer,
 			shared_from_this (), std::placeholders::_1));	
 }
 
@@ -786,8 +785,7 @@ namespace transport
 		if (m_State == eSessionStateUnknown)
 		{	
 			// set connect timer
-			m_Timer.expires_from_now (boost::posix_time::seconds(SSU_CONNECT_TIMEOUT));
-			m_Timer.async_wait (std::bind (&SSUSession::HandleConnectTimer,
+			m_Timer.AsyncWait (SSU_CONNECT_TIMEOUT*1000, std::bind (&SSUSession::HandleConnectTimer,
 				shared_from_this (), std::placeholders::_1));
 		}
 		uint32_t nonce;
@@ -800,8 +798,7 @@ namespace transport
 	{
 		m_State = eSessionStateIntroduced;
 		// set connect timer
-		m_Timer.expires_from_now (boost::posix_time::seconds(SSU_CONNECT_TIMEOUT));
-		m_Timer.async_wait (std::bind (&SSUSession::HandleConnectTimer,
+		m_Timer.AsyncWait (SSU_CONNECT_TIMEOUT*1000, std::bind (&SSUSession::HandleConnectTimer,
 			shared_from_this (), std::placeholders::_1));			
 	}
 
@@ -811,7 +808,7 @@ namespace transport
 		SendSesionDestroyed ();
 		transports.PeerDisconnected (shared_from_this ());
 		m_Data.Stop ();
-		m_Timer.cancel ();
+		m_Timer.Cancel ();
 	}	
 
 	void SSUSession::Done ()
@@ -843,9 +840,7 @@ namespace transport
 
 	void SSUSession::ScheduleTermination ()
 	{
-		m_Timer.cancel ();
-		m_Timer.expires_from_now (boost::posix_time::seconds(SSU_TERMINATION_TIMEOUT));
-		m_Timer.async_wait (std::bind (&SSUSession::HandleTerminationTimer,
+		m_Timer.AsyncWait (SSU_TERMINATION_TIMEOUT*1000, std::bind (&SSUSession::HandleTerminationTimer,
 			shared_from_this (), std::placeholders::_1));
 	}
 
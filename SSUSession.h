@@ -87,6 +87,7 @@ namespace transport
 			uint32_t GetRelayTag () const { return m_RelayTag; };	
 			const i2p::data::RouterInfo::IntroKey& GetIntroKey () const { return m_IntroKey; };
 			uint32_t GetCreationTime () const { return m_CreationTime; };
+			const SSUData& GetData () const { return m_Data; };
 
 			void FlushData ();
 			
@@ -135,7 +136,7 @@ namespace transport
 			friend class SSUData; // TODO: change in later
 			SSUServer& m_Server;
 			boost::asio::ip::udp::endpoint m_RemoteEndpoint;
-			boost::asio::deadline_timer m_Timer;
+			i2p::util::WheelTimer m_Timer;
 			bool m_IsPeerTest;
 			SessionState m_State;
 			bool m_IsSessionKey;
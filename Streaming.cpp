@@ -1,3 +1,5 @@
+#include <cstdlib>
+#include <chrono>
 #include <openssl/rand.h>
 #include "Log.h"
 #include "RouterInfo.h"
@@ -11,14 +13,71 @@ namespace i2p
 {
 namespace stream
 {
+	void SendRingBuffer::Grow (size_t size)
+	{
+		size_t capacity = m_Capacity ? m_Capacity : STREAM_SEND_BUFFER_SIZE;
+		while (capacity < size) capacity <<= 1;
+		uint8_t * buffer = new uint8_t[capacity];
+		size_t len = Get (buffer, m_Size); // linearize
+		m_Buffer.reset (buffer);
+		m_Capacity = capacity;
+		m_Head = 0;
+		m_Size = len;
+	}
+
+	void SendRingBuffer::Add (const uint8_t * buf, size_t len)
+	{
+		if (m_Size + len > m_Capacity) Grow (m_Size + len);
+		size_t tail = (m_Head + m_Size) % m_Capacity, l = m_Capacity - tail;
+		if (l > len) l = len;
+		memcpy (m_Buffer.get () + tail, buf, l);
+		memcpy (m_Buffer.get (), buf + l, len - l); // wrapped
+		m_Size += len;
+	}
+
+	size_t SendRingBuffer::Get (uint8_t * buf, size_t len)
+	{
+		if (len > m_Size) len = m_Size;
+		if (!len) return 0;
+		size_t l = m_Capacity - m_Head;
+		if (l > len) l = len;
+		memcpy (buf, m_Buffer.get () + m_Head, l);
+		memcpy (buf + l, m_Buffer.get (), len - l); // wrapped
+		m_Size -= len;
+		m_Head = (m_Size || m_IsPrepared) ? (m_Head + len) % m_Capacity : 0;
+		return len;
+	}
+
+	std::vector<boost::asio::mutable_buffer> SendRingBuffer::Prepare (size_t len)
+	{
+		if (!m_IsPrepared && (m_Size + len > m_Capacity || !m_Capacity)) Grow (m_Size + len);
+		m_IsPrepared = true;
+		std::vector<boost::asio::mutable_buffer> buffers;
+		size_t tail = (m_Head + m_Size) % m_Capacity, l = m_Capacity - tail;
+		if (len > m_Capacity - m_Size) len = m_Capacity - m_Size;
+		if (l > len) l = len;
+		buffers.push_back (boost::asio::buffer (m_Buffer.get () + tail, l));
+		if (len > l) buffers.push_back (boost::asio::buffer (m_Buffer.get (), len - l)); // wrapped
+		return buffers;
+	}
+
+	void SendRingBuffer::Commit (size_t len)
+	{
+		m_Size += len;
+		m_IsPrepared = false;
+	}
+
 	Stream::Stream (boost::asio::io_service& service, StreamingDestination& local, 
 		std::shared_ptr<const i2p::data::LeaseSet> remote, int port): m_Service (service),
 		m_SendStreamID (0), m_SequenceNumber (0), m_LastReceivedSequenceNumber (-1), 
 		m_Status (eStreamStatusNew), m_IsAckSendScheduled (false), m_LocalDestination (local), 
-		m_RemoteLeaseSet (remote), m_ReceiveTimer (m_Service), m_ResendTimer (m_Service), 
+		m_RemoteLeaseSet (remote), m_NumSavedPackets (0), m_LastSavedSequenceNumber (-1), m_ReceiveTimer (m_Service), m_ResendTimer (m_Service), 
 		m_AckSendTimer (m_Service),  m_NumSentBytes (0), m_NumReceivedBytes (0), m_Port (port), 
-		m_WindowSize (MIN_WINDOW_SIZE), m_RTT (INITIAL_RTT), m_RTO (INITIAL_RTO),
-		m_LastWindowSizeIncreaseTime (0), m_NumResendAttempts (0)
+		m_WindowSize (WINDOW_SIZE), m_SlowStartThreshold (MAX_WINDOW_SIZE), m_RTT (INITIAL_RTT), m_RTTVar (0), 
+		m_RTO (INITIAL_RTO), m_IsRTTMeasured (false), m_LastWindowSizeIncreaseTime (0), m_LastWindowSizeDecreaseTime (0),
+		m_NumResentPackets (0), m_NumResendAttempts (0),
+		m_NumPacketsToProbe (0), m_CompressionProbeInterval (COMPRESSION_MIN_PROBE_INTERVAL), m_NumCompressionSavedBytes (0),
+		m_DeflateTime (0), m_NumDeflatedPackets (0)
 	{
 		RAND_bytes ((uint8_t *)&m_RecvStreamID, 4);
 		m_RemoteIdentity = remote->GetIdentity ();
@@ -28,9 +87,12 @@ namespace stream
 	Stream::Stream (boost::asio::io_service& service, StreamingDestination& local):
 		m_Service (service), m_SendStreamID (0), m_SequenceNumber (0), m_LastReceivedSequenceNumber (-1), 
 		m_Status (eStreamStatusNew), m_IsAckSendScheduled (false), m_LocalDestination (local),
-		m_ReceiveTimer (m_Service), m_ResendTimer (m_Service), m_AckSendTimer (m_Service), 
-		m_NumSentBytes (0), m_NumReceivedBytes (0), m_Port (0),  m_WindowSize (MIN_WINDOW_SIZE), 
-		m_RTT (INITIAL_RTT), m_RTO (INITIAL_RTO), m_LastWindowSizeIncreaseTime (0), m_NumResendAttempts (0)
+		m_NumSavedPackets (0), m_LastSavedSequenceNumber (-1), m_ReceiveTimer (m_Service), m_ResendTimer (m_Service), m_AckSendTimer (m_Service), 
+		m_NumSentBytes (0), m_NumReceivedBytes (0), m_Port (0),  m_WindowSize (WINDOW_SIZE), 
+		m_SlowStartThreshold (MAX_WINDOW_SIZE), m_RTT (INITIAL_RTT), m_RTTVar (0), m_RTO (INITIAL_RTO), m_IsRTTMeasured (false),
+		m_LastWindowSizeIncreaseTime (0), m_LastWindowSizeDecreaseTime (0), m_NumResentPackets (0), m_NumResendAttempts (0),
+		m_NumPacketsToProbe (0), m_CompressionProbeInterval (COMPRESSION_MIN_PROBE_INTERVAL), m_NumCompressionSavedBytes (0),
+		m_DeflateTime (0), m_NumDeflatedPackets (0)
 	{
 		RAND_bytes ((uint8_t *)&m_RecvStreamID, 4);
 	}
@@ -41,16 +103,16 @@ namespace stream
 		while (!m_ReceiveQueue.empty ())
 		{
 			auto packet = m_ReceiveQueue.front ();
-			m_ReceiveQueue.pop ();
-			delete packet;
+			m_ReceiveQueue.pop_front ();
+			DeletePacket (packet);
 		}
 		
 		for (auto it: m_SentPackets)
-			delete it;
+			DeletePacket (it);
 		m_SentPackets.clear ();
 		
 		for (auto it: m_SavedPackets)
-			delete it;
+			if (it) DeletePacket (it);
 		m_SavedPackets.clear ();
 			
 		LogPrint (eLogDebug, "Streaming: Stream deleted");
@@ -58,9 +120,9 @@ namespace stream
 
 	void Stream::Terminate ()
 	{
-		m_AckSendTimer.cancel ();
-		m_ReceiveTimer.cancel ();
-		m_ResendTimer.cancel ();
+		m_AckSendTimer.Cancel ();
+		m_ReceiveTimer.Cancel ();
+		m_ResendTimer.Cancel ();
 		if (m_SendHandler) 
 		{
 			auto handler = m_SendHandler;
@@ -84,7 +146,7 @@ namespace stream
 		{
 			// plain ack
 			LogPrint (eLogDebug, "Streaming: Plain ACK received");
-			delete packet;
+			DeletePacket (packet);
 			return;
 		}
 
@@ -95,18 +157,8 @@ namespace stream
 			ProcessPacket (packet);
 			
 			// we should also try stored messages if any
-			for (auto it = m_SavedPackets.begin (); it != m_SavedPackets.end ();)
-			{			
-				if ((*it)->GetSeqn () == (uint32_t)(m_LastReceivedSequenceNumber + 1))
-				{
-					Packet * savedPacket = *it;
-					m_SavedPackets.erase (it++);
-
-					ProcessPacket (savedPacket);
-				}
-				else
-					break;
-			}
+			while (auto savedPacket = GetNextSavedPacket ())
+				ProcessPacket (savedPacket);
 
 			// schedule ack for last message
 			if (m_Status == eStreamStatusOpen)
@@ -114,8 +166,7 @@ namespace stream
 				if (!m_IsAckSendScheduled)
 				{
 					m_IsAckSendScheduled = true;
-					m_AckSendTimer.expires_from_now (boost::posix_time::milliseconds(ACK_SEND_TIMEOUT));
-					m_AckSendTimer.async_wait (std::bind (&Stream::HandleAckSendTimer,
+					m_AckSendTimer.AsyncWait (ACK_SEND_TIMEOUT, std::bind (&Stream::HandleAckSendTimer,
 						shared_from_this (), std::placeholders::_1));
 				}
 			}	
@@ -130,7 +181,7 @@ namespace stream
 				// we have received duplicate
 				LogPrint (eLogWarning, "Streaming: Duplicate message ", receivedSeqn, " received");
 				SendQuickAck (); // resend ack for previous message again
-				delete packet; // packet dropped
+				DeletePacket (packet); // packet dropped
 			}	
 			else
 			{
@@ -143,7 +194,7 @@ namespace stream
 					if (m_IsAckSendScheduled)
 					{
 						m_IsAckSendScheduled = false;	
-						m_AckSendTimer.cancel ();
+						m_AckSendTimer.Cancel ();
 					}
 					SendQuickAck ();
 				}	
@@ -151,8 +202,7 @@ namespace stream
 				{
 					// wait for SYN
 					m_IsAckSendScheduled = true;
-					m_AckSendTimer.expires_from_now (boost::posix_time::milliseconds(ACK_SEND_TIMEOUT));
-					m_AckSendTimer.async_wait (std::bind (&Stream::HandleAckSendTimer,
+					m_AckSendTimer.AsyncWait (ACK_SEND_TIMEOUT, std::bind (&Stream::HandleAckSendTimer,
 						shared_from_this (), std::placeholders::_1));
 				}			
 			}	
@@ -161,9 +211,38 @@ namespace stream
 
 	void Stream::SavePacket (Packet * packet)
 	{
-		m_SavedPackets.insert (packet);
+		int32_t seqn = packet->GetSeqn ();
+		if (seqn - m_LastReceivedSequenceNumber > MAX_WINDOW_SIZE)
+		{
+			LogPrint (eLogWarning, "Streaming: seqn ", seqn, " is beyond window, dropped");
+			DeletePacket (packet);
+			return;
+		}	
+		if (m_SavedPackets.empty ()) m_SavedPackets.resize (MAX_WINDOW_SIZE, nullptr);
+		auto& slot = m_SavedPackets[seqn % MAX_WINDOW_SIZE];
+		if (slot)
+		{
+			DeletePacket (packet); // duplicate
+			return;
+		}	
+		slot = packet;
+		m_NumSavedPackets++;
+		if (seqn > m_LastSavedSequenceNumber) m_LastSavedSequenceNumber = seqn;
 	}	
 
+	Packet * Stream::GetNextSavedPacket ()
+	{
+		if (!m_NumSavedPackets) return nullptr;
+		auto& slot = m_SavedPackets[(m_LastReceivedSequenceNumber + 1) % MAX_WINDOW_SIZE];
+		auto packet = slot;
+		if (packet)
+		{
+			slot = nullptr;
+			m_NumSavedPackets--;
+		}	
+		return packet;
+	}
+
 	void Stream::ProcessPacket (Packet * packet)
 	{
 		// process flags
@@ -210,11 +289,11 @@ namespace stream
 		packet->offset = packet->GetPayload () - packet->buf;
 		if (packet->GetLength () > 0)
 		{	
-			m_ReceiveQueue.push (packet);
-			m_ReceiveTimer.cancel ();
+			m_ReceiveQueue.push_back (packet);
+			m_ReceiveTimer.Cancel ();
 		}	
 		else
-			delete packet;
+			DeletePacket (packet);
 		
 		m_LastReceivedSequenceNumber = receivedSeqn;
 
@@ -231,7 +310,9 @@ namespace stream
 		auto ts = i2p::util::GetMillisecondsSinceEpoch ();
 		uint32_t ackThrough = packet->GetAckThrough ();
 		int nackCount = packet->GetNACKCount ();
-		for (auto it = m_SentPackets.begin (); it != m_SentPackets.end ();)
+		std::vector<Packet *> nackedPackets;
+		auto it = m_SentPackets.begin (), kept = it; // NACKed packets are moved to kept
+		for (; it != m_SentPackets.end (); it++)
 		{			
 			auto seqn = (*it)->GetSeqn ();
 			if (seqn <= ackThrough)
@@ -248,36 +329,48 @@ namespace stream
 					if (nacked)
 					{
 						LogPrint (eLogDebug, "Streaming: Packet ", seqn, " NACK");
-						it++;
+						// fast retransmit, unless it was resent within last RTT already
+						if (ts >= (*it)->sendTime + m_RTT)
+						{
+							(*it)->sendTime = ts;
+							(*it)->isResent = true;
+							nackedPackets.push_back (*it);
+						}
+						*kept++ = *it;
 						continue;
 					}	
 				}
 				auto sentPacket = *it;
-				uint64_t rtt = ts - sentPacket->sendTime;
-				m_RTT = (m_RTT*seqn + rtt)/(seqn + 1);
-				m_RTO = m_RTT*1.5; // TODO: implement it better
-				LogPrint (eLogDebug, "Packet ", seqn, " acknowledged rtt=", rtt);
-				m_SentPackets.erase (it++);
-				delete sentPacket;	
+				if (!sentPacket->isResent) // Karn's algorithm
+					UpdateRTT (ts - sentPacket->sendTime);
+				LogPrint (eLogDebug, "Packet ", seqn, " acknowledged rtt=", ts - sentPacket->sendTime);
+				DeletePacket (sentPacket);	
 				acknowledged = true;
-				if (m_WindowSize < WINDOW_SIZE)
-					m_WindowSize++; // slow start
+				if (m_WindowSize < m_SlowStartThreshold)
+					m_WindowSize++; // slow start, doubles every RTT
 				else
 				{
 					// linear growth
 					if (ts > m_LastWindowSizeIncreaseTime + m_RTT)
 					{
 						m_WindowSize++;
-						if (m_WindowSize > MAX_WINDOW_SIZE) m_WindowSize = MAX_WINDOW_SIZE;
 						m_LastWindowSizeIncreaseTime = ts;
 					}
 				}
+				if (m_WindowSize > MAX_WINDOW_SIZE) m_WindowSize = MAX_WINDOW_SIZE;
 			}
 			else
 				break;
 		}
+		m_SentPackets.erase (kept, it);
+		if (!nackedPackets.empty ())
+		{
+			DecreaseWindow (ts);
+			m_NumResentPackets += nackedPackets.size ();
+			SendPackets (nackedPackets);
+		}	
 		if (m_SentPackets.empty ())
-			m_ResendTimer.cancel ();
+			m_ResendTimer.Cancel ();
 		if (acknowledged)
 		{
 			m_NumResendAttempts = 0;
@@ -286,14 +379,42 @@ namespace stream
 		if (m_Status == eStreamStatusClosing)
 			Close (); // all outgoing messages have been sent
 	}		
+
+	void Stream::UpdateRTT (int rtt)
+	{
+		// RFC 6298
+		if (m_IsRTTMeasured)
+		{
+			m_RTTVar = (3*m_RTTVar + std::abs (m_RTT - rtt))/4;
+			m_RTT = (7*m_RTT + rtt)/8;
+		}
+		else
+		{
+			m_RTT = rtt;
+			m_RTTVar = rtt/2;
+			m_IsRTTMeasured = true;
+		}
+		m_RTO = m_RTT + 4*m_RTTVar;
+		if (m_RTO < MIN_RTO) m_RTO = MIN_RTO;
+		if (m_RTO > MAX_RTO) m_RTO = MAX_RTO;
+	}
+
+	void Stream::DecreaseWindow (uint64_t ts)
+	{
+		// once per RTT, losses of the same window count as one
+		if (ts < m_LastWindowSizeDecreaseTime + m_RTT) return;
+		m_SlowStartThreshold = m_WindowSize/2;
+		if (m_SlowStartThreshold < 2*MIN_WINDOW_SIZE) m_SlowStartThreshold = 2*MIN_WINDOW_SIZE;
+		m_WindowSize = m_SlowStartThreshold;
+		m_LastWindowSizeDecreaseTime = ts;
+	}
 		
 	size_t Stream::Send (const uint8_t * buf, size_t len)
 	{
 		if (len > 0 && buf)
 		{
 			std::unique_lock<std::mutex> l(m_SendBufferMutex);
-			m_SendBuffer.clear ();
-			m_SendBuffer.write ((const char *)buf, len);
+			m_SendBuffer.Add (buf, len);
 		}	
 		m_Service.post (std::bind (&Stream::SendBuffer, shared_from_this ()));
 		return len;
@@ -308,6 +429,21 @@ namespace stream
 		Send (buf, len);
 	}
 
+	std::vector<boost::asio::mutable_buffer> Stream::PrepareSend (size_t len)
+	{
+		std::unique_lock<std::mutex> l(m_SendBufferMutex);
+		return m_SendBuffer.Prepare (len);
+	}
+
+	void Stream::AsyncCommitSend (size_t len, SendHandler handler)
+	{
+		{
+			std::unique_lock<std::mutex> l(m_SendBufferMutex);
+			m_SendBuffer.Commit (len);
+		}
+		AsyncSend (nullptr, 0, handler);
+	}
+
 	void Stream::SendBuffer ()
 	{	
 		int numMsgs = m_WindowSize - m_SentPackets.size ();
@@ -315,11 +451,12 @@ namespace stream
 		
 		bool isNoAck = m_LastReceivedSequenceNumber < 0; // first packet
 		std::vector<Packet *> packets;
+		SendHandler sendHandler;
 		{
 			std::unique_lock<std::mutex> l(m_SendBufferMutex);
-			while ((m_Status == eStreamStatusNew) || (IsEstablished () && !m_SendBuffer.eof () && numMsgs > 0))
+			while ((m_Status == eStreamStatusNew) || (IsEstablished () && !m_SendBuffer.IsEmpty () && numMsgs > 0))
 			{
-				Packet * p = new Packet ();
+				Packet * p = NewPacket ();
 				uint8_t * packet = p->GetBuffer ();
 				// TODO: implement setters
 				size_t size = 0;
@@ -358,8 +495,7 @@ namespace stream
 					uint8_t * signature = packet + size; // set it later
 					memset (signature, 0, signatureLen); // zeroes for now
 					size += signatureLen; // signature
-					m_SendBuffer.read ((char *)(packet + size), STREAMING_MTU - size);
-					size += m_SendBuffer.gcount (); // payload
+					size += m_SendBuffer.Get (packet + size, STREAMING_MTU - size); // payload
 					m_LocalDestination.GetOwner ()->Sign (packet, size, signature);
 				}	
 				else
@@ -369,32 +505,33 @@ namespace stream
 					size += 2; // flags
 					htobuf16 (packet + size, 0); // no options
 					size += 2; // options size
-					m_SendBuffer.read((char *)(packet + size), STREAMING_MTU - size);  
-					size += m_SendBuffer.gcount (); // payload
+					size += m_SendBuffer.Get (packet + size, STREAMING_MTU - size); // payload
 				}	
 				p->len = size;
 				packets.push_back (p);
 				numMsgs--;
 			}
-			if (m_SendBuffer.eof () && m_SendHandler)
+			// let caller write more while the rest is being sent
+			if (m_SendHandler && m_SendBuffer.GetSize () < STREAM_SEND_BUFFER_SIZE/2)
 			{
-				m_SendHandler (boost::system::error_code ());
+				sendHandler = m_SendHandler;
 				m_SendHandler = nullptr;
 			}
 		}	
+		if (sendHandler) sendHandler (boost::system::error_code ()); // unlocked, might call PrepareSend
 		if (packets.size () > 0)
 		{
 			m_IsAckSendScheduled = false;	
-			m_AckSendTimer.cancel ();
+			m_AckSendTimer.Cancel ();
 			bool isEmpty = m_SentPackets.empty ();
 			auto ts = i2p::util::GetMillisecondsSinceEpoch ();
 			for (auto it: packets)
 			{
 				it->sendTime = ts;
-				m_SentPackets.insert (it);
+				m_SentPackets.push_back (it);
 			}
 			SendPackets (packets);
-			if (m_Status == eStreamStatusClosing && m_SendBuffer.eof ())
+			if (m_Status == eStreamStatusClosing && m_SendBuffer.IsEmpty ())
 				SendClose ();
 			if (isEmpty)
 				ScheduleResend ();
@@ -404,11 +541,8 @@ namespace stream
 	void Stream::SendQuickAck ()
 	{
 		int32_t lastReceivedSeqn = m_LastReceivedSequenceNumber;
-		if (!m_SavedPackets.empty ())
-		{
-			int32_t seqn = (*m_SavedPackets.rbegin ())->GetSeqn ();
-			if (seqn > lastReceivedSeqn) lastReceivedSeqn = seqn;
-		}	
+		if (m_NumSavedPackets > 0 && m_LastSavedSequenceNumber > lastReceivedSeqn)
+			lastReceivedSeqn = m_LastSavedSequenceNumber;
 		if (lastReceivedSeqn < 0) 
 		{	
 			LogPrint (eLogError, "Streaming: No packets have been received yet");
@@ -431,23 +565,18 @@ namespace stream
 		{	
 			// fill NACKs
 			uint8_t * nacks = packet + size + 1;
-			auto nextSeqn = m_LastReceivedSequenceNumber + 1;
-			for (auto it: m_SavedPackets)
+			for (int32_t seqn = m_LastReceivedSequenceNumber + 1; seqn < lastReceivedSeqn; seqn++)
 			{
-				auto seqn = it->GetSeqn ();
-				if (numNacks + (seqn - nextSeqn) >= 256)
+				if (m_SavedPackets[seqn % MAX_WINDOW_SIZE]) continue; // received
+				if (numNacks == 255)
 				{
-					LogPrint (eLogError, "Number of NACKs exceeds 256. seqn=", seqn, " nextSeqn=", nextSeqn);
-					htobe32buf (packet + 12, nextSeqn); // change ack Through
+					LogPrint (eLogError, "Number of NACKs exceeds 255. seqn=", seqn);
+					htobe32buf (packet + 12, seqn - 1); // change ack Through
 					break;
 				}	
-				for (uint32_t i = nextSeqn; i < seqn; i++)
-				{
-					htobe32buf (nacks, i);
-					nacks += 4;
-					numNacks++;
-				}	
-				nextSeqn = seqn + 1;
+				htobe32buf (nacks, seqn);
+				nacks += 4;
+				numNacks++;
 			}
 			packet[size] = numNacks; 
 			size++; // NACK count	
@@ -486,7 +615,7 @@ namespace stream
 				m_LocalDestination.DeleteStream (shared_from_this ());	
 			break;
 			case eStreamStatusClosing:
-				if (m_SentPackets.empty () && m_SendBuffer.eof ()) // nothing to send
+				if (m_SentPackets.empty () && m_SendBuffer.IsEmpty ()) // nothing to send
 				{
 					m_Status = eStreamStatusClosed;
 					SendClose ();
@@ -506,7 +635,7 @@ namespace stream
 
 	void Stream::SendClose ()
 	{
-		Packet * p = new Packet ();
+		Packet * p = NewPacket ();
 		uint8_t * packet = p->GetBuffer ();
 		size_t size = 0;
 		htobe32buf (packet + size, m_SendStreamID);
@@ -542,18 +671,37 @@ namespace stream
 		{
 			Packet * packet = m_ReceiveQueue.front ();
 			size_t l = std::min (packet->GetLength (), len - pos);
-			memcpy (buf + pos, packet->GetBuffer (), l);
+			if (buf) memcpy (buf + pos, packet->GetBuffer (), l);
 			pos += l;
 			packet->offset += l;
 			if (!packet->GetLength ())
 			{
-				m_ReceiveQueue.pop ();
-				delete packet;
+				m_ReceiveQueue.pop_front ();
+				DeletePacket (packet);
 			}	
 		}	
 		return pos; 
 	}
 
+	size_t Stream::GetReceivedBuffers (std::vector<boost::asio::const_buffer>& buffers, size_t len)
+	{
+		size_t pos = 0;
+		for (auto it = m_ReceiveQueue.begin (); pos < len && it != m_ReceiveQueue.end (); it++)
+		{
+			size_t l = std::min ((*it)->GetLength (), len - pos);
+			buffers.push_back (boost::asio::buffer ((*it)->GetBuffer (), l));
+			pos += l;
+		}
+		return pos;
+	}
+
+	void Stream::Consume (size_t len)
+	{
+		// might be called from socket's thread
+		auto s = shared_from_this ();
+		m_Service.post ([s, len](void) { s->ConcatenatePackets (nullptr, len); });
+	}
+
 	bool Stream::SendPacket (Packet * packet)
 	{
 		if (packet)
@@ -561,18 +709,18 @@ namespace stream
 			if (m_IsAckSendScheduled)
 			{
 				m_IsAckSendScheduled = false;	
-				m_AckSendTimer.cancel ();
+				m_AckSendTimer.Cancel ();
 			}
 			SendPackets (std::vector<Packet *> { packet });
 			if (m_Status == eStreamStatusOpen)
 			{	
 				bool isEmpty = m_SentPackets.empty ();
-				m_SentPackets.insert (packet);
+				m_SentPackets.push_back (packet);
 				if (isEmpty)
 					ScheduleResend ();
 			}	
 			else
-				delete packet;
+				DeletePacket (packet);
 			return true;	
 		}	
 		else
@@ -624,9 +772,7 @@ namespace stream
 		
 	void Stream::ScheduleResend ()
 	{
-		m_ResendTimer.cancel ();
-		m_ResendTimer.expires_from_now (boost::posix_time::milliseconds(m_RTO));
-		m_ResendTimer.async_wait (std::bind (&Stream::HandleResendTimer,
+		m_ResendTimer.AsyncWait (m_RTO, std::bind (&Stream::HandleResendTimer,
 			shared_from_this (), std::placeholders::_1));
 	}
 		
@@ -651,6 +797,7 @@ namespace stream
 				if (ts >= it->sendTime + m_RTO)
 				{
 					it->sendTime = ts;
+					it->isResent = true;
 					packets.push_back (it);
 				}					
 			}	
@@ -659,15 +806,19 @@ namespace stream
 			if (packets.size () > 0)
 			{
 				m_NumResendAttempts++;
-				m_RTO *= 2;
+				m_NumResentPackets += packets.size ();
+				m_RTO *= 2; // backoff
+				if (m_RTO > MAX_RTO) m_RTO = MAX_RTO;
+				// timeout, start over with slow start
+				m_SlowStartThreshold = m_WindowSize/2;
+				if (m_SlowStartThreshold < 2*MIN_WINDOW_SIZE) m_SlowStartThreshold = 2*MIN_WINDOW_SIZE;
+				m_WindowSize = MIN_WINDOW_SIZE;
+				m_LastWindowSizeDecreaseTime = ts;
 				switch (m_NumResendAttempts)
 				{	
-					case 1: // congesion avoidance
-						m_WindowSize /= 2;
-						if (m_WindowSize < MIN_WINDOW_SIZE) m_WindowSize = MIN_WINDOW_SIZE;
-					break;
 					case 2:
 						m_RTO = INITIAL_RTO; // drop RTO to initial upon tunnels pair change first time
+						m_IsRTTMeasured = false; // new path
 						// no break here
 					case 4:	
 						UpdateCurrentRemoteLease (); // pick another lease
@@ -758,14 +909,43 @@ namespace stream
 	std::shared_ptr<I2NPMessage> Stream::CreateDataMessage (const uint8_t * payload, size_t len)
 	{
 		auto msg = NewI2NPShortMessage ();
-		if (len <= i2p::stream::COMPRESSION_THRESHOLD_SIZE)
-			m_LocalDestination.m_Deflator.SetCompressionLevel (Z_NO_COMPRESSION);
-		else
-			m_LocalDestination.m_Deflator.SetCompressionLevel (Z_DEFAULT_COMPRESSION);
+		bool compress = false;
+		if (len > i2p::stream::COMPRESSION_THRESHOLD_SIZE)
+		{
+			if (m_NumPacketsToProbe > 0)
+				m_NumPacketsToProbe--; // incompressible so far, send stored
+			else
+				compress = true;
+		}
+		m_LocalDestination.m_Deflator.SetCompressionLevel (compress ? Z_DEFAULT_COMPRESSION : Z_NO_COMPRESSION);
 		uint8_t * buf = msg->GetPayload ();
 		buf += 4; // reserve for lengthlength
 		msg->len += 4;
-		size_t size = m_LocalDestination.m_Deflator.Deflate (payload, len, buf, msg->maxLen - msg->len);
+		size_t size;
+		if (compress)
+		{
+			auto start = std::chrono::steady_clock::now ();
+			size = m_LocalDestination.m_Deflator.Deflate (payload, len, buf, msg->maxLen - msg->len);
+			m_DeflateTime += std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now () - start).count ();
+			m_NumDeflatedPackets++;
+			if (size)
+			{
+				m_NumCompressionSavedBytes += (int64_t)len - (int64_t)size;
+				if (size*100 > len*COMPRESSION_MAX_RATIO)
+				{
+					// TLS, images, torrents. Try again later, less often each time
+					m_NumPacketsToProbe = m_CompressionProbeInterval;
+					if (m_CompressionProbeInterval < COMPRESSION_MAX_PROBE_INTERVAL)
+						m_CompressionProbeInterval <<= 1;
+					LogPrint (eLogDebug, "Streaming: payload is incompressible, stored blocks for next ", m_NumPacketsToProbe, " packets");
+				}
+				else
+					m_CompressionProbeInterval = COMPRESSION_MIN_PROBE_INTERVAL;
+			}
+		}
+		else
+			size = m_LocalDestination.m_Deflator.Deflate (payload, len, buf, msg->maxLen - msg->len);
 		if (size)
 		{
 			htobe32buf (msg->GetPayload (), size); // length
@@ -814,7 +994,7 @@ namespace stream
 			else
 			{	
 				LogPrint (eLogError, "Streaming: Unknown stream sendStreamID=", sendStreamID);
-				delete packet;
+				DeletePacket (packet);
 			}
 		}	
 		else 
@@ -856,7 +1036,7 @@ namespace stream
 					}
 				// TODO: should queue it up
 				LogPrint (eLogError, "Streaming: Unknown stream receiveStreamID=", receiveStreamID);
-				delete packet;
+				DeletePacket (packet);
 			}	
 		}	
 	}	
@@ -921,13 +1101,13 @@ namespace stream
 	void StreamingDestination::HandleDataMessagePayload (const uint8_t * buf, size_t len)
 	{
 		// unzip it
-		Packet * uncompressed = new Packet;
+		Packet * uncompressed = NewPacket ();
 		uncompressed->offset = 0;
 		uncompressed->len = m_Inflator.Inflate (buf, len, uncompressed->buf, MAX_PACKET_SIZE);
 		if (uncompressed->len)
 			HandleNextPacket (uncompressed); 
 		else
-			delete uncompressed;
+			DeletePacket (uncompressed);
 	}
 }		
 }	
@@ -3,10 +3,9 @@
 
 #include <inttypes.h>
 #include <string>
-#include <sstream>
 #include <map>
 #include <set>
-#include <queue>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
@@ -18,6 +17,8 @@
 #include "I2NPProtocol.h"
 #include "Garlic.h"
 #include "Tunnel.h"
+#include "TimerWheel.h"
+#include "MemoryPool.h"
 
 namespace i2p
 {
@@ -42,23 +43,31 @@ namespace stream
 	const size_t STREAMING_MTU = 1730;
 	const size_t MAX_PACKET_SIZE = 4096;
 	const size_t COMPRESSION_THRESHOLD_SIZE = 66;	
+	const size_t COMPRESSION_MAX_RATIO = 90; // in percents of original size, worse means incompressible
+	const int COMPRESSION_MIN_PROBE_INTERVAL = 16; // in packets sent uncompressed before next try
+	const int COMPRESSION_MAX_PROBE_INTERVAL = 1024; // doubled after each failed try
 	const int ACK_SEND_TIMEOUT = 200; // in milliseconds
 	const int MAX_NUM_RESEND_ATTEMPTS = 6;	
-	const int WINDOW_SIZE = 6; // in messages
+	const int WINDOW_SIZE = 6; // in messages, initial
 	const int MIN_WINDOW_SIZE = 1;
-	const int MAX_WINDOW_SIZE = 128;		
+	const int MAX_WINDOW_SIZE = 512;		
 	const int INITIAL_RTT = 8000; // in milliseconds
 	const int INITIAL_RTO = 9000; // in milliseconds
+	const int MIN_RTO = 100; // in milliseconds
+	const int MAX_RTO = 60000; // in milliseconds
 	const size_t MAX_PENDING_INCOMING_BACKLOG = 128;
 	const int PENDING_INCOMING_TIMEOUT = 10; // in seconds
+	const size_t STREAM_SEND_BUFFER_SIZE = 65536; // AsyncSend completes when less than half is used
+	const size_t STREAMING_MAX_FREE_PACKETS = 256; // per thread
 	
 	struct Packet
 	{
 		size_t len, offset;
 		uint8_t buf[MAX_PACKET_SIZE];	
 		uint64_t sendTime;
+		bool isResent; // not used for RTT
 		
-		Packet (): len (0), offset (0), sendTime (0) {};
+		Packet (): len (0), offset (0), sendTime (0), isResent (false) {};
 		uint8_t * GetBuffer () { return buf + offset; };
 		size_t GetLength () const { return len - offset; };
 
@@ -78,13 +87,37 @@ namespace stream
 		bool IsNoAck () const { return GetFlags () & PACKET_FLAG_NO_ACK; };
 	};	
 
-	struct PacketCmp
+	// recycled by thread running destination
+	typedef i2p::util::MemoryPool<Packet, STREAMING_MAX_FREE_PACKETS> PacketsPool;
+	inline Packet * NewPacket () { return PacketsPool::Acquire (); };
+	inline void DeletePacket (Packet * packet) { PacketsPool::Release (packet); };
+
+	// application data waiting for packets, grows if Send doesn't fit
+	class SendRingBuffer
 	{
-		bool operator() (const Packet * p1, const Packet * p2) const
-  		{	
-			return p1->GetSeqn () < p2->GetSeqn (); 
-		};
-	};	
+		public:
+
+			SendRingBuffer (): m_Capacity (0), m_Head (0), m_Size (0), m_IsPrepared (false) {};
+
+			void Add (const uint8_t * buf, size_t len);
+			size_t Get (uint8_t * buf, size_t len); // returns number of bytes copied
+			size_t GetSize () const { return m_Size; };
+			bool IsEmpty () const { return !m_Size; };
+
+			// zero-copy Add, caller writes to free space directly. No Add until Commit
+			std::vector<boost::asio::mutable_buffer> Prepare (size_t len);
+			void Commit (size_t len);
+
+		private:
+
+			void Grow (size_t size);
+
+		private:
+
+			std::unique_ptr<uint8_t[]> m_Buffer; // allocated on first Add
+			size_t m_Capacity, m_Head, m_Size;
+			bool m_IsPrepared; // free space is being written, tail must stay
+	};
 
 	enum StreamStatus
 	{
@@ -124,16 +157,31 @@ namespace stream
 			void AsyncReceive (const Buffer& buffer, ReceiveHandler handler, int timeout = 0);
 			size_t ReadSome (uint8_t * buf, size_t len) { return ConcatenatePackets (buf, len); };
 			
+			// zero-copy receive, handler gets buffers of received packets. Call Consume when they are written
+			template<typename BuffersHandler>
+			void AsyncReceiveBuffers (size_t len, BuffersHandler handler, int timeout = 0);
+			void Consume (size_t len);
+			// zero-copy send, read to returned buffers then commit. Can't be mixed with Send until committed
+			std::vector<boost::asio::mutable_buffer> PrepareSend (size_t len);
+			void AsyncCommitSend (size_t len, SendHandler handler);
+			
 			void Close ();
-			void Cancel () { m_ReceiveTimer.cancel (); };
+			void Cancel () { m_ReceiveTimer.Cancel (); };
 
 			size_t GetNumSentBytes () const { return m_NumSentBytes; };
 			size_t GetNumReceivedBytes () const { return m_NumReceivedBytes; };
 			size_t GetSendQueueSize () const { return m_SentPackets.size (); };
 			size_t GetReceiveQueueSize () const { return m_ReceiveQueue.size (); };
-			size_t GetSendBufferSize () const { return m_SendBuffer.rdbuf ()->in_avail (); };
+			size_t GetSendBufferSize () const { return m_SendBuffer.GetSize (); };
 			int GetWindowSize () const { return m_WindowSize; };
+			int GetSlowStartThreshold () const { return m_SlowStartThreshold; };
 			int GetRTT () const { return m_RTT; };
+			int GetRTO () const { return m_RTO; };
+			size_t GetNumResentPackets () const { return m_NumResentPackets; };
+			bool IsCompressionEnabled () const { return !m_NumPacketsToProbe; };
+			int64_t GetNumCompressionSavedBytes () const { return m_NumCompressionSavedBytes; };
+			uint64_t GetAverageDeflateTime () const // in microseconds per packet
+			{ return m_NumDeflatedPackets ? m_DeflateTime/m_NumDeflatedPackets : 0; };
 			
 		private:
 
@@ -146,15 +194,21 @@ namespace stream
 			void SendPackets (const std::vector<Packet *>& packets);
 
 			void SavePacket (Packet * packet);
+			Packet * GetNextSavedPacket (); // next in sequence
 			void ProcessPacket (Packet * packet);
 			void ProcessAck (Packet * packet);
-			size_t ConcatenatePackets (uint8_t * buf, size_t len);
+			size_t ConcatenatePackets (uint8_t * buf, size_t len); // drops data if buf is null
+			size_t GetReceivedBuffers (std::vector<boost::asio::const_buffer>& buffers, size_t len);
 
 			void UpdateCurrentRemoteLease (bool expired = false);
 			
 			template<typename Buffer, typename ReceiveHandler>
 			void HandleReceiveTimer (const boost::system::error_code& ecode, const Buffer& buffer, ReceiveHandler handler);
+			template<typename BuffersHandler>
+			void HandleReceiveBuffersTimer (const boost::system::error_code& ecode, size_t len, BuffersHandler handler);
 			
+			void UpdateRTT (int rtt);
+			void DecreaseWindow (uint64_t ts);
 			void ScheduleResend ();
 			void HandleResendTimer (const boost::system::error_code& ecode);
 			void HandleAckSendTimer (const boost::system::error_code& ecode);
@@ -174,18 +228,26 @@ namespace stream
 			std::shared_ptr<i2p::garlic::GarlicRoutingSession> m_RoutingSession;
 			i2p::data::Lease m_CurrentRemoteLease;
 			std::shared_ptr<i2p::tunnel::OutboundTunnel> m_CurrentOutboundTunnel;
-			std::queue<Packet *> m_ReceiveQueue;
-			std::set<Packet *, PacketCmp> m_SavedPackets;
-			std::set<Packet *, PacketCmp> m_SentPackets;
-			boost::asio::deadline_timer m_ReceiveTimer, m_ResendTimer, m_AckSendTimer;
+			std::deque<Packet *> m_ReceiveQueue; // packets stay here until consumed
+			std::vector<Packet *> m_SavedPackets; // out of order, slot is seqn % MAX_WINDOW_SIZE, allocated on first
+			int m_NumSavedPackets;
+			int32_t m_LastSavedSequenceNumber; // highest
+			std::deque<Packet *> m_SentPackets; // by seqn, since sent in order
+			i2p::util::WheelTimer m_ReceiveTimer, m_ResendTimer, m_AckSendTimer;
 			size_t m_NumSentBytes, m_NumReceivedBytes;
 			uint16_t m_Port;
 
 			std::mutex m_SendBufferMutex;
-			std::stringstream m_SendBuffer;
-			int m_WindowSize, m_RTT, m_RTO;
-			uint64_t m_LastWindowSizeIncreaseTime;
+			SendRingBuffer m_SendBuffer;
+			int m_WindowSize, m_SlowStartThreshold, m_RTT, m_RTTVar, m_RTO;
+			bool m_IsRTTMeasured; // first sample is taken as is
+			uint64_t m_LastWindowSizeIncreaseTime, m_LastWindowSizeDecreaseTime;
+			size_t m_NumResentPackets;
 			int m_NumResendAttempts;
+			int m_NumPacketsToProbe, m_CompressionProbeInterval; // stored blocks while m_NumPacketsToProbe > 0
+			int64_t m_NumCompressionSavedBytes; // negative if compression doesn't pay off
+			uint64_t m_DeflateTime; // in microseconds
+			size_t m_NumDeflatedPackets;
 			SendHandler m_SendHandler;
 	};
 
@@ -248,8 +310,7 @@ namespace stream
 				s->HandleReceiveTimer (boost::asio::error::make_error_code (boost::asio::error::operation_aborted), buffer, handler);
 			else
 			{
-				s->m_ReceiveTimer.expires_from_now (boost::posix_time::seconds(timeout));
-				s->m_ReceiveTimer.async_wait ([=](const boost::system::error_code& ecode)
+				s->m_ReceiveTimer.AsyncWait (timeout*1000, [=](const boost::system::error_code& ecode)
 					{ s->HandleReceiveTimer (ecode, buffer, handler); });
 			}
 		});	
@@ -273,6 +334,42 @@ namespace stream
 			// timeout expired
 			handler (boost::asio::error::make_error_code (boost::asio::error::timed_out), received);
 	}
+
+	template<typename BuffersHandler>
+	void Stream::AsyncReceiveBuffers (size_t len, BuffersHandler handler, int timeout)
+	{
+		auto s = shared_from_this();
+		m_Service.post ([=](void)
+		{
+			if (!m_ReceiveQueue.empty () || m_Status == eStreamStatusReset)
+				s->HandleReceiveBuffersTimer (boost::asio::error::make_error_code (boost::asio::error::operation_aborted), len, handler);
+			else
+			{
+				s->m_ReceiveTimer.AsyncWait (timeout*1000, [=](const boost::system::error_code& ecode)
+					{ s->HandleReceiveBuffersTimer (ecode, len, handler); });
+			}
+		});	
+	}
+
+	template<typename BuffersHandler>
+	void Stream::HandleReceiveBuffersTimer (const boost::system::error_code& ecode, size_t len, BuffersHandler handler)
+	{
+		std::vector<boost::asio::const_buffer> buffers;
+		size_t received = GetReceivedBuffers (buffers, len);
+		if (received > 0)
+			handler (boost::system::error_code (), buffers, received);
+		else if (ecode == boost::asio::error::operation_aborted)
+		{	
+			// timeout not expired	
+			if (m_Status == eStreamStatusReset)
+				handler (boost::asio::error::make_error_code (boost::asio::error::connection_reset), buffers, 0);
+			else
+				handler (boost::asio::error::make_error_code (boost::asio::error::operation_aborted), buffers, 0); 
+		}	
+		else
+			// timeout expired
+			handler (boost::asio::error::make_error_code (boost::asio::error::timed_out), buffers, 0);
+	}
 }		
 }	
 
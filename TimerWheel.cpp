@@ -0,0 +1,163 @@
+#include "TimerWheel.h"
+
+namespace i2p
+{
+namespace util
+{
+	WheelTimer::WheelTimer (boost::asio::io_service& service):
+		m_Wheel (boost::asio::use_service<TimerWheel> (service)), m_NumRounds (0)
+	{
+		prev = next = nullptr;
+	}
+
+	WheelTimer::~WheelTimer ()
+	{
+		Cancel ();
+	}
+
+	void WheelTimer::AsyncWait (int milliseconds, Handler handler)
+	{
+		m_Wheel.Schedule (this, milliseconds, handler);
+	}
+
+	void WheelTimer::Cancel ()
+	{
+		m_Wheel.Cancel (this);
+	}
+
+	boost::asio::io_service::id TimerWheel::id;
+
+	TimerWheel::TimerWheel (boost::asio::io_service& service):
+		boost::asio::io_service::service (service), m_Service (service), m_Timer (service),
+		m_StartTime (std::chrono::steady_clock::now ()), m_CurrentTick (0), m_IsTicking (false),
+		m_NumTimers (0)
+	{
+		for (auto& it: m_Slots)
+			it.prev = it.next = &it;
+	}
+
+	TimerWheel::~TimerWheel ()
+	{
+	}
+
+	void TimerWheel::shutdown_service ()
+	{
+		// drop everything, handlers might hold last references to timers' owners
+		std::vector<WheelTimer::Handler> handlers;
+		{
+			std::unique_lock<std::mutex> l(m_Mutex);
+			for (auto& it: m_Slots)
+				while (it.next != &it)
+				{
+					auto timer = static_cast<WheelTimer *>(it.next);
+					handlers.push_back (std::move (timer->m_Handler));
+					Unlink (timer);
+				}
+			m_IsTicking = false;
+		}
+		boost::system::error_code ec;
+		m_Timer.cancel (ec);
+		handlers.clear ();
+	}
+
+	uint64_t TimerWheel::GetMilliseconds () const
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now () - m_StartTime).count ();
+	}
+
+	void TimerWheel::Schedule (WheelTimer * timer, int milliseconds, WheelTimer::Handler handler)
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (timer->prev)
+		{
+			PostAborted (timer->m_Handler);
+			Unlink (timer);
+		}
+		auto ts = GetMilliseconds ();
+		if (!m_IsTicking) m_CurrentTick = ts/TIMER_WHEEL_TICK; // nothing to catch up
+		// round up, never expire earlier than requested
+		uint64_t numTicks = (ts + (milliseconds > 0 ? milliseconds : 0) + TIMER_WHEEL_TICK - 1)/TIMER_WHEEL_TICK;
+		numTicks = numTicks > m_CurrentTick ? numTicks - m_CurrentTick : 1;
+		auto& slot = m_Slots[(m_CurrentTick + numTicks) & (TIMER_WHEEL_NUM_SLOTS - 1)];
+		timer->m_NumRounds = (numTicks - 1)/TIMER_WHEEL_NUM_SLOTS;
+		timer->m_Handler = handler;
+		timer->prev = slot.prev;
+		timer->next = &slot;
+		slot.prev->next = timer;
+		slot.prev = timer;
+		m_NumTimers++;
+		if (!m_IsTicking)
+		{
+			m_IsTicking = true;
+			ScheduleTick ();
+		}
+	}
+
+	void TimerWheel::Cancel (WheelTimer * timer)
+	{
+		std::unique_lock<std::mutex> l(m_Mutex);
+		if (timer->prev)
+		{
+			PostAborted (timer->m_Handler);
+			Unlink (timer);
+		}
+	}
+
+	void TimerWheel::Unlink (WheelTimer * timer)
+	{
+		timer->prev->next = timer->next;
+		timer->next->prev = timer->prev;
+		timer->prev = timer->next = nullptr;
+		timer->m_Handler = nullptr;
+		m_NumTimers--;
+	}
+
+	void TimerWheel::PostAborted (WheelTimer::Handler& handler)
+	{
+		m_Service.post (std::bind (handler, boost::asio::error::make_error_code (boost::asio::error::operation_aborted)));
+	}
+
+	void TimerWheel::ScheduleTick ()
+	{
+		m_Timer.expires_from_now (boost::posix_time::milliseconds (TIMER_WHEEL_TICK));
+		m_Timer.async_wait (std::bind (&TimerWheel::HandleTick, this, std::placeholders::_1));
+	}
+
+	void TimerWheel::HandleTick (const boost::system::error_code& ecode)
+	{
+		if (ecode == boost::asio::error::operation_aborted) return;
+		{
+			std::unique_lock<std::mutex> l(m_Mutex);
+			auto tick = GetMilliseconds ()/TIMER_WHEEL_TICK;
+			while (m_CurrentTick < tick && m_NumTimers > 0)
+			{
+				m_CurrentTick++;
+				auto& slot = m_Slots[m_CurrentTick & (TIMER_WHEEL_NUM_SLOTS - 1)];
+				for (auto node = slot.next; node != &slot;)
+				{
+					auto timer = static_cast<WheelTimer *>(node);
+					node = node->next;
+					if (timer->m_NumRounds)
+						timer->m_NumRounds--;
+					else
+					{
+						m_ExpiredHandlers.push_back (std::move (timer->m_Handler));
+						Unlink (timer);
+					}
+				}
+			}
+			m_CurrentTick = tick;
+			if (m_NumTimers > 0)
+				ScheduleTick ();
+			else
+				m_IsTicking = false;
+		}
+		// handlers might schedule timers again
+		boost::system::error_code ec;
+		for (auto& it: m_ExpiredHandlers)
+			it (ec);
+		m_ExpiredHandlers.clear ();
+	}
+}
+}
@@ -0,0 +1,91 @@
+#ifndef TIMER_WHEEL_H__
+#define TIMER_WHEEL_H__
+
+#include <inttypes.h>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <boost/asio.hpp>
+
+namespace i2p
+{
+namespace util
+{
+	const int TIMER_WHEEL_TICK = 10; // in milliseconds
+	const int TIMER_WHEEL_NUM_SLOTS = 1024; // must be power of 2, ~10 seconds per revolution
+
+	struct TimerWheelNode
+	{
+		TimerWheelNode * prev, * next;
+	};
+
+	class TimerWheel;
+	// Used instead of deadline_timer by objects existing in large numbers. Handlers are
+	// called with operation_aborted if cancelled or rescheduled, the same as deadline_timer's
+	class WheelTimer: private TimerWheelNode
+	{
+		public:
+
+			typedef std::function<void (const boost::system::error_code&)> Handler;
+
+			WheelTimer (boost::asio::io_service& service);
+			~WheelTimer ();
+
+			void AsyncWait (int milliseconds, Handler handler); // cancels previous wait
+			void Cancel ();
+
+		private:
+
+			friend class TimerWheel;
+
+			TimerWheel& m_Wheel;
+			uint64_t m_NumRounds; // revolutions left
+			Handler m_Handler;
+	};
+
+	// Hashed timer wheel, one per io_service. Timer is put to slot of its expiration tick
+	// with number of revolutions left, so schedule and cancel are O(1).
+	// Slots are processed by single deadline_timer, ticking only while there are timers
+	class TimerWheel: public boost::asio::io_service::service
+	{
+		public:
+
+			static boost::asio::io_service::id id;
+
+			TimerWheel (boost::asio::io_service& service);
+			~TimerWheel ();
+
+			size_t GetNumTimers () const { return m_NumTimers; };
+
+		private:
+
+			friend class WheelTimer;
+
+			void shutdown_service ();
+
+			void Schedule (WheelTimer * timer, int milliseconds, WheelTimer::Handler handler);
+			void Cancel (WheelTimer * timer);
+			void Unlink (WheelTimer * timer); // m_Mutex must be locked
+			void PostAborted (WheelTimer::Handler& handler);
+			uint64_t GetMilliseconds () const; // since start
+
+			void ScheduleTick ();
+			void HandleTick (const boost::system::error_code& ecode);
+
+		private:
+
+			boost::asio::io_service& m_Service;
+			std::mutex m_Mutex;
+			boost::asio::deadline_timer m_Timer;
+			std::chrono::steady_clock::time_point m_StartTime;
+			uint64_t m_CurrentTick; // processed up to
+			bool m_IsTicking;
+			size_t m_NumTimers;
+			TimerWheelNode m_Slots[TIMER_WHEEL_NUM_SLOTS]; // circular lists
+			std::vector<WheelTimer::Handler> m_ExpiredHandlers; // io_service is run by one thread
+	};
+}
+}
+
+#endif
@@ -30,17 +30,40 @@ namespace tunnel
 		
 	void TransitTunnelParticipant::HandleTunnelDataMsg (std::shared_ptr<const i2p::I2NPMessage> tunnelMsg)
 	{
-		auto newMsg = CreateEmptyTunnelDataMsg ();
-		EncryptTunnelMsg (tunnelMsg, newMsg);
-		
 		m_NumTransmittedBytes += tunnelMsg->GetLength ();
-		htobe32buf (newMsg->GetPayload (), GetNextTunnelID ());
-		newMsg->FillI2NPMessageHeader (eI2NPTunnelData); 
-		m_TunnelDataMsgs.push_back (newMsg);
+		m_PendingMsgs.push_back (tunnelMsg);
+		if (m_PendingMsgs.size () >= (size_t)i2p::crypto::TUNNEL_CRYPTO_NUM_LANES)
+			EncryptPendingMsgs ();
 	}
 
+	void TransitTunnelParticipant::EncryptPendingMsgs ()
+	{
+		// all messages of the tunnel have same keys, so they can be encrypted together
+		auto num = m_PendingMsgs.size (); // never exceeds TUNNEL_CRYPTO_NUM_LANES
+		if (!num) return;
+		const uint8_t * in[i2p::crypto::TUNNEL_CRYPTO_NUM_LANES];
+		uint8_t * out[i2p::crypto::TUNNEL_CRYPTO_NUM_LANES];
+		size_t first = m_TunnelDataMsgs.size ();
+		for (size_t i = 0; i < num; i++)
+		{
+			auto newMsg = CreateEmptyTunnelDataMsg ();
+			in[i] = m_PendingMsgs[i]->GetPayload () + 4;
+			out[i] = newMsg->GetPayload () + 4;
+			m_TunnelDataMsgs.push_back (newMsg);
+		}	
+		EncryptTunnelMsgs (num, in, out);
+		m_PendingMsgs.clear ();
+		for (size_t i = first; i < m_TunnelDataMsgs.size (); i++)
+		{
+			auto& newMsg = m_TunnelDataMsgs[i];
+			htobe32buf (newMsg->GetPayload (), GetNextTunnelID ());
+			newMsg->FillI2NPMessageHeader (eI2NPTunnelData); 
+		}	
+	}	
+
 	void TransitTunnelParticipant::FlushTunnelDataMsgs ()
 	{
+		EncryptPendingMsgs ();
 		if (!m_TunnelDataMsgs.empty ())
 		{	
 			auto num = m_TunnelDataMsgs.size ();
@@ -29,6 +29,14 @@ namespace tunnel
 			void SendTunnelDataMsg (std::shared_ptr<i2p::I2NPMessage> msg);
 			void HandleTunnelDataMsg (std::shared_ptr<const i2p::I2NPMessage> tunnelMsg);
 			void EncryptTunnelMsg (std::shared_ptr<const I2NPMessage> in, std::shared_ptr<I2NPMessage> out); 			
+
+		protected:
+
+			void EncryptTunnelMsgs (int num, const uint8_t * const * in, uint8_t * const * out) // payloads
+			{ 
+				m_Encryption.Encrypt (num, in, out); 
+			}	
+
 		private:
 			
 			i2p::crypto::TunnelEncryption m_Encryption;
@@ -49,9 +57,14 @@ namespace tunnel
 			void HandleTunnelDataMsg (std::shared_ptr<const i2p::I2NPMessage> tunnelMsg);
 			void FlushTunnelDataMsgs ();
 
+		private:
+
+			void EncryptPendingMsgs ();
+
 		private:
 
 			size_t m_NumTransmittedBytes;
+			std::vector<std::shared_ptr<const i2p::I2NPMessage> > m_PendingMsgs; // to encrypt
 			std::vector<std::shared_ptr<i2p::I2NPMessage> > m_TunnelDataMsgs;
 	};	
 	
@@ -1,5 +1,6 @@
 #include <openssl/dh.h>
 #include "Log.h"
+#include "Timestamp.h"
 #include "Crypto.h"
 #include "RouterContext.h"
 #include "I2NPProtocol.h"
@@ -12,8 +13,10 @@ namespace i2p
 {
 namespace transport
 {
-	DHKeysPairSupplier::DHKeysPairSupplier (int size):
-		m_QueueSize (size), m_IsRunning (false), m_Thread (nullptr)
+	DHKeysPairSupplier::DHKeysPairSupplier (int minSize, int maxSize):
+		m_MinSize (minSize), m_MaxSize (maxSize), m_TargetSize (minSize), m_NumCreating (0),
+		m_LastRateUpdateTime (0), m_NumAcquiredSinceUpdate (0), m_Rate (0), m_IsRunning (false),
+		m_NumAvailable (0), m_NumAcquired (0), m_NumStarved (0)
 	{
 	}	
 
@@ -22,80 +25,119 @@ namespace transport
 		Stop ();
 	}
 
-	void DHKeysPairSupplier::Start ()
+	void DHKeysPairSupplier::Start (int numThreads)
 	{
+		if (numThreads < 1) numThreads = 1;
+		if (numThreads > DH_KEYS_PAIR_SUPPLIER_MAX_NUM_THREADS) numThreads = DH_KEYS_PAIR_SUPPLIER_MAX_NUM_THREADS;
 		m_IsRunning = true;
-		m_Thread = new std::thread (std::bind (&DHKeysPairSupplier::Run, this));
+		m_LastRateUpdateTime = i2p::util::GetSecondsSinceEpoch ();
+		for (int i = 0; i < numThreads; i++)
+			m_Threads.push_back (new std::thread (std::bind (&DHKeysPairSupplier::Run, this)));
 	}
 
 	void DHKeysPairSupplier::Stop ()
 	{
-		m_IsRunning = false;
-		m_Acquired.notify_one ();	
-		if (m_Thread)
+		{
+			std::unique_lock<std::mutex>  l(m_AcquiredMutex);
+			m_IsRunning = false;
+		}
+		m_Acquired.notify_all ();	
+		for (auto it: m_Threads)
 		{	
-			m_Thread->join (); 
-			delete m_Thread;
-			m_Thread = 0;
+			it->join (); 
+			delete it;
 		}	
+		m_Threads.clear ();
 	}
 
 	void DHKeysPairSupplier::Run ()
 	{
-		while (m_IsRunning)
+		while (true)
 		{
-			int num;
-			while ((num = m_QueueSize - m_Queue.size ()) > 0)
-				CreateDHKeysPairs (num);
+			{
+				std::unique_lock<std::mutex>  l(m_AcquiredMutex);
+				// wait for element gets aquired or target size grows
+				m_Acquired.wait (l, [this]() 
+					{ 
+						return !m_IsRunning || (int)m_Queue.size () + m_NumCreating < m_TargetSize; 
+					});
+				if (!m_IsRunning) break;
+				m_NumCreating++;
+			}
+			// generate outside of the lock, other workers might generate in parallel
+			auto pair = std::make_shared<i2p::crypto::DHKeys> ();
+			pair->GenerateKeys ();
 			std::unique_lock<std::mutex>  l(m_AcquiredMutex);
-			m_Acquired.wait (l); // wait for element gets aquired
+			m_NumCreating--;
+			m_Queue.push (pair);
+			m_NumAvailable = m_Queue.size ();
 		}
 	}		
 
-	void DHKeysPairSupplier::CreateDHKeysPairs (int num)
+	void DHKeysPairSupplier::UpdateTargetSize (uint64_t ts)
 	{
-		if (num > 0)
+		// called under m_AcquiredMutex
+		if (ts < m_LastRateUpdateTime + DH_KEYS_PAIR_SUPPLIER_RATE_INTERVAL) return;
+		double rate = (double)m_NumAcquiredSinceUpdate/(ts - m_LastRateUpdateTime);
+		m_Rate = (m_Rate + rate)/2; // smooth, but forget past storms quickly
+		int targetSize = (int)(m_Rate*DH_KEYS_PAIR_SUPPLIER_HEADROOM) + 1;
+		if (targetSize < m_MinSize) targetSize = m_MinSize;
+		if (targetSize > m_MaxSize) targetSize = m_MaxSize;
+		if (targetSize != m_TargetSize)
 		{
-			i2p::crypto::DHKeys dh;
-			for (int i = 0; i < num; i++)
-			{
-				auto pair = std::make_shared<i2p::crypto::DHKeys> ();
-				pair->GenerateKeys ();
-				std::unique_lock<std::mutex>  l(m_AcquiredMutex);
-				m_Queue.push (pair);
-			}
+			LogPrint (eLogDebug, "DH keys pairs pool size changed from ", m_TargetSize.load (), " to ", targetSize);
+			if (targetSize > m_TargetSize) m_Acquired.notify_all ();
+			m_TargetSize = targetSize;
 		}
+		m_LastRateUpdateTime = ts;
+		m_NumAcquiredSinceUpdate = 0;
 	}
 
 	std::shared_ptr<i2p::crypto::DHKeys> DHKeysPairSupplier::Acquire ()
 	{
-		if (!m_Queue.empty ())
+		m_NumAcquired++;
+		auto ts = i2p::util::GetSecondsSinceEpoch ();
 		{
 			std::unique_lock<std::mutex>  l(m_AcquiredMutex);
-			auto pair = m_Queue.front ();
-			m_Queue.pop ();
-			m_Acquired.notify_one ();
-			return pair;
-		}	
-		else // queue is empty, create new
-		{	
-			auto pair = std::make_shared<i2p::crypto::DHKeys> ();
-			pair->GenerateKeys ();
-			return pair;
+			m_NumAcquiredSinceUpdate++;
+			UpdateTargetSize (ts);
+			if (!m_Queue.empty ())
+			{
+				auto pair = m_Queue.front ();
+				m_Queue.pop ();
+				m_NumAvailable = m_Queue.size ();
+				m_Acquired.notify_one ();
+				return pair;
+			}
+			// starved, grow right away rather than wait for next rate update
+			if (m_IsRunning && m_TargetSize < m_MaxSize)
+			{
+				m_TargetSize = std::min (m_TargetSize.load ()*2, m_MaxSize);
+				m_Acquired.notify_all ();
+			}
 		}
+		// queue is empty, create new
+		m_NumStarved++;
+		auto pair = std::make_shared<i2p::crypto::DHKeys> ();
+		pair->GenerateKeys ();
+		return pair;
 	}
 
 	void DHKeysPairSupplier::Return (std::shared_ptr<i2p::crypto::DHKeys> pair)
 	{
 		std::unique_lock<std::mutex>  l(m_AcquiredMutex);
-		m_Queue.push (pair);
+		if ((int)m_Queue.size () < m_MaxSize)
+		{
+			m_Queue.push (pair);
+			m_NumAvailable = m_Queue.size ();
+		}
 	}
 
 	Transports transports;	
 	
 	Transports::Transports (): 
 		m_IsRunning (false), m_Thread (nullptr), m_Work (m_Service), m_PeerCleanupTimer (m_Service),
-		m_NTCPServer (nullptr), m_SSUServer (nullptr), m_DHKeysPairSupplier (5), // 5 pre-generated keys
+		m_NTCPServer (nullptr), m_SSUServer (nullptr), m_DHKeysPairSupplier (DH_KEYS_PAIR_SUPPLIER_MIN_SIZE, DH_KEYS_PAIR_SUPPLIER_MAX_SIZE),
 		m_TotalSentBytes(0), m_TotalReceivedBytes(0), m_InBandwidth (0), m_OutBandwidth (0),
 		m_LastInBandwidthUpdateBytes (0), m_LastOutBandwidthUpdateBytes (0), m_LastBandwidthUpdateTime (0)	
 	{		
@@ -106,9 +148,9 @@ namespace transport
 		Stop ();
 	}	
 
-	void Transports::Start ()
+	void Transports::Start (int numDHThreads, int numSSUThreads, int numNTCPThreads)
 	{
-		m_DHKeysPairSupplier.Start ();
+		m_DHKeysPairSupplier.Start (numDHThreads);
 		m_IsRunning = true;
 		m_Thread = new std::thread (std::bind (&Transports::Run, this));
 		// create acceptors
@@ -117,7 +159,7 @@ namespace transport
 		{
 			if (!m_NTCPServer)
 			{	
-				m_NTCPServer = new NTCPServer (address.port);
+				m_NTCPServer = new NTCPServer (address.port, numNTCPThreads);
 				m_NTCPServer->Start ();
 			}	
 			
@@ -125,7 +167,7 @@ namespace transport
 			{
 				if (!m_SSUServer)
 				{	
-					m_SSUServer = new SSUServer (address.port);
+					m_SSUServer = new SSUServer (address.port, numSSUThreads);
 					LogPrint (eLogInfo, "Transports: Start listening UDP port ", address.port);
 					m_SSUServer->Start ();	
 					DetectExternalIP ();
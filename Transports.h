@@ -23,31 +23,49 @@ namespace i2p
 {
 namespace transport
 {
+	const int DH_KEYS_PAIR_SUPPLIER_MIN_SIZE = 5;
+	const int DH_KEYS_PAIR_SUPPLIER_MAX_SIZE = 200;
+	const int DH_KEYS_PAIR_SUPPLIER_RATE_INTERVAL = 10; // in seconds
+	const int DH_KEYS_PAIR_SUPPLIER_HEADROOM = 4; // in seconds of recent acquisition rate
+	const int DH_KEYS_PAIR_SUPPLIER_MAX_NUM_THREADS = 8;
 	class DHKeysPairSupplier
 	{
 		public:
 
-			DHKeysPairSupplier (int size);
+			DHKeysPairSupplier (int minSize, int maxSize);
 			~DHKeysPairSupplier ();
-			void Start ();
+			void Start (int numThreads = 1);
 			void Stop ();
 			std::shared_ptr<i2p::crypto::DHKeys> Acquire ();
 			void Return (std::shared_ptr<i2p::crypto::DHKeys> pair);
 
+			// for HTTP only
+			size_t GetNumAvailable () const { return m_NumAvailable; };
+			int GetTargetSize () const { return m_TargetSize; };
+			uint64_t GetNumAcquired () const { return m_NumAcquired; };
+			uint64_t GetNumStarved () const { return m_NumStarved; }; // created inline by caller
+
 		private:
 
 			void Run ();
-			void CreateDHKeysPairs (int num);
+			void UpdateTargetSize (uint64_t ts);
 
 		private:
 
-			const int m_QueueSize;
+			const int m_MinSize, m_MaxSize;
 			std::queue<std::shared_ptr<i2p::crypto::DHKeys> > m_Queue;
+			std::atomic<int> m_TargetSize; // changed under m_AcquiredMutex, read by HTTP without lock
+			int m_NumCreating;
+			uint64_t m_LastRateUpdateTime;
+			int m_NumAcquiredSinceUpdate;
+			double m_Rate; // smoothed acquisitions per second
 
 			bool m_IsRunning;
-			std::thread * m_Thread;	
+			std::vector<std::thread *> m_Threads;
 			std::condition_variable m_Acquired;
 			std::mutex m_AcquiredMutex;
+			std::atomic<size_t> m_NumAvailable;
+			std::atomic<uint64_t> m_NumAcquired, m_NumStarved;
 	};
 
 	struct Peer
@@ -75,7 +93,7 @@ namespace transport
 			Transports ();
 			~Transports ();
 
-			void Start ();
+			void Start (int numDHThreads = 1, int numSSUThreads = 1, int numNTCPThreads = 1);
 			void Stop ();
 			
 			boost::asio::io_service& GetService () { return m_Service; };
@@ -148,6 +166,7 @@ namespace transport
 			const NTCPServer * GetNTCPServer () const { return m_NTCPServer; };
 			const SSUServer * GetSSUServer () const { return m_SSUServer; };
 			const decltype(m_Peers)& GetPeers () const { return m_Peers; };
+			const DHKeysPairSupplier& GetDHKeysPairSupplier () const { return m_DHKeysPairSupplier; };
 	};	
 
 	extern Transports transports;
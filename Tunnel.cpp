@@ -31,7 +31,7 @@ namespace tunnel
 	{
 		auto numHops = m_Config->GetNumHops ();
 		int numRecords = numHops <= STANDARD_NUM_RECORDS ? STANDARD_NUM_RECORDS : numHops; 
-		auto msg = NewI2NPShortMessage ();
+		auto msg = NewI2NPMessage (numRecords*TUNNEL_BUILD_RECORD_SIZE + 1);
 		*msg->GetPayload () = numRecords;
 		msg->len += numRecords*TUNNEL_BUILD_RECORD_SIZE + 1;		
 
@@ -161,6 +161,15 @@ namespace tunnel
 		}	
 	}	
 
+	void Tunnel::EncryptTunnelMsgs (int num, const uint8_t * const * in, uint8_t * const * out)
+	{
+		for (auto& it: m_Hops)
+		{
+			it->decryption.Decrypt (num, in, out);
+			in = out;	
+		}	
+	}	
+
 	void Tunnel::SendTunnelDataMsg (std::shared_ptr<i2p::I2NPMessage> msg)
 	{
 		LogPrint (eLogWarning, "Tunnel: Can't send I2NP messages without delivery instructions");
@@ -194,10 +203,36 @@ namespace tunnel
 	void InboundTunnel::HandleTunnelDataMsg (std::shared_ptr<const I2NPMessage> msg)
 	{
 		if (IsFailed ()) SetState (eTunnelStateEstablished); // incoming messages means a tunnel is alive	
-		auto newMsg = CreateEmptyTunnelDataMsg ();
-		EncryptTunnelMsg (msg, newMsg);
-		newMsg->from = shared_from_this ();
-		m_Endpoint.HandleDecryptedTunnelDataMsg (newMsg);	
+		m_PendingMsgs.push_back (msg);
+		if (m_PendingMsgs.size () >= (size_t)i2p::crypto::TUNNEL_CRYPTO_NUM_LANES)
+			DecryptPendingMsgs ();
+	}	
+
+	void InboundTunnel::FlushTunnelDataMsgs ()
+	{
+		DecryptPendingMsgs ();
+	}	
+
+	void InboundTunnel::DecryptPendingMsgs ()
+	{
+		auto num = m_PendingMsgs.size (); // never exceeds TUNNEL_CRYPTO_NUM_LANES
+		if (!num) return;
+		std::shared_ptr<I2NPMessage> newMsgs[i2p::crypto::TUNNEL_CRYPTO_NUM_LANES];
+		const uint8_t * in[i2p::crypto::TUNNEL_CRYPTO_NUM_LANES];
+		uint8_t * out[i2p::crypto::TUNNEL_CRYPTO_NUM_LANES];
+		for (size_t i = 0; i < num; i++)
+		{
+			newMsgs[i] = CreateEmptyTunnelDataMsg ();
+			in[i] = m_PendingMsgs[i]->GetPayload () + 4;
+			out[i] = newMsgs[i]->GetPayload () + 4;
+		}	
+		EncryptTunnelMsgs (num, in, out);
+		m_PendingMsgs.clear ();
+		for (size_t i = 0; i < num; i++)
+		{
+			newMsgs[i]->from = shared_from_this ();
+			m_Endpoint.HandleDecryptedTunnelDataMsg (newMsgs[i]);	
+		}	
 	}	
 
 	void InboundTunnel::Print (std::stringstream& s) const
@@ -264,6 +299,7 @@ namespace tunnel
 	
 	std::shared_ptr<InboundTunnel> Tunnels::GetInboundTunnel (uint32_t tunnelID)
 	{
+		std::unique_lock<std::mutex> l(m_InboundTunnelsMutex);
 		auto it = m_InboundTunnels.find(tunnelID);
 		if (it != m_InboundTunnels.end ())
 			return it->second;
@@ -272,6 +308,7 @@ namespace tunnel
 	
 	TransitTunnel * Tunnels::GetTransitTunnel (uint32_t tunnelID)
 	{
+		std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
 		auto it = m_TransitTunnels.find(tunnelID);
 		if (it != m_TransitTunnels.end ())
 			return it->second;
@@ -373,9 +410,20 @@ namespace tunnel
 		}
 	}	
 
-	void Tunnels::Start ()
+	void Tunnels::Start (int numWorkers)
 	{
 		m_IsRunning = true;
+		if (numWorkers > TUNNEL_MAX_NUM_WORKERS) numWorkers = TUNNEL_MAX_NUM_WORKERS;
+		if (numWorkers > 1)
+		{
+			// tunnel data and gateway messages are dispatched to workers by tunnel ID, 
+			// so messages of the same tunnel are always handled by the same thread in order
+			for (int i = 0; i < numWorkers; i++)
+				m_WorkerQueues.emplace_back (new TunnelMsgQueue ());
+			for (int i = 0; i < numWorkers; i++)
+				m_Workers.push_back (new std::thread (std::bind (&Tunnels::RunWorker, this, i)));
+			LogPrint (eLogInfo, "Tunnel: started ", numWorkers, " tunnel workers");
+		}	
 		m_Thread = new std::thread (std::bind (&Tunnels::Run, this));
 	}
 	
@@ -383,12 +431,21 @@ namespace tunnel
 	{
 		m_IsRunning = false;
 		m_Queue.WakeUp ();
+		for (auto& it: m_WorkerQueues)
+			it->WakeUp ();
+		for (auto it: m_Workers)
+		{
+			it->join ();
+			delete it;
+		}	
+		m_Workers.clear ();
 		if (m_Thread)
 		{	
 			m_Thread->join (); 
 			delete m_Thread;
 			m_Thread = 0;
 		}	
+		m_WorkerQueues.clear ();
 	}	
 
 	void Tunnels::Run ()
@@ -401,61 +458,7 @@ namespace tunnel
 			try
 			{	
 				auto msg = m_Queue.GetNextWithTimeout (1000); // 1 sec
-				if (msg)
-				{	
-					uint32_t prevTunnelID = 0, tunnelID = 0;
-					TunnelBase * prevTunnel = nullptr; 
-					do
-					{
-						TunnelBase * tunnel = nullptr;
-						uint8_t typeID = msg->GetTypeID ();
-						switch (typeID)
-						{									
-							case eI2NPTunnelData:
-							case eI2NPTunnelGateway:
-							{	
-								tunnelID = bufbe32toh (msg->GetPayload ()); 
-								if (tunnelID == prevTunnelID)
-									tunnel = prevTunnel;
-								else if (prevTunnel)
-									prevTunnel->FlushTunnelDataMsgs (); 
-						
-								if (!tunnel && typeID == eI2NPTunnelData)
-									tunnel = GetInboundTunnel (tunnelID).get ();
-								if (!tunnel)
-									tunnel = GetTransitTunnel (tunnelID);
-								if (tunnel)
-								{
-									if (typeID == eI2NPTunnelData)
-										tunnel->HandleTunnelDataMsg (msg);
-									else // tunnel gateway assumed
-										HandleTunnelGatewayMsg (tunnel, msg);
-								}
-								else		
-									LogPrint (eLogWarning, "Tunnel: tunnel with id ", tunnelID, " not found");
-								break;
-							}	
-							case eI2NPVariableTunnelBuild:		
-							case eI2NPVariableTunnelBuildReply:
-							case eI2NPTunnelBuild:
-							case eI2NPTunnelBuildReply:	
-								HandleI2NPMessage (msg->GetBuffer (), msg->GetLength ());
-							break;	
-							default:
-								LogPrint (eLogError, "Tunnel: unexpected messsage type ", (int) typeID);
-						}
-							
-						msg = m_Queue.Get ();
-						if (msg)
-						{
-							prevTunnelID = tunnelID;
-							prevTunnel = tunnel;
-						}
-						else if (tunnel)
-							tunnel->FlushTunnelDataMsgs ();
-					}
-					while (msg);
-				}	
+				if (msg) ProcessMessages (m_Queue, msg);
 			
 				uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
 				if (ts - lastTs >= 15) // manage tunnels every 15 seconds
@@ -471,6 +474,106 @@ namespace tunnel
 		}	
 	}	
 
+	void Tunnels::RunWorker (int shard)
+	{
+		auto& queue = *m_WorkerQueues[shard];
+		uint64_t lastTs = i2p::util::GetSecondsSinceEpoch ();
+		while (m_IsRunning)
+		{
+			try
+			{	
+				auto msg = queue.GetNextWithTimeout (1000); // 1 sec
+				if (msg) ProcessMessages (queue, msg);
+			
+				uint64_t ts = i2p::util::GetSecondsSinceEpoch ();
+				if (ts - lastTs >= 15) 
+				{
+					// transit tunnels of this shard are used by this thread only, so delete them here
+					ManageTransitTunnels (shard);
+					lastTs = ts;
+				}
+			}
+			catch (std::exception& ex)
+			{
+				LogPrint (eLogError, "Tunnel: worker ", shard, " runtime exception: ", ex.what ());
+			}	
+		}	
+	}	
+
+	void Tunnels::ProcessMessages (TunnelMsgQueue& queue, std::shared_ptr<I2NPMessage> msg)
+	{
+		// last found tunnel, it might keep messages to encrypt them in batch until flushed
+		uint32_t prevTunnelID = 0;
+		TunnelBase * prevTunnel = nullptr; 
+		std::shared_ptr<InboundTunnel> prevInboundTunnel; // keep it alive while it's in use
+		auto flushPrevTunnel = [&prevTunnel, &prevInboundTunnel]()
+			{
+				if (prevTunnel)
+				{	
+					prevTunnel->FlushTunnelDataMsgs ();
+					prevTunnel = nullptr;
+					prevInboundTunnel = nullptr;
+				}	
+			};	
+		do
+		{
+			uint8_t typeID = msg->GetTypeID ();
+			switch (typeID)
+			{									
+				case eI2NPTunnelData:
+				case eI2NPTunnelGateway:
+				{	
+					uint32_t tunnelID = bufbe32toh (msg->GetPayload ()); 
+					TunnelBase * tunnel = nullptr;
+					std::shared_ptr<InboundTunnel> inboundTunnel;
+					if (prevTunnel && tunnelID == prevTunnelID)
+					{	
+						tunnel = prevTunnel;
+						inboundTunnel = prevInboundTunnel;
+					}	
+					else
+					{	
+						flushPrevTunnel (); 
+						if (typeID == eI2NPTunnelData)
+						{	
+							inboundTunnel = GetInboundTunnel (tunnelID);
+							tunnel = inboundTunnel.get ();
+						}	
+						if (!tunnel)
+							tunnel = GetTransitTunnel (tunnelID);
+					}	
+					if (tunnel)
+					{
+						if (typeID == eI2NPTunnelData)
+							tunnel->HandleTunnelDataMsg (msg);
+						else // tunnel gateway assumed
+							HandleTunnelGatewayMsg (tunnel, msg);
+						prevTunnelID = tunnelID;
+						prevTunnel = tunnel;
+						prevInboundTunnel = inboundTunnel;
+					}
+					else		
+						LogPrint (eLogWarning, "Tunnel: tunnel with id ", tunnelID, " not found");
+					break;
+				}	
+				case eI2NPVariableTunnelBuild:		
+				case eI2NPVariableTunnelBuildReply:
+				case eI2NPTunnelBuild:
+				case eI2NPTunnelBuildReply:	
+					flushPrevTunnel ();
+					HandleI2NPMessage (msg->GetBuffer (), msg->GetLength ());
+				break;	
+				default:
+					flushPrevTunnel ();
+					LogPrint (eLogError, "Tunnel: unexpected messsage type ", (int) typeID);
+			}
+				
+			msg = queue.Get ();
+			if (!msg) flushPrevTunnel (); // nothing else to batch with
+		}
+		while (msg);
+	}	
+
 	void Tunnels::HandleTunnelGatewayMsg (TunnelBase * tunnel, std::shared_ptr<I2NPMessage> msg)
 	{
 		if (!tunnel)
@@ -503,7 +606,7 @@ namespace tunnel
 		ManagePendingTunnels ();
 		ManageInboundTunnels ();
 		ManageOutboundTunnels ();
-		ManageTransitTunnels ();
+		if (m_Workers.empty ()) ManageTransitTunnels (); // otherwise each worker manages own shard
 		ManageTunnelPools ();
 	}	
 
@@ -628,6 +731,7 @@ namespace tunnel
 					auto pool = tunnel->GetTunnelPool ();
 					if (pool)
 						pool->TunnelExpired (tunnel);
+					std::unique_lock<std::mutex> l(m_InboundTunnelsMutex);
 					it = m_InboundTunnels.erase (it);
 				}	
 				else 
@@ -673,24 +777,30 @@ namespace tunnel
 		}
 	}	
 
-	void Tunnels::ManageTransitTunnels ()
+	void Tunnels::ManageTransitTunnels (int shard)
 	{
 		uint32_t ts = i2p::util::GetSecondsSinceEpoch ();
-		for (auto it = m_TransitTunnels.begin (); it != m_TransitTunnels.end ();)
+		size_t numShards = m_WorkerQueues.size ();
+		std::vector<TransitTunnel *> expired;
 		{
-			if (ts > it->second->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
+			std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
+			for (auto it = m_TransitTunnels.begin (); it != m_TransitTunnels.end ();)
 			{
-				auto tmp = it->second;
-				LogPrint (eLogDebug, "Tunnel: Transit tunnel with id ", tmp->GetTunnelID (), " expired");
+				if ((shard < 0 || it->first % numShards == (size_t)shard) &&
+					ts > it->second->GetCreationTime () + TUNNEL_EXPIRATION_TIMEOUT)
 				{
-					std::unique_lock<std::mutex> l(m_TransitTunnelsMutex);
+					expired.push_back (it->second);
 					it = m_TransitTunnels.erase (it);
 				}	
-				delete tmp;
-			}	
-			else 
-				it++;
-		}
+				else 
+					it++;
+			}
+		}	
+		for (auto it: expired)
+		{
+			LogPrint (eLogDebug, "Tunnel: Transit tunnel with id ", it->GetTunnelID (), " expired");
+			delete it;
+		}	
 	}	
 
 	void Tunnels::ManageTunnelPools ()
@@ -707,14 +817,35 @@ namespace tunnel
 		}
 	}	
 	
+	Tunnels::TunnelMsgQueue& Tunnels::GetQueueFor (std::shared_ptr<I2NPMessage> msg)
+	{
+		if (!m_WorkerQueues.empty ())
+		{
+			uint8_t typeID = msg->GetTypeID ();
+			if (typeID == eI2NPTunnelData || typeID == eI2NPTunnelGateway)
+				return *m_WorkerQueues[bufbe32toh (msg->GetPayload ()) % m_WorkerQueues.size ()];
+		}
+		return m_Queue; // tunnel build messages
+	}	
+
 	void Tunnels::PostTunnelData (std::shared_ptr<I2NPMessage> msg)
 	{
-		if (msg) m_Queue.Put (msg);		
+		if (msg) GetQueueFor (msg).Put (msg);		
 	}	
 
 	void Tunnels::PostTunnelData (const std::vector<std::shared_ptr<I2NPMessage> >& msgs)
 	{
-		m_Queue.Put (msgs);
+		if (m_WorkerQueues.empty ())
+		{
+			m_Queue.Put (msgs);
+			return;
+		}	
+		// keep batches, one per queue
+		std::map<TunnelMsgQueue *, std::vector<std::shared_ptr<I2NPMessage> > > batches;
+		for (auto it: msgs)
+			if (it) batches[&GetQueueFor (it)].push_back (it);
+		for (auto& it: batches)
+			it.first->Put (it.second);
 	}	
 		
 	template<class TTunnel>
@@ -750,7 +881,10 @@ namespace tunnel
 
 	void Tunnels::AddInboundTunnel (std::shared_ptr<InboundTunnel> newTunnel)
 	{
-		m_InboundTunnels[newTunnel->GetTunnelID ()] = newTunnel;
+		{
+			std::unique_lock<std::mutex> l(m_InboundTunnelsMutex);
+			m_InboundTunnels[newTunnel->GetTunnelID ()] = newTunnel;
+		}	
 		auto pool = newTunnel->GetTunnelPool ();
 		if (!pool)
 		{		
@@ -27,6 +27,7 @@ namespace tunnel
 	const int TUNNEL_EXPIRATION_THRESHOLD = 60; // 1 minute	
 	const int TUNNEL_RECREATION_THRESHOLD = 90; // 1.5 minutes	
 	const int TUNNEL_CREATION_TIMEOUT = 30; // 30 seconds
+	const int TUNNEL_MAX_NUM_WORKERS = 16;
 	const int STANDARD_NUM_RECORDS = 5; // in VariableTunnelBuild message
 
 	enum TunnelState
@@ -79,6 +80,7 @@ namespace tunnel
 		protected:
 
 			void PrintHops (std::stringstream& s) const;
+			void EncryptTunnelMsgs (int num, const uint8_t * const * in, uint8_t * const * out); // payloads, all hops
 			
 		private:
 
@@ -118,12 +120,18 @@ namespace tunnel
 
 			InboundTunnel (std::shared_ptr<const TunnelConfig> config): Tunnel (config), m_Endpoint (true) {};
 			void HandleTunnelDataMsg (std::shared_ptr<const I2NPMessage> msg);
+			void FlushTunnelDataMsgs ();
 			size_t GetNumReceivedBytes () const { return m_Endpoint.GetNumReceivedBytes (); };
 			void Print (std::stringstream& s) const;
 			
+		private:
+
+			void DecryptPendingMsgs ();
+
 		private:
 
 			TunnelEndpoint m_Endpoint; 
+			std::vector<std::shared_ptr<const I2NPMessage> > m_PendingMsgs; // to decrypt
 	};	
 
 	
@@ -133,7 +141,7 @@ namespace tunnel
 
 			Tunnels ();
 			~Tunnels ();
-			void Start ();
+			void Start (int numWorkers = 1);
 			void Stop ();		
 			
 			std::shared_ptr<InboundTunnel> GetInboundTunnel (uint32_t tunnelID);
@@ -165,11 +173,16 @@ namespace tunnel
 
 			void HandleTunnelGatewayMsg (TunnelBase * tunnel, std::shared_ptr<I2NPMessage> msg);
 
+			typedef i2p::util::LockFreeQueue<std::shared_ptr<I2NPMessage> > TunnelMsgQueue;
+			void ProcessMessages (TunnelMsgQueue& queue, std::shared_ptr<I2NPMessage> msg);
+			TunnelMsgQueue& GetQueueFor (std::shared_ptr<I2NPMessage> msg);
+
 			void Run ();	
+			void RunWorker (int shard);
 			void ManageTunnels ();
 			void ManageOutboundTunnels ();
 			void ManageInboundTunnels ();
-			void ManageTransitTunnels ();
+			void ManageTransitTunnels (int shard = -1); // -1 means all
 			void ManagePendingTunnels ();
 			template<class PendingTunnels>
 			void ManagePendingTunnels (PendingTunnels& pendingTunnels);
@@ -184,13 +197,17 @@ namespace tunnel
 			std::map<uint32_t, std::shared_ptr<InboundTunnel> > m_PendingInboundTunnels; // by replyMsgID
 			std::map<uint32_t, std::shared_ptr<OutboundTunnel> > m_PendingOutboundTunnels; // by replyMsgID
 			std::map<uint32_t, std::shared_ptr<InboundTunnel> > m_InboundTunnels;
+			std::mutex m_InboundTunnelsMutex;
 			std::list<std::shared_ptr<OutboundTunnel> > m_OutboundTunnels;
 			std::mutex m_TransitTunnelsMutex;
 			std::map<uint32_t, TransitTunnel *> m_TransitTunnels;
 			std::mutex m_PoolsMutex;
 			std::list<std::shared_ptr<TunnelPool>> m_Pools;
 			std::shared_ptr<TunnelPool> m_ExploratoryPool;
-			i2p::util::Queue<std::shared_ptr<I2NPMessage> > m_Queue;
+			TunnelMsgQueue m_Queue;
+			// tunnel data workers, sharded by tunnel ID. Empty if everything is in m_Thread
+			std::vector<std::thread *> m_Workers;
+			std::vector<std::unique_ptr<TunnelMsgQueue> > m_WorkerQueues;
 
 			// some stats
 			int m_NumSuccesiveTunnelCreations, m_NumFailedTunnelCreations;
@@ -201,7 +218,12 @@ namespace tunnel
 			const decltype(m_OutboundTunnels)& GetOutboundTunnels () const { return m_OutboundTunnels; };
 			const decltype(m_InboundTunnels)& GetInboundTunnels () const { return m_InboundTunnels; };
 			const decltype(m_TransitTunnels)& GetTransitTunnels () const { return m_TransitTunnels; };
-			int GetQueueSize () { return m_Queue.GetSize (); };
+			int GetQueueSize () 
+			{ 
+				int size = m_Queue.GetSize ();
+				for (auto& it: m_WorkerQueues) size += it->GetSize ();
+				return size; 
+			};
 			int GetTunnelCreationSuccessRate () const // in percents
 			{ 
 				int totalNum = m_NumSuccesiveTunnelCreations + m_NumFailedTunnelCreations;
@@ -98,7 +98,8 @@ namespace tunnel
 				if (fragment + size < decrypted + TUNNEL_DATA_ENCRYPTED_SIZE)
 				{
 					// this is not last message. we have to copy it
-					m.data = NewI2NPShortMessage ();
+					// fragment size is final unless it's first of many
+					m.data = (isFollowOnFragment || isLastFragment) ? NewI2NPMessage (size) : NewI2NPShortMessage ();
 					m.data->offset += TUNNEL_GATEWAY_HEADER_SIZE; // reserve room for TunnelGateway header
 					m.data->len += TUNNEL_GATEWAY_HEADER_SIZE;
 					*(m.data) = *msg;
@@ -153,7 +154,9 @@ namespace tunnel
 					if (msg.data->len + size > msg.data->maxLen)
 					{
 						LogPrint (eLogWarning, "TunnelMessage: I2NP message size ", msg.data->maxLen, " is not enough");
-						auto newMsg = NewI2NPMessage ();
+						// total size is known only when last fragment arrives, grow twice otherwise
+						auto newLen = msg.data->GetLength () + size;
+						auto newMsg = NewI2NPMessage (isLastFragment ? newLen : 2*newLen);
 						*newMsg = *(msg.data);
 						msg.data = newMsg;
 					}
@@ -209,7 +212,8 @@ namespace tunnel
 				if (msg.data->len + size > msg.data->maxLen)
 				{
 					LogPrint (eLogWarning, "TunnelMessage: Tunnel endpoint I2NP message size ", msg.data->maxLen, " is not enough");
-					auto newMsg = NewI2NPMessage ();
+					auto newLen = msg.data->GetLength () + size;
+					auto newMsg = NewI2NPMessage (it->second.isLastFragment ? newLen : 2*newLen);
 					*newMsg = *(msg.data);
 					msg.data = newMsg;
 				}
@@ -1,10 +1,10 @@
 LIB_SRC = \
   Crypto.cpp Datagram.cpp Garlic.cpp I2NPProtocol.cpp LeaseSet.cpp \
-  Log.cpp NTCPSession.cpp NetDb.cpp NetDbRequests.cpp Profiling.cpp \
+  Log.cpp NTCPSession.cpp NetDb.cpp NetDbRequests.cpp NetDbStore.cpp NetDbIndex.cpp Profiling.cpp \
   Reseed.cpp RouterContext.cpp RouterInfo.cpp Signature.cpp SSU.cpp \
   SSUSession.cpp SSUData.cpp Streaming.cpp Identity.cpp TransitTunnel.cpp \
   Transports.cpp Tunnel.cpp TunnelEndpoint.cpp TunnelPool.cpp TunnelGateway.cpp \
-  Destination.cpp Base.cpp I2PEndian.cpp util.cpp api.cpp
+  Destination.cpp Base.cpp I2PEndian.cpp util.cpp TimerWheel.cpp api.cpp
 
 LIB_CLIENT_SRC = \
 	AddressBook.cpp BOB.cpp ClientContext.cpp I2PTunnel.cpp I2PService.cpp \
@@ -14,3 +14,5 @@ LIB_CLIENT_SRC = \
 DAEMON_SRC = \
 	HTTPServer.cpp I2PControl.cpp UPnP.cpp Daemon.cpp i2pd.cpp
 
+BENCHMARK_SRC = Benchmark.cpp
+
@@ -0,0 +1,95 @@
+#include <cassert>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include "../Queue.h"
+
+// LockFreeQueue must deliver elements of each producer in order they were put,
+// even if ring is full and some of them went to overflow
+
+static std::atomic<bool> isPending (false), isReleased (false);
+
+struct Element // assignment of blocking element to ring's cell stalls producer after slot is claimed
+{
+	int value;
+	bool isBlocking;
+
+	Element (std::nullptr_t = nullptr): value (0), isBlocking (false) {};
+	Element (int v, bool blocking = false): value (v), isBlocking (blocking) {};
+	Element (const Element& other) = default;
+	Element& operator= (const Element& other)
+	{
+		if (other.isBlocking)
+		{
+			isPending = true;
+			while (!isReleased) std::this_thread::yield ();
+		}
+		value = other.value;
+		isBlocking = false;
+		return *this;
+	}
+	bool operator! () const { return !value; };
+	explicit operator bool () const { return value; };
+};
+
+static void TestOverflowWhileSlotIsPending ()
+{
+	i2p::util::LockFreeQueue<Element> queue (2);
+	// producer A claims first slot and stalls before publishing it
+	std::thread producerA ([&queue]() { queue.Put (Element (1, true)); });
+	while (!isPending) std::this_thread::yield ();
+	// producer B takes second slot, then ring is full and next element goes to overflow
+	queue.Put (Element (2));
+	queue.Put (Element (3));
+	assert (!queue.Get ()); // 3 must not go ahead of 2 waiting behind pending slot
+	isReleased = true;
+	producerA.join ();
+	assert (queue.Get ().value == 1);
+	assert (queue.Get ().value == 2);
+	assert (queue.Get ().value == 3);
+	assert (!queue.Get ());
+	// ring is used again after overflow is drained
+	queue.Put (Element (4));
+	assert (queue.GetSize () == 1);
+	assert (queue.Get ().value == 4);
+}
+
+static void TestManyProducers ()
+{
+	const int numProducers = 8, numElements = 100000;
+	i2p::util::LockFreeQueue<int *> queue (16);
+	std::vector<std::thread> producers;
+	for (intptr_t p = 0; p < numProducers; p++)
+		producers.emplace_back ([&queue, p]()
+			{
+				for (intptr_t i = 1; i <= numElements; i++)
+				{
+					auto el = (int *)((p << 32) | i);
+					if (i & 1)
+						queue.Put (el);
+					else
+						queue.Put (std::vector<int *>{ el });
+				}
+			});
+	std::vector<intptr_t> last (numProducers, 0);
+	for (int n = 0; n < numProducers*numElements;)
+	{
+		auto el = (intptr_t)queue.GetNextWithTimeout (10);
+		if (!el) continue;
+		int p = el >> 32;
+		assert (p >= 0 && p < numProducers);
+		assert ((el & 0xFFFFFFFF) == last[p] + 1);
+		last[p]++;
+		n++;
+	}
+	for (auto& it: producers) it.join ();
+	assert (queue.IsEmpty ());
+}
+
+int main ()
+{
+	TestOverflowWhileSlotIsPending ();
+	TestManyProducers ();
+	return 0;
+}
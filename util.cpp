@@ -601,5 +601,75 @@ namespace net
     }	
 } 
 
+	ServicePool::ServicePool (int numThreads, const std::string& name):
+		m_Name (name), m_IsRunning (false), m_NextService (0)
+	{
+		if (numThreads < 1) numThreads = 1;
+		for (int i = 0; i < numThreads; i++)
+		{
+			m_Services.emplace_back (new boost::asio::io_service ());
+			m_Works.emplace_back (new boost::asio::io_service::work (*m_Services.back ()));
+		}
+	}
+
+	ServicePool::~ServicePool ()
+	{
+		Stop ();
+	}
+
+	void ServicePool::Start ()
+	{
+		if (!m_IsRunning)
+		{
+			m_IsRunning = true;
+			for (auto& it: m_Services)
+			{
+				it->reset (); // if restarted
+				m_Threads.emplace_back (new std::thread (std::bind (&ServicePool::Run, this, it.get ())));
+			}
+			LogPrint (eLogInfo, m_Name, ": started ", m_Threads.size (), " threads");
+		}
+	}
+
+	void ServicePool::Stop ()
+	{
+		if (m_IsRunning)
+		{
+			m_IsRunning = false;
+			for (auto& it: m_Services)
+				it->stop ();
+			for (auto& it: m_Threads)
+				it->join ();
+			m_Threads.clear ();
+		}
+	}
+
+	boost::asio::io_service& ServicePool::GetNextService ()
+	{
+		return *m_Services[m_NextService++ % m_Services.size ()];
+	}
+
+	bool ServicePool::IsPoolThread () const
+	{
+		auto id = std::this_thread::get_id ();
+		for (auto& it: m_Threads)
+			if (it->get_id () == id) return true;
+		return false;
+	}
+
+	void ServicePool::Run (boost::asio::io_service * service)
+	{
+		while (m_IsRunning)
+		{
+			try
+			{
+				service->run ();
+			}
+			catch (std::exception& ex)
+			{
+				LogPrint (eLogError, m_Name, ": runtime exception: ", ex.what ());
+			}
+		}
+	}
 } // util
 } // i2p
@@ -3,6 +3,10 @@
 
 #include <map>
 #include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
 #include <iostream>
 #include <boost/asio.hpp>
 #include <boost/filesystem.hpp>
@@ -64,6 +68,37 @@ namespace util
 	{
 		int GetMTU (const boost::asio::ip::address& localAddress);
 	}
+
+	// io_services run by one thread each. Objects stick to the service they got,
+	// so their handlers never run concurrently, the same as with own thread
+	class ServicePool
+	{
+		public:
+
+			ServicePool (int numThreads, const std::string& name);
+			~ServicePool ();
+
+			void Start ();
+			void Stop ();
+
+			int GetNumThreads () const { return m_Services.size (); };
+			boost::asio::io_service& GetService (int ind) { return *m_Services[ind]; };
+			boost::asio::io_service& GetNextService (); // round robin
+			bool IsPoolThread () const;
+
+		private:
+
+			void Run (boost::asio::io_service * service);
+
+		private:
+
+			std::string m_Name; // for log
+			volatile bool m_IsRunning;
+			std::vector<std::unique_ptr<boost::asio::io_service> > m_Services;
+			std::vector<std::unique_ptr<boost::asio::io_service::work> > m_Works;
+			std::vector<std::unique_ptr<std::thread> > m_Threads;
+			std::atomic<unsigned int> m_NextService;
+	};
 }
 }
 